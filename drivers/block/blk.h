@@ -7,9 +7,10 @@
 #include <linux/genhd.h>
 
 /*
- * NR_REQUEST is the number of entries in the request-queue.
- * NOTE that writes may use only the low 2/3 of these: reads
- * take precedence.
+ * NR_REQUEST is the default number of entries in a device's request
+ * pool: a driver can ask for another depth by setting nr_requests in its
+ * blk_dev entry before the first request. NOTE that writes may use only
+ * 2/3 of these: reads take precedence.
  *
  * 32 seems to be a reasonable number: enough to get some benefit
  * from the elevator-mechanism, but not so much as to lock a lot of
@@ -36,6 +37,8 @@ struct request {
 	struct buffer_head * bh;
 	struct buffer_head * bhtail;
 	struct request * next;
+	unsigned long expires;	/* deadline for the deadline elevator */
+	struct request * free_next;	/* link in the device's free pool */
 };
 
 /*
@@ -48,9 +51,29 @@ struct request {
 ((s1)->dev < (s2)->dev || (((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector)))))
 
+struct blk_dev_struct;
+
+/*
+ * An elevator decides where in the queue a new request goes. It is
+ * called with interrupts disabled and a non-empty queue, and must never
+ * put anything in front of current_request, which the driver may
+ * already be working on.
+ */
+struct elevator {
+	char * name;
+	void (*add_request)(struct blk_dev_struct * dev, struct request * req);
+};
+
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	struct elevator * elevator;
+	int can_merge;		/* driver follows the b_reqnext chain of a request */
+	int nr_requests;	/* depth of the request pool */
+	int nr_free_requests;
+	struct request * free_requests;
+	struct request * request_pool;	/* NULL until the first request */
+	struct wait_queue * wait_for_request;
 };
 
 
@@ -72,7 +95,7 @@ struct sec_size {
 
 extern struct sec_size * blk_sec[MAX_BLKDEV];
 extern struct blk_dev_struct blk_dev[MAX_BLKDEV];
-extern struct wait_queue * wait_for_request;
+extern void free_request(struct request * req);
 extern void resetup_one_dev(struct gendisk *dev, int drive);
 
 extern int * blk_size[MAX_BLKDEV];
@@ -277,12 +300,9 @@ static void end_request(int uptodate)
 	CURRENT = req->next;
 	if ((p = req->waiting) != NULL) {
 		req->waiting = NULL;
-		p->state = TASK_RUNNING;
-		if (p->counter > current->counter)
-			need_resched = 1;
+		wake_up_process(p);
 	}
-	req->dev = -1;
-	wake_up(&wait_for_request);
+	free_request(req);
 }
 #endif
 
@@ -729,6 +729,7 @@ unsigned long hd_init(unsigned long mem_start, unsigned long mem_end)
 		return mem_start;
 	}
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].can_merge = 1;
 	read_ahead[MAJOR_NR] = 8;		/* 8 sector (4kB) read-ahead */
 	hd_gendisk.next = gendisk_head;
 	gendisk_head = &hd_gendisk;
@@ -14,8 +14,10 @@
 #include <linux/string.h>
 #include <linux/config.h>
 #include <linux/locks.h>
+#include <linux/malloc.h>
 
 #include <asm/system.h>
+#include <asm/segment.h>
 
 #include "blk.h"
 
@@ -23,17 +25,6 @@
 extern u_long sbpcd_init(u_long, u_long);
 #endif /* CONFIG_SBPCD */
 
-/*
- * The request-struct contains all necessary data
- * to load a nr of sectors into memory
- */
-static struct request all_requests[NR_REQUEST];
-
-/*
- * used to wait on when there are no free requests
- */
-struct wait_queue * wait_for_request = NULL;
-
 /* This specifies how many sectors to read ahead on the disk.  */
 
 int read_ahead[MAX_BLKDEV] = {0, };
@@ -75,50 +66,92 @@ int * blk_size[MAX_BLKDEV] = { NULL, NULL, };
 int * blksize_size[MAX_BLKDEV] = { NULL, NULL, };
 
 /*
- * look for a free request in the first N entries.
+ * Each device has its own pool of request structures, so a slow device
+ * filling its queue can't hold up I/O to the others. The pool is made
+ * the first time the device is used, as the drivers (SCSI in particular)
+ * register themselves at different points during boot.
+ */
+static int init_request_pool(struct blk_dev_struct * dev)
+{
+	struct request * req;
+	int nr = dev->nr_requests;
+
+	if (nr <= 0)
+		nr = NR_REQUEST;
+	if (nr > 4080 / sizeof(struct request))
+		nr = 4080 / sizeof(struct request);
+	req = (struct request *) kmalloc(nr * sizeof(struct request), GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+	if (dev->request_pool) {	/* somebody beat us to it while we slept */
+		kfree_s(req, nr * sizeof(struct request));
+		return 0;
+	}
+	dev->request_pool = req;
+	dev->nr_requests = nr;
+	dev->nr_free_requests = nr;
+	dev->free_requests = NULL;
+	for (req += nr ; --req >= dev->request_pool ; ) {
+		req->dev = -1;
+		req->next = NULL;
+		req->free_next = dev->free_requests;
+		dev->free_requests = req;
+	}
+	return 0;
+}
+
+/*
+ * take a request from the device's pool, leaving at least "reserve" of
+ * them free.
  * NOTE: interrupts must be disabled on the way in, and will still
  *       be disabled on the way out.
  */
-static inline struct request * get_request(int n, int dev)
+static inline struct request * get_request(struct blk_dev_struct * q, int reserve, int dev)
 {
-	static struct request *prev_found = NULL, *prev_limit = NULL;
-	register struct request *req, *limit;
-
-	if (n <= 0)
-		panic("get_request(%d): impossible!\n", n);
+	struct request * req;
 
-	limit = all_requests + n;
-	if (limit != prev_limit) {
-		prev_limit = limit;
-		prev_found = all_requests;
-	}
-	req = prev_found;
-	for (;;) {
-		req = ((req > all_requests) ? req : limit) - 1;
-		if (req->dev < 0)
-			break;
-		if (req == prev_found)
-			return NULL;
-	}
-	prev_found = req;
+	if (q->nr_free_requests <= reserve)
+		return NULL;
+	req = q->free_requests;
+	q->free_requests = req->free_next;
+	q->nr_free_requests--;
 	req->dev = dev;
 	return req;
 }
 
 /*
- * wait until a free request in the first N entries is available.
+ * wait until a free request is available.
  * NOTE: interrupts must be disabled on the way in, and will still
  *       be disabled on the way out.
  */
-static inline struct request * get_request_wait(int n, int dev)
+static inline struct request * get_request_wait(struct blk_dev_struct * q, int dev)
 {
 	register struct request *req;
 
-	while ((req = get_request(n, dev)) == NULL)
-		sleep_on(&wait_for_request);
+	while ((req = get_request(q, 0, dev)) == NULL)
+		sleep_on(&q->wait_for_request);
 	return req;
 }
 
+/*
+ * Give a finished request back to its device's pool. Called by the
+ * drivers, possibly from an interrupt.
+ */
+void free_request(struct request * req)
+{
+	struct blk_dev_struct * q = blk_dev + MAJOR(req->dev);
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	req->dev = -1;
+	req->free_next = q->free_requests;
+	q->free_requests = req;
+	q->nr_free_requests++;
+	restore_flags(flags);
+	wake_up(&q->wait_for_request);
+}
+
 /* RO fail safe mechanism */
 
 static long ro_bits[MAX_BLKDEV][8];
@@ -144,6 +177,127 @@ void set_device_ro(int dev,int flag)
 	else ro_bits[major][minor >> 5] &= ~(1 << (minor & 31));
 }
 
+/*
+ * Sort a request into the queue somewhere after "tmp", keeping the
+ * one-way elevator order of IN_ORDER(): the scan wraps round once it
+ * passes the last request.
+ */
+static inline void elevator_insert(struct request * tmp, struct request * req)
+{
+	for ( ; tmp->next ; tmp = tmp->next) {
+		if ((IN_ORDER(tmp,req) ||
+		    !IN_ORDER(tmp,tmp->next)) &&
+		    IN_ORDER(req,tmp->next))
+			break;
+	}
+	req->next = tmp->next;
+	tmp->next = req;
+}
+
+static void elevator_add(struct blk_dev_struct * dev, struct request * req)
+{
+	elevator_insert(dev->current_request, req);
+}
+
+/*
+ * Deadline: requests are sorted as by the elevator, but each is stamped
+ * with an expiry time, much shorter for reads than for writes (the stamp
+ * goes on in add_request(), whatever the policy, so requests already
+ * queued when a device is switched to deadline carry one too). Every
+ * time a request is queued, the oldest expired read (or failing that,
+ * the oldest expired write) is moved to the front of the queue, so a
+ * steady stream of new requests elsewhere on the disk can't starve it.
+ */
+static int read_expire = HZ/2;
+static int write_expire = 5*HZ;
+
+static void deadline_add(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * head = dev->current_request;
+	struct request * tmp, * prev;
+	struct request * expired[2] = { NULL, NULL }, * before[2];
+	int rw;
+
+	for (prev = head ; (tmp = prev->next) != NULL ; prev = tmp) {
+		if ((long) (jiffies - tmp->expires) < 0)
+			continue;
+		rw = tmp->cmd & 1;
+		if (!expired[rw] || (long) (tmp->expires - expired[rw]->expires) < 0) {
+			expired[rw] = tmp;
+			before[rw] = prev;
+		}
+	}
+	rw = expired[READ] ? READ : WRITE;
+	if ((tmp = expired[rw]) == NULL) {
+		elevator_insert(head, req);
+		return;
+	}
+	if (before[rw] != head) {
+		before[rw]->next = tmp->next;
+		tmp->next = head->next;
+		head->next = tmp;
+	}
+	elevator_insert(tmp, req);
+}
+
+/*
+ * Fifo: no reordering at all, for devices where seeking is free.
+ */
+static void fifo_add(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * tmp;
+
+	for (tmp = dev->current_request ; tmp->next ; tmp = tmp->next)
+		/* nothing */;
+	tmp->next = req;
+}
+
+static struct elevator elevators[] = {
+	{ "elevator", elevator_add },
+	{ "deadline", deadline_add },
+	{ "fifo", fifo_add }
+};
+
+#define NR_ELEVATORS (sizeof(elevators) / sizeof(elevators[0]))
+
+/*
+ * BLKELVGET/BLKELVSET: get or set the elevator used for a device's
+ * queue. All minors of a major share the queue.
+ */
+int blk_elevator_ioctl(dev_t dev, unsigned int cmd, unsigned long arg)
+{
+	struct blk_dev_struct * bd;
+	unsigned int major = MAJOR(dev);
+	int error;
+	long i;
+
+	if (major >= MAX_BLKDEV || !blk_dev[major].request_fn)
+		return -ENODEV;
+	bd = blk_dev + major;
+	switch (cmd) {
+		case BLKELVGET:
+			error = verify_area(VERIFY_WRITE, (void *) arg, sizeof(long));
+			if (error)
+				return error;
+			put_fs_long(bd->elevator - elevators, (long *) arg);
+			return 0;
+		case BLKELVSET:
+			if (!suser())
+				return -EPERM;
+			error = verify_area(VERIFY_READ, (void *) arg, sizeof(long));
+			if (error)
+				return error;
+			i = get_fs_long((long *) arg);
+			if (i < 0 || i >= NR_ELEVATORS)
+				return -EINVAL;
+			cli();
+			bd->elevator = elevators + i;
+			sti();
+			return 0;
+	}
+	return -EINVAL;
+}
+
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
@@ -151,26 +305,18 @@ void set_device_ro(int dev,int flag)
  */
 static void add_request(struct blk_dev_struct * dev, struct request * req)
 {
-	struct request * tmp;
-
 	req->next = NULL;
+	req->expires = jiffies + (req->cmd == READ ? read_expire : write_expire);
 	cli();
 	if (req->bh)
 		req->bh->b_dirt = 0;
-	if (!(tmp = dev->current_request)) {
+	if (!dev->current_request) {
 		dev->current_request = req;
 		(dev->request_fn)();
 		sti();
 		return;
 	}
-	for ( ; tmp->next ; tmp = tmp->next) {
-		if ((IN_ORDER(tmp,req) ||
-		    !IN_ORDER(tmp,tmp->next)) &&
-		    IN_ORDER(req,tmp->next))
-			break;
-	}
-	req->next = tmp->next;
-	tmp->next = req;
+	dev->elevator->add_request(dev, req);
 
 /* for SCSI devices, call request_fn unconditionally */
 	if (scsi_major(MAJOR(req->dev)))
@@ -183,7 +329,8 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 {
 	unsigned int sector, count;
 	struct request * req;
-	int rw_ahead, max_req;
+	struct blk_dev_struct * q = blk_dev + major;
+	int rw_ahead, reserve;
 
 /* WRITEA/READA is special case - it is not really needed, so if the */
 /* buffer is locked, we just forget about it, else it's a normal read */
@@ -213,11 +360,17 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 		return;
 	}
 
+	if (!q->request_pool && init_request_pool(q)) {
+		printk("make_request: no memory for a request pool\n");
+		unlock_buffer(bh);
+		return;
+	}
+
 /* we don't allow the write-requests to fill up the queue completely:
  * we want some room for reads: they take precedence. The last third
  * of the requests are only for reads.
  */
-	max_req = (rw == READ) ? NR_REQUEST : ((NR_REQUEST*2)/3);
+	reserve = (rw == READ) ? 0 : q->nr_requests/3;
 
 /* big loop: look for a free request. */
 
@@ -226,14 +379,13 @@ repeat:
 
 /* The scsi disk drivers completely remove the request from the queue when
  * they start processing an entry.  For this reason it is safe to continue
- * to add links to the top entry for scsi devices.
+ * to add links to the top entry for scsi devices. Other drivers may be
+ * working on it, so it is left alone. Only drivers that set can_merge
+ * follow the buffer chain of a request; the rest assume one buffer.
  */
-	if ((major == HD_MAJOR
-	     || major == SCSI_DISK_MAJOR
-	     || major == SCSI_CDROM_MAJOR)
-	    && (req = blk_dev[major].current_request))
+	if (blk_dev[major].can_merge && (req = blk_dev[major].current_request))
 	{
-	        if (major == HD_MAJOR)
+	        if (!scsi_major(major))
 			req = req->next;
 		while (req) {
 			if (req->dev == bh->b_dev &&
@@ -272,7 +424,7 @@ repeat:
 	}
 
 /* find an unused request. */
-	req = get_request(max_req, bh->b_dev);
+	req = get_request(q, reserve, bh->b_dev);
 
 /* if no request available: if rw_ahead, forget it; otherwise try again. */
 	if (! req) {
@@ -281,7 +433,7 @@ repeat:
 			unlock_buffer(bh);
 			return;
 		}
-		sleep_on(&wait_for_request);
+		sleep_on(&q->wait_for_request);
 		sti();
 		goto repeat;
 	}
@@ -318,8 +470,12 @@ void ll_rw_page(int rw, int dev, int page, char * buffer)
 		printk("Can't page to read-only device 0x%X\n",dev);
 		return;
 	}
+	if (!blk_dev[major].request_pool && init_request_pool(blk_dev+major)) {
+		printk("ll_rw_page: no memory for a request pool\n");
+		return;
+	}
 	cli();
-	req = get_request_wait(NR_REQUEST, dev);
+	req = get_request_wait(blk_dev+major, dev);
 	sti();
 /* fill up the request-info, and add it to the queue */
 	req->cmd = rw;
@@ -449,13 +605,17 @@ void ll_rw_swap_file(int rw, int dev, unsigned int *b, int nb, char *buf)
 		printk("Can't swap to read-only device 0x%X\n",dev);
 		return;
 	}
+	if (!blk_dev[major].request_pool && init_request_pool(blk_dev+major)) {
+		printk("ll_rw_swap_file: no memory for a request pool\n");
+		return;
+	}
 	
 	buffersize = PAGE_SIZE / nb;
 
 	for (i=0; i<nb; i++, buf += buffersize)
 	{
 		cli();
-		req = get_request_wait(NR_REQUEST, dev);
+		req = get_request_wait(blk_dev+major, dev);
 		sti();
 		req->cmd = rw;
 		req->errors = 0;
@@ -474,13 +634,10 @@ void ll_rw_swap_file(int rw, int dev, unsigned int *b, int nb, char *buf)
 
 long blk_dev_init(long mem_start, long mem_end)
 {
-	struct request * req;
+	struct blk_dev_struct * dev;
 
-	req = all_requests + NR_REQUEST;
-	while (--req >= all_requests) {
-		req->dev = -1;
-		req->next = NULL;
-	}
+	for (dev = blk_dev ; dev < blk_dev + MAX_BLKDEV ; dev++)
+		dev->elevator = elevators;
 	memset(ro_bits,0,sizeof(ro_bits));
 #ifdef CONFIG_BLK_DEV_HD
 	mem_start = hd_init(mem_start,mem_end);
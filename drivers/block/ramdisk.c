@@ -52,6 +52,9 @@ repeat:
 			      len);
 	} else
 		panic("RAMDISK: unknown RAM disk command !\n");
+	/* merged requests: move on to the next buffer */
+	CURRENT->sector += CURRENT->current_nr_sectors;
+	CURRENT->nr_sectors -= CURRENT->current_nr_sectors;
 	end_request(1);
 	goto repeat;
 }
@@ -82,6 +85,7 @@ long rd_init(long mem_start, int length)
 		return 0;
 	}
 	blk_dev[MEM_MAJOR].request_fn = DEVICE_REQUEST;
+	blk_dev[MEM_MAJOR].can_merge = 1;
 	rd_start = (char *) mem_start;
 	rd_length = length;
 	cp = rd_start;
@@ -579,7 +579,7 @@ Scsi_Cmnd * request_queueable (struct request * req, int index)
       req->buffer = bh->b_data;
       SCpnt->request.waiting = NULL; /* Wait until whole thing done */
     } else
-      req->dev = -1;
+      free_request(req);
       
   } else {
     SCpnt->request.dev = 0xffff; /* Busy, but no request */
@@ -677,7 +677,7 @@ Scsi_Cmnd * allocate_device (struct request ** reqp, int index, int wait)
 	  }
 	  else 
 	    {
-	      req->dev = -1;
+	      free_request(req);
 	      *reqp = req->next;
 	    };
 	} else {
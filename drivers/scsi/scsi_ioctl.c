@@ -80,9 +80,7 @@ static void scsi_ioctl_done (Scsi_Cmnd * SCpnt)
   
   if ((p = req->waiting) != NULL) {
     req->waiting = NULL;
-    p->state = TASK_RUNNING;
-    if (p->counter > current->counter)
-      need_resched = 1;
+    wake_up_process(p);
   }
 }	
 
@@ -370,8 +370,6 @@ static void do_sd_request (void)
     
     if (!SCpnt) return; /* Could not find anything to do */
     
-    wake_up(&wait_for_request);
-    
     /* Queue command */
     requeue_sd_request(SCpnt);
   };  /* While */
@@ -655,9 +653,7 @@ static void sd_init_done (Scsi_Cmnd * SCpnt)
   
   if ((p = req->waiting) != NULL) {
     req->waiting = NULL;
-    p->state = TASK_RUNNING;
-    if (p->counter > current->counter)
-      need_resched = 1;
+    wake_up_process(p);
   }
 }
 
@@ -888,6 +884,7 @@ unsigned long sd_init(unsigned long memory_start, unsigned long memory_end)
 	  i = sd_init_onedisk(i);
 
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].can_merge = 1;
 
 	/* If our host adapter is capable of scatter-gather, then we increase
 	   the read-ahead to 16 blocks (32 sectors).  If not, we use
@@ -336,8 +336,6 @@ static void do_sr_request (void)
     if (!SCpnt)
       return; /* Could not find anything to do */
     
-  wake_up(&wait_for_request);
-
 /* Queue command */
   requeue_sr_request(SCpnt);
   };  /* While */
@@ -638,9 +636,7 @@ static void sr_init_done (Scsi_Cmnd * SCpnt)
   
   if ((p = req->waiting) != NULL) {
     req->waiting = NULL;
-    p->state = TASK_RUNNING;
-    if (p->counter > current->counter)
-      need_resched = 1;
+    wake_up_process(p);
   }
 }
 
@@ -737,6 +733,7 @@ unsigned long sr_init(unsigned long memory_start, unsigned long memory_end)
 		}
 
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].can_merge = 1;
 	blk_size[MAJOR_NR] = sr_sizes;	
 
 	/* If our host adapter is capable of scatter-gather, then we increase
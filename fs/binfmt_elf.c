@@ -52,7 +52,7 @@ unsigned long * create_elf_tables(char * p,int argc,int envc,struct elfhdr * exe
 	unsigned long * sp;
 	struct vm_area_struct *mpnt;
 
-	mpnt = (struct vm_area_struct *)kmalloc(sizeof(*mpnt), GFP_KERNEL);
+	mpnt = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 	if (mpnt) {
 		mpnt->vm_task = current;
 		mpnt->vm_start = PAGE_MASK & (unsigned long) p;
@@ -67,7 +67,7 @@ int block_write(struct inode * inode, struct file * filp, char * buf, int count)
 		p += chars;
 		buf += chars;
 		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
 	}
 	return written;
@@ -25,9 +25,11 @@
 #include <linux/major.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/kernel_stat.h>
 #include <linux/errno.h>
 
 #include <asm/system.h>
+#include <asm/segment.h>
 #include <asm/io.h>
 
 #ifdef CONFIG_SCSI
@@ -47,15 +49,52 @@ extern int check_mcd_media_change(int, int);
 #endif
 
 static int grow_buffers(int pri, int size);
+static int flush_dirty_buffers(int isize, int all, int limit);
 
-static struct buffer_head * hash_table[NR_HASH];
-static struct buffer_head * free_list = NULL;
+/*
+ * Buffers are kept on one LRU list per block size and state (clean,
+ * locked, dirty), so getblk() only ever has to look at the clean
+ * buffers of the right size. Interrupts never move buffers between
+ * lists: a buffer whose I/O finished is refiled the next time somebody
+ * comes across it.
+ */
+#define NR_SIZES 4
+static int buffersize_index[9] = {-1,  0,  1, -1,  2, -1, -1, -1, 3};
+#define BUFSIZE_INDEX(X) (buffersize_index[(X)>>9])
+
+static struct buffer_head ** hash_table;
+static unsigned int hash_bits;
+static struct buffer_head * lru_list[NR_SIZES][NR_LIST] = {{NULL, }, };
+static int nr_buffers_type[NR_SIZES][NR_LIST] = {{0, }, };
 static struct buffer_head * unused_list = NULL;
 static struct wait_queue * buffer_wait = NULL;
 
 int nr_buffers = 0;
 int buffermem = 0;
 int nr_buffer_heads = 0;
+static unsigned long hash_lookups = 0, hash_hits = 0, hash_probes = 0;
+static unsigned long nr_hashed = 0, hash_used = 0;
+
+/*
+ * Tunables for the bdflush daemon, settable through sys_bdflush():
+ *	0: percentage of dirty buffers that wakes bdflush early
+ *	1: maximum number of buffers written per wake-up
+ *	2: ticks a buffer may stay dirty before bdflush writes it
+ *	3: ticks between bdflush wake-ups
+ */
+#define N_PARAM 4
+static int bdf_prm[N_PARAM] = { 25, 256, 30*HZ, 5*HZ };
+static int bdflush_min[N_PARAM] = { 1, 1, HZ, 1 };
+static int bdflush_max[N_PARAM] = { 100, 5000, 600*HZ, 600*HZ };
+#define bdf_nfract	bdf_prm[0]
+#define bdf_ndirty	bdf_prm[1]
+#define bdf_age		bdf_prm[2]
+#define bdf_interval	bdf_prm[3]
+
+static struct wait_queue * bdflush_wait = NULL;
+static int bdflush_running = 0;
+static unsigned long bdflush_wakeups = 0, bdflush_aged = 0;
+static unsigned long bdflush_early = 0, bdflush_batches = 0;
 static int min_free_pages = 20;	/* nr free pages needed before buffer grows */
 extern int *blksize_size[];
 
@@ -92,51 +131,65 @@ repeat:
 static int sync_buffers(dev_t dev, int wait)
 {
 	int i, retry, pass = 0, err = 0;
-	struct buffer_head * bh;
+	int isize, nlist;
+	struct buffer_head * bh, * next;
 
 	/* One pass for no-wait, three for wait:
 	   0) write out all dirty, unlocked buffers;
 	   1) write out all dirty buffers, waiting if locked;
 	   2) wait for completion by waiting for all buffers to unlock.
+	   Only the locked and dirty lists can hold anything of interest.
 	 */
 repeat:
 	retry = 0;
-	bh = free_list;
-	for (i = nr_buffers*2 ; i-- > 0 ; bh = bh->b_next_free) {
-		if (dev && bh->b_dev != dev)
-			continue;
+	for (isize = 0 ; isize < NR_SIZES ; isize++)
+	for (nlist = BUF_LOCKED ; nlist < NR_LIST ; nlist++) {
+	repeat_list:
+		bh = lru_list[isize][nlist];
+		for (i = nr_buffers_type[isize][nlist]*2 ; i-- > 0 && bh ; bh = next) {
+			/* we may have slept: start over if bh moved */
+			if (bh->b_list != nlist)
+				goto repeat_list;
+			next = bh->b_next_free;
+			if (dev && bh->b_dev != dev)
+				continue;
 #ifdef NO_COMPILE /* Disable bad-block debugging code */
 		if (bh->b_req && !bh->b_lock &&
 		    !bh->b_dirt && !bh->b_uptodate)
 			printk ("Warning (IO error) - orphaned block %08x on %04x\n",
 				bh->b_blocknr, bh->b_dev);
 #endif
-		if (bh->b_lock)
-		{
-			/* Buffer is locked; skip it unless wait is
-			   requested AND pass > 0. */
-			if (!wait || !pass) {
-				retry = 1;
+			if (bh->b_lock)
+			{
+				/* Buffer is locked; skip it unless wait is
+				   requested AND pass > 0. */
+				if (!wait || !pass) {
+					retry = 1;
+					continue;
+				}
+				wait_on_buffer (bh);
+			}
+			/* If an unlocked buffer is not uptodate, there has been 
+			   an IO error. Skip it. */
+			if (wait && bh->b_req && !bh->b_lock &&
+			    !bh->b_dirt && !bh->b_uptodate)
+			{
+				err = 1;
+				refile_buffer(bh);
 				continue;
 			}
-			wait_on_buffer (bh);
-		}
-		/* If an unlocked buffer is not uptodate, there has been 
-		   an IO error. Skip it. */
-		if (wait && bh->b_req && !bh->b_lock &&
-		    !bh->b_dirt && !bh->b_uptodate)
-		{
-			err = 1;
-			continue;
+			/* Don't write clean buffers.  Don't write ANY buffers
+			   on the third pass. */
+			if (!bh->b_dirt || pass>=2) {
+				refile_buffer(bh);
+				continue;
+			}
+			bh->b_count++;
+			ll_rw_block(WRITE, 1, &bh);
+			bh->b_count--;
+			refile_buffer(bh);
+			retry = 1;
 		}
-		/* Don't write clean buffers.  Don't write ANY buffers
-		   on the third pass. */
-		if (!bh->b_dirt || pass>=2)
-			continue;
-		bh->b_count++;
-		ll_rw_block(WRITE, 1, &bh);
-		bh->b_count--;
-		retry = 1;
 	}
 	/* If we are waiting for the sync to succeed, and if any dirty
 	   blocks were written, then repeat; on the second pass, only
@@ -190,16 +243,19 @@ asmlinkage int sys_fsync(unsigned int fd)
 
 void invalidate_buffers(dev_t dev)
 {
-	int i;
+	int i, isize, nlist;
 	struct buffer_head * bh;
 
-	bh = free_list;
-	for (i = nr_buffers*2 ; --i > 0 ; bh = bh->b_next_free) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev)
-			bh->b_uptodate = bh->b_dirt = bh->b_req = 0;
+	for (isize = 0 ; isize < NR_SIZES ; isize++)
+	for (nlist = 0 ; nlist < NR_LIST ; nlist++) {
+		bh = lru_list[isize][nlist];
+		for (i = nr_buffers_type[isize][nlist]*2 ; i-- > 0 && bh ; bh = bh->b_next_free) {
+			if (bh->b_dev != dev)
+				continue;
+			wait_on_buffer(bh);
+			if (bh->b_dev == dev)
+				bh->b_uptodate = bh->b_dirt = bh->b_req = 0;
+		}
 	}
 }
 
@@ -276,89 +332,153 @@ void check_disk_change(dev_t dev)
 #endif
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+/*
+ * Multiplicative hashing: the table size is a power of two chosen at boot,
+ * and the top bits of the product mix both the device and the block.
+ */
+#define _hashfn(dev,block) \
+	(((((unsigned) (dev)) << 16 ^ (unsigned) (block)) * 0x9e370001UL) >> (32 - hash_bits))
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
 static inline void remove_from_hash_queue(struct buffer_head * bh)
 {
+	if (!bh->b_next && !bh->b_prev && hash(bh->b_dev,bh->b_blocknr) != bh)
+		return;
 	if (bh->b_next)
 		bh->b_next->b_prev = bh->b_prev;
 	if (bh->b_prev)
 		bh->b_prev->b_next = bh->b_next;
-	if (hash(bh->b_dev,bh->b_blocknr) == bh)
+	if (hash(bh->b_dev,bh->b_blocknr) == bh) {
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
+		if (!bh->b_next)
+			hash_used--;
+	}
 	bh->b_next = bh->b_prev = NULL;
+	nr_hashed--;
 }
 
-static inline void remove_from_free_list(struct buffer_head * bh)
+static inline void remove_from_lru_list(struct buffer_head * bh)
 {
+	struct buffer_head ** list = &lru_list[BUFSIZE_INDEX(bh->b_size)][bh->b_list];
+
 	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("VFS: Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
+		panic("VFS: LRU block list corrupted");
+	if (bh->b_next_free == bh)
+		*list = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (*list == bh)
+			*list = bh->b_next_free;
+	}
 	bh->b_next_free = bh->b_prev_free = NULL;
+	nr_buffers_type[BUFSIZE_INDEX(bh->b_size)][bh->b_list]--;
 }
 
 static inline void remove_from_queues(struct buffer_head * bh)
 {
 	remove_from_hash_queue(bh);
-	remove_from_free_list(bh);
+	remove_from_lru_list(bh);
 }
 
-static inline void put_first_free(struct buffer_head * bh)
+/* add to the back (most recently used end) of the buffer's list */
+static inline void put_last_lru(struct buffer_head * bh)
 {
-	if (!bh || (bh == free_list))
-		return;
-	remove_from_free_list(bh);
-/* add to front of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
-	free_list = bh;
+	struct buffer_head ** list = &lru_list[BUFSIZE_INDEX(bh->b_size)][bh->b_list];
+
+	if (!*list) {
+		bh->b_next_free = bh->b_prev_free = bh;
+		*list = bh;
+	} else {
+		bh->b_next_free = *list;
+		bh->b_prev_free = (*list)->b_prev_free;
+		(*list)->b_prev_free->b_next_free = bh;
+		(*list)->b_prev_free = bh;
+	}
+	nr_buffers_type[BUFSIZE_INDEX(bh->b_size)][bh->b_list]++;
 }
 
-static inline void put_last_free(struct buffer_head * bh)
+/* add to the front of the list: unused buffers are taken first */
+static inline void put_first_lru(struct buffer_head * bh)
 {
-	if (!bh)
-		return;
-	if (bh == free_list) {
-		free_list = bh->b_next_free;
-		return;
-	}
-	remove_from_free_list(bh);
-/* add to back of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
+	put_last_lru(bh);
+	lru_list[BUFSIZE_INDEX(bh->b_size)][bh->b_list] = bh;
+}
+
+static inline void touch_buffer(struct buffer_head * bh)
+{
+	remove_from_lru_list(bh);
+	put_last_lru(bh);
 }
 
 static inline void insert_into_queues(struct buffer_head * bh)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
+	struct buffer_head ** head;
+
+	put_last_lru(bh);
 /* put the buffer in new hash-queue if it has a device */
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
 	if (!bh->b_dev)
 		return;
-	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
-	hash(bh->b_dev,bh->b_blocknr) = bh;
-	if (bh->b_next)
+	head = &hash(bh->b_dev,bh->b_blocknr);
+	if (!(bh->b_next = *head))
+		hash_used++;
+	else
 		bh->b_next->b_prev = bh;
+	*head = bh;
+	nr_hashed++;
+}
+
+static int nr_dirty_buffers(void)
+{
+	int isize, nr = 0;
+
+	for (isize = 0 ; isize < NR_SIZES ; isize++)
+		nr += nr_buffers_type[isize][BUF_DIRTY];
+	return nr;
+}
+
+static inline int too_many_dirty(void)
+{
+	return nr_dirty_buffers() * 100 > nr_buffers * bdf_nfract;
+}
+
+/*
+ * Move a buffer to the list its state says it belongs on. A buffer
+ * going onto the dirty list is stamped with the time bdflush should
+ * write it by. Called from
+ * process context whenever a buffer is marked dirty, released or
+ * noticed on the wrong list.
+ */
+void refile_buffer(struct buffer_head * bh)
+{
+	int dispose;
+
+	if (bh->b_lock)
+		dispose = BUF_LOCKED;
+	else if (bh->b_dirt)
+		dispose = BUF_DIRTY;
+	else
+		dispose = BUF_CLEAN;
+	if (dispose == bh->b_list || !bh->b_next_free)
+		return;
+	remove_from_lru_list(bh);
+	bh->b_list = dispose;
+	put_last_lru(bh);
+	if (dispose == BUF_DIRTY) {
+		bh->b_flushtime = jiffies + bdf_age;
+		if (too_many_dirty())
+			wake_up(&bdflush_wait);
+	}
 }
 
 static struct buffer_head * find_buffer(dev_t dev, int block, int size)
 {		
 	struct buffer_head * tmp;
 
-	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next)
+	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next) {
+		hash_probes++;
 		if (tmp->b_dev==dev && tmp->b_blocknr==block)
 			if (tmp->b_size == size)
 				return tmp;
@@ -367,6 +487,7 @@ static struct buffer_head * find_buffer(dev_t dev, int block, int size)
 							MAJOR(dev), MINOR(dev));
 				return NULL;
 			}
+	}
 	return NULL;
 }
 
@@ -381,20 +502,23 @@ struct buffer_head * get_hash_table(dev_t dev, int block, int size)
 {
 	struct buffer_head * bh;
 
+	hash_lookups++;
 	for (;;) {
 		if (!(bh=find_buffer(dev,block,size)))
 			return NULL;
 		bh->b_count++;
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_blocknr == block && bh->b_size == size)
+		if (bh->b_dev == dev && bh->b_blocknr == block && bh->b_size == size) {
+			hash_hits++;
 			return bh;
+		}
 		bh->b_count--;
 	}
 }
 
 void set_blocksize(dev_t dev, int size)
 {
-	int i;
+	int i, isize, nlist;
 	struct buffer_head * bh, *bhnext;
 
 	if (!blksize_size[MAJOR(dev)])
@@ -415,22 +539,80 @@ void set_blocksize(dev_t dev, int size)
 	blksize_size[MAJOR(dev)][MINOR(dev)] = size;
 
   /* We need to be quite careful how we do this - we are moving entries
-     around on the free list, and we can get in a loop if we are not careful.*/
+     around on the lists, and we can get in a loop if we are not careful.*/
+
+	for (isize = 0 ; isize < NR_SIZES ; isize++) {
+		if (isize == BUFSIZE_INDEX(size))
+			continue;
+		for (nlist = 0 ; nlist < NR_LIST ; nlist++) {
+			bh = lru_list[isize][nlist];
+			for (i = nr_buffers_type[isize][nlist]*2 ; i-- > 0 && bh ; bh = bhnext) {
+				bhnext = bh->b_next_free; 
+				if (bh->b_dev != dev)
+					continue;
+
+				wait_on_buffer(bh);
+				if (bh->b_dev == dev && bh->b_size != size)
+					bh->b_uptodate = bh->b_dirt = 0;
+				remove_from_hash_queue(bh);
+			}
+		}
+	}
+}
+
+/*
+ * Find a buffer of the given size that can be reused. Clean buffers are
+ * kept in LRU order, so normally the first one will do: buffers that
+ * turn out to be locked or dirty are moved to their own lists, and ones
+ * still in use are rotated to the back, so that each buffer is passed
+ * over at most once per trip round the list.
+ */
+static struct buffer_head * find_candidate(int isize)
+{
+	struct buffer_head * bh;
+	int buffers;
 
-	bh = free_list;
-	for (i = nr_buffers*2 ; --i > 0 ; bh = bhnext) {
-		bhnext = bh->b_next_free; 
-		if (bh->b_dev != dev)
+	/* writes that have completed put their buffers back in play */
+	while ((bh = lru_list[isize][BUF_LOCKED]) != NULL && !bh->b_lock)
+		refile_buffer(bh);
+
+	buffers = nr_buffers_type[isize][BUF_CLEAN];
+	while (buffers-- > 0 && (bh = lru_list[isize][BUF_CLEAN]) != NULL) {
+		if (bh->b_lock || bh->b_dirt) {
+			refile_buffer(bh);
 			continue;
-		if (bh->b_size == size)
+		}
+		if (bh->b_count || mem_map[MAP_NR((unsigned long) bh->b_data)] != 1) {
+			lru_list[isize][BUF_CLEAN] = bh->b_next_free;
 			continue;
+		}
+		return bh;
+	}
+	return NULL;
+}
+
+#define NR_WAIT_BATCH 8
 
+/*
+ * There is no clean buffer of this size to be had: write a few of the
+ * oldest dirty ones, leave the rest to bdflush, and wait for the oldest
+ * write to finish. Returns 0 if there was nothing to wait for.
+ */
+static int wait_for_buffers(int isize)
+{
+	struct buffer_head * bh;
+	int i;
+
+	wake_up(&bdflush_wait);
+	flush_dirty_buffers(isize, 1, NR_WAIT_BATCH);
+	i = nr_buffers_type[isize][BUF_LOCKED];
+	while (i-- > 0 && (bh = lru_list[isize][BUF_LOCKED]) != NULL) {
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_size != size)
-			bh->b_uptodate = bh->b_dirt = 0;
-		remove_from_hash_queue(bh);
-/*    put_first_free(bh); */
+		refile_buffer(bh);
+		if (bh->b_list == BUF_CLEAN)
+			return 1;
 	}
+	return 0;
 }
 
 /*
@@ -442,19 +624,27 @@ void set_blocksize(dev_t dev, int size)
  *
  * 14.02.92: changed it to sync dirty buffers a bit: better performance
  * when the filesystem starts to get full of dirty blocks (I hope).
+ *
+ * Free buffers now come off the per-size clean list instead of a walk
+ * over every buffer in the system.
  */
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 struct buffer_head * getblk(dev_t dev, int block, int size)
 {
-	struct buffer_head * bh, * tmp;
-	int buffers;
+	struct buffer_head * bh;
+	int isize = BUFSIZE_INDEX(size);
 	static int grow_size = 0;
 
+	if ((size & 511) || size > PAGE_SIZE || isize < 0) {
+		printk("VFS: getblk: bad blocksize %d on device %d/%d\n",
+			size, MAJOR(dev), MINOR(dev));
+		return NULL;
+	}
 repeat:
 	bh = get_hash_table(dev, block, size);
 	if (bh) {
+		refile_buffer(bh);
 		if (bh->b_uptodate && !bh->b_dirt)
-			put_last_free(bh);
+			touch_buffer(bh);
 		return bh;
 	}
 	grow_size -= size;
@@ -462,45 +652,19 @@ repeat:
 		if (grow_buffers(GFP_BUFFER, size))
 			grow_size = PAGE_SIZE;
 	}
-	buffers = nr_buffers;
-	bh = NULL;
 
-	for (tmp = free_list; buffers-- > 0 ; tmp = tmp->b_next_free) {
-		if (tmp->b_count || tmp->b_size != size)
-			continue;
-		if (mem_map[MAP_NR((unsigned long) tmp->b_data)] != 1)
-			continue;
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
-		}
-#if 0
-		if (tmp->b_dirt) {
-			tmp->b_count++;
-			ll_rw_block(WRITEA, 1, &tmp);
-			tmp->b_count--;
-		}
-#endif
-	}
-
-	if (!bh) {
+	if (!(bh = find_candidate(isize))) {
 		if (nr_free_pages > 5)
 			if (grow_buffers(GFP_BUFFER, size))
 				goto repeat;
+		if (wait_for_buffers(isize))
+			goto repeat;
 		if (!grow_buffers(GFP_ATOMIC, size))
 			sleep_on(&buffer_wait);
 		goto repeat;
 	}
 
-	wait_on_buffer(bh);
-	if (bh->b_count || bh->b_size != size)
-		goto repeat;
-	if (bh->b_dirt) {
-		sync_buffers(0,0);
-		goto repeat;
-	}
-/* NOTE!! While we slept waiting for this block, somebody else might */
+/* NOTE!! We may have slept growing the cache, and somebody else might */
 /* already have added "this" block to the cache. check it */
 	if (find_buffer(dev,block,size))
 		goto repeat;
@@ -522,6 +686,7 @@ void brelse(struct buffer_head * buf)
 	if (!buf)
 		return;
 	wait_on_buffer(buf);
+	refile_buffer(buf);
 	if (buf->b_count) {
 		if (--buf->b_count)
 			return;
@@ -857,6 +1022,55 @@ unsigned long bread_page(unsigned long address, dev_t dev, int b[], int size, in
 	return where;
 }
 
+/*
+ * read_page_blocks reads the blocks of a page straight into the page,
+ * for the page cache, instead of into buffers that are then copied.
+ * Blocks that are in the buffer cache already are copied from there, as
+ * they may be newer than what is on disk. Holes (zero block numbers) are
+ * skipped, so the page should come in cleared.
+ */
+void read_page_blocks(unsigned long address, dev_t dev, int b[], int size)
+{
+	struct buffer_head * bh[8];
+	struct buffer_head * tmp;
+	int i, j, nr = 0;
+
+ 	for (i=0, j=0; j<PAGE_SIZE ; i++, j += size, address += size) {
+		if (!b[i])
+			continue;
+		tmp = get_hash_table(dev, b[i], size);
+		if (tmp) {
+			if (tmp->b_uptodate) {
+				COPYBLK(size, (unsigned long) tmp->b_data, address);
+				brelse(tmp);
+				continue;
+			}
+			brelse(tmp);
+		}
+		tmp = get_unused_buffer_head();
+		if (!tmp) {
+			/* out of buffer heads: go through the cache after all */
+			if ((tmp = bread(dev, b[i], size)) != NULL) {
+				COPYBLK(size, (unsigned long) tmp->b_data, address);
+				brelse(tmp);
+			}
+			continue;
+		}
+		tmp->b_data = (char *) address;
+		tmp->b_size = size;
+		tmp->b_dev = dev;
+		tmp->b_blocknr = b[i];
+		tmp->b_count = 1;
+		bh[nr++] = tmp;
+	}
+	if (nr)
+		ll_rw_block(READ, nr, bh);
+	for (i = 0 ; i < nr ; i++) {
+		wait_on_buffer(bh[i]);
+		put_unused_buffer_head(bh[i]);
+	}
+}
+
 /*
  * Try to increase the number of buffers available: the size argument
  * is used to determine what kind of buffers we want.
@@ -879,16 +1093,8 @@ static int grow_buffers(int pri, int size)
 	}
 	tmp = bh;
 	while (1) {
-		if (free_list) {
-			tmp->b_next_free = free_list;
-			tmp->b_prev_free = free_list->b_prev_free;
-			free_list->b_prev_free->b_next_free = tmp;
-			free_list->b_prev_free = tmp;
-		} else {
-			tmp->b_prev_free = tmp;
-			tmp->b_next_free = tmp;
-		}
-		free_list = tmp;
+		tmp->b_list = BUF_CLEAN;
+		put_first_lru(tmp);
 		++nr_buffers;
 		if (tmp->b_this_page)
 			tmp = tmp->b_this_page;
@@ -904,12 +1110,11 @@ static int grow_buffers(int pri, int size)
  * try_to_free() checks if all the buffers on this particular page
  * are unused, and free's the page if so.
  */
-static int try_to_free(struct buffer_head * bh, struct buffer_head ** bhp)
+static int try_to_free(struct buffer_head * bh)
 {
 	unsigned long page;
 	struct buffer_head * tmp, * p;
 
-	*bhp = bh;
 	page = (unsigned long) bh->b_data;
 	page &= PAGE_MASK;
 	tmp = bh;
@@ -925,8 +1130,6 @@ static int try_to_free(struct buffer_head * bh, struct buffer_head ** bhp)
 		p = tmp;
 		tmp = tmp->b_this_page;
 		nr_buffers--;
-		if (p == *bhp)
-			*bhp = p->b_prev_free;
 		remove_from_queues(p);
 		put_unused_buffer_head(p);
 	} while (tmp != bh);
@@ -936,28 +1139,21 @@ static int try_to_free(struct buffer_head * bh, struct buffer_head ** bhp)
 }
 
 /*
- * Try to free up some pages by shrinking the buffer-cache
- *
- * Priority tells the routine how hard to try to shrink the
- * buffers: 3 means "don't bother too much", while a value
- * of 0 means "we'd better get some free pages now".
+ * Look at up to *budget buffers from the front of one list, oldest
+ * first. Every buffer looked at goes to the back of the list.
  */
-int shrink_buffers(unsigned int priority)
+static int shrink_specific_buffers(unsigned int priority, int isize, int nlist,
+	int * budget)
 {
 	struct buffer_head *bh;
-	int i;
 
-	if (priority < 2)
-		sync_buffers(0,0);
-	bh = free_list;
-	i = nr_buffers >> priority;
-	for ( ; i-- > 0 ; bh = bh->b_next_free) {
+	while ((*budget)-- > 0 && (bh = lru_list[isize][nlist]) != NULL) {
+		lru_list[isize][nlist] = bh->b_next_free;
+		vmstat.buffers_scanned++;
 		if (bh->b_count ||
 		    (priority >= 5 &&
-		     mem_map[MAP_NR((unsigned long) bh->b_data)] > 1)) {
-			put_last_free(bh);
+		     mem_map[MAP_NR((unsigned long) bh->b_data)] > 1))
 			continue;
-		}
 		if (!bh->b_this_page)
 			continue;
 		if (bh->b_lock)
@@ -971,33 +1167,119 @@ int shrink_buffers(unsigned int priority)
 			bh->b_count--;
 			continue;
 		}
-		if (try_to_free(bh, &bh))
+		if (try_to_free(bh))
 			return 1;
 	}
 	return 0;
 }
 
+/*
+ * Try to free up some pages by shrinking the buffer-cache
+ *
+ * Priority tells the routine how hard to try to shrink the
+ * buffers: 3 means "don't bother too much", while a value
+ * of 0 means "we'd better get some free pages now".
+ *
+ * Clean buffers are tried first, as they can go without any I/O.
+ */
+int shrink_buffers(unsigned int priority)
+{
+	int i, isize, nlist;
+
+	if (priority < 2)
+		sync_buffers(0,0);
+	i = nr_buffers >> priority;
+	for (nlist = BUF_CLEAN ; nlist < NR_LIST ; nlist++)
+		for (isize = 0 ; isize < NR_SIZES ; isize++)
+			if (shrink_specific_buffers(priority, isize, nlist, &i))
+				return 1;
+	return 0;
+}
+
 void show_buffers(void)
 {
 	struct buffer_head * bh;
 	int found = 0, locked = 0, dirty = 0, used = 0, lastused = 0;
+	int isize, nlist;
+	static char *buf_types[NR_LIST] = {"CLEAN","LOCKED","DIRTY"};
 
 	printk("Buffer memory:   %6dkB\n",buffermem>>10);
 	printk("Buffer heads:    %6d\n",nr_buffer_heads);
 	printk("Buffer blocks:   %6d\n",nr_buffers);
-	bh = free_list;
-	do {
-		found++;
-		if (bh->b_lock)
-			locked++;
-		if (bh->b_dirt)
-			dirty++;
-		if (bh->b_count)
-			used++, lastused = found;
-		bh = bh->b_next_free;
-	} while (bh != free_list);
-	printk("Buffer mem: %d buffers, %d used (last=%d), %d locked, %d dirty\n",
-		found, used, lastused, locked, dirty);
+	for (isize = 0 ; isize < NR_SIZES ; isize++)
+	for (nlist = 0 ; nlist < NR_LIST ; nlist++) {
+		found = locked = dirty = used = lastused = 0;
+		bh = lru_list[isize][nlist];
+		if (!bh)
+			continue;
+		do {
+			found++;
+			if (bh->b_lock)
+				locked++;
+			if (bh->b_dirt)
+				dirty++;
+			if (bh->b_count)
+				used++, lastused = found;
+			bh = bh->b_next_free;
+		} while (bh != lru_list[isize][nlist]);
+		printk("%5d %-6s: %d buffers, %d used (last=%d), %d locked, %d dirty\n",
+			512 << isize, buf_types[nlist],
+			found, used, lastused, locked, dirty);
+	}
+}
+
+/* a/b in hundredths, without overflowing on long-running counters */
+static unsigned long ratio100(unsigned long a, unsigned long b)
+{
+	if (!b)
+		return 0;
+	if (b >= 1000000)
+		return a / (b / 100);
+	return (a * 100) / b;
+}
+
+/*
+ * Lookup statistics for /proc/buffers.
+ */
+int get_buffer_stats(char * buffer)
+{
+	unsigned long chain, probes, hits;
+
+	chain = ratio100(nr_hashed, hash_used);
+	probes = ratio100(hash_probes, hash_lookups);
+	hits = ratio100(hash_hits, hash_lookups);
+	return sprintf(buffer,
+		"hash buckets:   %8u\n"
+		"buckets used:   %8lu\n"
+		"hashed buffers: %8lu\n"
+		"avg chain:      %5lu.%02lu\n"
+		"lookups:        %8lu\n"
+		"hits:           %8lu\n"
+		"hit rate:       %7lu%%\n"
+		"probes/lookup:  %5lu.%02lu\n",
+		1U << hash_bits, hash_used, nr_hashed,
+		chain / 100, chain % 100,
+		hash_lookups, hash_hits, hits,
+		probes / 100, probes % 100);
+}
+
+/*
+ * The hash table is sized from the amount of memory, at roughly one
+ * bucket per page, and has to be set up before mem_init() as it can be
+ * bigger than a page.
+ */
+unsigned long buffer_hash_init(unsigned long start, unsigned long end)
+{
+	unsigned long size;
+
+	hash_bits = 8;
+	while (hash_bits < 16 && (1UL << hash_bits) < (end >> PAGE_SHIFT))
+		hash_bits++;
+	size = sizeof(struct buffer_head *) << hash_bits;
+	start = (start + 3) & ~3;
+	hash_table = (struct buffer_head **) start;
+	memset(hash_table, 0, size);
+	return start + size;
 }
 
 /*
@@ -1009,17 +1291,184 @@ void show_buffers(void)
  */
 void buffer_init(void)
 {
-	int i;
-
 	if (high_memory >= 4*1024*1024)
 		min_free_pages = 200;
 	else
 		min_free_pages = 20;
-	for (i = 0 ; i < NR_HASH ; i++)
-		hash_table[i] = NULL;
-	free_list = 0;
 	grow_buffers(GFP_KERNEL, BLOCK_SIZE);
-	if (!free_list)
+	if (!lru_list[BUFSIZE_INDEX(BLOCK_SIZE)][BUF_CLEAN])
 		panic("VFS: Unable to initialize buffer free list!");
 	return;
 }
+
+/*
+ * Write a batch of dirty buffers, sorted by device and block so that the
+ * requests reach the driver in order. The caller holds a reference to
+ * each buffer; it is dropped here.
+ */
+static void write_batch(struct buffer_head * bh[], int nr)
+{
+	struct buffer_head * tmp;
+	int i, j;
+
+	for (i = 1 ; i < nr ; i++) {
+		tmp = bh[i];
+		for (j = i ; j > 0 ; j--) {
+			if (bh[j-1]->b_dev < tmp->b_dev)
+				break;
+			if (bh[j-1]->b_dev == tmp->b_dev &&
+			    bh[j-1]->b_blocknr < tmp->b_blocknr)
+				break;
+			bh[j] = bh[j-1];
+		}
+		bh[j] = tmp;
+	}
+	for (i = 0 ; i < nr ; i = j) {
+		for (j = i+1 ; j < nr && bh[j]->b_dev == bh[i]->b_dev ; j++)
+			/* nothing */;
+		ll_rw_block(WRITE, j - i, bh + i);
+		bdflush_batches++;
+	}
+	for (i = 0 ; i < nr ; i++) {
+		bh[i]->b_count--;
+		refile_buffer(bh[i]);
+	}
+}
+
+#define NR_BATCH 32
+
+/*
+ * Write out up to "limit" dirty buffers of one size, oldest first. Unless
+ * "all" is set, stop at the first buffer that hasn't reached its flush
+ * time: the dirty list is kept in the order buffers were dirtied.
+ */
+static int flush_dirty_buffers(int isize, int all, int limit)
+{
+	struct buffer_head * bh, * batch[NR_BATCH];
+	int i, nr, written = 0;
+
+	do {
+		while ((bh = lru_list[isize][BUF_DIRTY]) != NULL &&
+		       (bh->b_lock || !bh->b_dirt))
+			refile_buffer(bh);
+		nr = 0;
+		i = nr_buffers_type[isize][BUF_DIRTY];
+		for ( ; i-- > 0 && nr < NR_BATCH && written+nr < limit ; bh = bh->b_next_free) {
+			if (bh->b_lock || !bh->b_dirt)
+				continue;
+			if (!all && (long) (jiffies - bh->b_flushtime) < 0)
+				break;
+			bh->b_count++;
+			batch[nr++] = bh;
+		}
+		if (nr)
+			write_batch(batch, nr);
+		written += nr;
+	} while (nr == NR_BATCH && written < limit);
+	return written;
+}
+
+/*
+ * One bdflush cycle: get the inodes and super blocks into their buffers,
+ * write the buffers that have been dirty too long, and if that leaves
+ * too many dirty ones, keep writing the oldest.
+ */
+static int sync_old_buffers(void)
+{
+	int isize, excess, written = 0;
+
+	sync_supers(0);
+	sync_inodes(0);
+	for (isize = 0 ; isize < NR_SIZES ; isize++)
+		written += flush_dirty_buffers(isize, 0, bdf_ndirty);
+	bdflush_aged += written;
+	excess = nr_dirty_buffers() - (nr_buffers * bdf_nfract) / 100;
+	for (isize = 0 ; isize < NR_SIZES && excess > 0 ; isize++) {
+		int n = flush_dirty_buffers(isize, 1,
+			excess < bdf_ndirty ? excess : bdf_ndirty);
+		bdflush_early += n;
+		written += n;
+		excess -= n;
+	}
+	return written;
+}
+
+/*
+ * sys_bdflush(0, 0) turns the calling process into the flush daemon and
+ * only returns if it is killed. func 1 runs a single flush cycle, and
+ * func 2+2*n reads tunable n into *(int *)data while func 3+2*n sets it
+ * to data.
+ */
+asmlinkage int sys_bdflush(int func, int data)
+{
+	int i, error, written;
+	unsigned long blocked;
+
+	if (!suser())
+		return -EPERM;
+	if (func == 1) {
+		sync_old_buffers();
+		return 0;
+	}
+	if (func >= 2) {
+		i = (func-2) >> 1;
+		if (i >= N_PARAM)
+			return -EINVAL;
+		if ((func & 1) == 0) {
+			error = verify_area(VERIFY_WRITE, (void *) data, sizeof(int));
+			if (error)
+				return error;
+			put_fs_long(bdf_prm[i], (unsigned long *) data);
+			return 0;
+		}
+		if (data < bdflush_min[i] || data > bdflush_max[i])
+			return -EINVAL;
+		bdf_prm[i] = data;
+		return 0;
+	}
+	if (func)
+		return -EINVAL;
+	if (bdflush_running)
+		return -EBUSY;
+	bdflush_running = 1;
+	memcpy(current->comm, "bdflush", 8);
+	/* only SIGKILL and SIGTERM wake the daemon, and they stop it */
+	blocked = current->blocked;
+	current->blocked = ~((1 << (SIGKILL-1)) | (1 << (SIGTERM-1)));
+	for (;;) {
+		bdflush_wakeups++;
+		written = sync_old_buffers();
+		if (current->signal & ~current->blocked) {
+			current->blocked = blocked;
+			bdflush_running = 0;
+			return 0;
+		}
+		/* still too many dirty buffers: come back on the next tick */
+		if (written && too_many_dirty())
+			current->timeout = jiffies + 1;
+		else
+			current->timeout = jiffies + bdf_interval;
+		interruptible_sleep_on(&bdflush_wait);
+	}
+}
+
+/*
+ * bdflush tunables and counters for /proc/bdflush.
+ */
+int get_bdflush_stats(char * buffer)
+{
+	return sprintf(buffer,
+		"nfract   %8d\n"
+		"ndirty   %8d\n"
+		"age      %8d\n"
+		"interval %8d\n"
+		"dirty    %8d\n"
+		"buffers  %8d\n"
+		"wakeups  %8lu\n"
+		"aged     %8lu\n"
+		"early    %8lu\n"
+		"batches  %8lu\n",
+		bdf_nfract, bdf_ndirty, bdf_age, bdf_interval,
+		nr_dirty_buffers(), nr_buffers,
+		bdflush_wakeups, bdflush_aged, bdflush_early, bdflush_batches);
+}
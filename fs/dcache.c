@@ -0,0 +1,206 @@
+/*
+ *  linux/fs/dcache.c
+ *
+ * A name cache for lookup(), shared by all the filesystems. An entry maps
+ * a name in a directory to the inode number it stands for, or records
+ * that the name isn't there (ino 0), so that a warm path walk doesn't
+ * have to call the filesystem for every component.
+ *
+ * Nothing is ever removed by name. Instead every in-core inode gets a
+ * version from "event" when it is set up (clear_inode()), and namei.c
+ * gives a directory a new version whenever it changes a name in it. An
+ * entry records the version of its directory and is only believed while
+ * the two match, so entries of a changed directory, or of one that has
+ * left the inode table and come back, just age out of the LRU.
+ *
+ * A hit is turned into an inode with iget(), so a filesystem whose
+ * lookup does more than that (or whose names can change behind our
+ * back, like nfs and /proc) sets s_nocache in its super block and goes
+ * to its own lookup every time.
+ */
+
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/mm.h>
+
+#define DCACHE_NAME_LEN	32
+
+struct dir_cache_entry {
+	struct dir_cache_entry * next_hash, * prev_hash;
+	struct dir_cache_entry * next_lru, * prev_lru;
+	dev_t dev;
+	unsigned long dir;
+	unsigned long version;
+	unsigned long ino;		/* 0 if the name doesn't exist */
+	int name_len;
+	char name[DCACHE_NAME_LEN];
+};
+
+unsigned long event = 0;
+
+static struct dir_cache_entry * dcache = NULL;
+static struct dir_cache_entry ** dcache_hash = NULL;
+static struct dir_cache_entry * dcache_lru = NULL;	/* most recently used */
+static unsigned int dcache_hash_bits = 0;
+static int nr_dcache = 0;
+
+static unsigned long dcache_lookups = 0;
+static unsigned long dcache_hits = 0;
+static unsigned long dcache_negative = 0;
+
+static inline unsigned long dcache_hashfn(dev_t dev, unsigned long dir,
+	const char * name, int len)
+{
+	unsigned long hash = ((unsigned long) dev << 16) ^ dir;
+
+	while (len--)
+		hash = (hash << 5) + hash + (unsigned char) *name++;
+	return (hash * 0x9e370001UL) >> (32 - dcache_hash_bits);
+}
+
+static inline int dcache_ok(struct inode * dir, int len)
+{
+	return dcache && len <= DCACHE_NAME_LEN && dir->i_sb && !dir->i_sb->s_nocache;
+}
+
+static inline void remove_hash(struct dir_cache_entry * de)
+{
+	if (de->next_hash)
+		de->next_hash->prev_hash = de->prev_hash;
+	if (de->prev_hash)
+		de->prev_hash->next_hash = de->next_hash;
+	else if (dcache_hash[dcache_hashfn(de->dev, de->dir, de->name, de->name_len)] == de)
+		dcache_hash[dcache_hashfn(de->dev, de->dir, de->name, de->name_len)] = de->next_hash;
+	de->next_hash = de->prev_hash = NULL;
+}
+
+static inline void insert_hash(struct dir_cache_entry * de, unsigned long hash)
+{
+	de->prev_hash = NULL;
+	if ((de->next_hash = dcache_hash[hash]) != NULL)
+		de->next_hash->prev_hash = de;
+	dcache_hash[hash] = de;
+}
+
+static inline void make_most_recent(struct dir_cache_entry * de)
+{
+	if (de == dcache_lru)
+		return;
+	de->prev_lru->next_lru = de->next_lru;
+	de->next_lru->prev_lru = de->prev_lru;
+	de->next_lru = dcache_lru;
+	de->prev_lru = dcache_lru->prev_lru;
+	dcache_lru->prev_lru->next_lru = de;
+	dcache_lru->prev_lru = de;
+	dcache_lru = de;
+}
+
+static struct dir_cache_entry * find_entry(struct inode * dir, const char * name,
+	int len, unsigned long hash)
+{
+	struct dir_cache_entry * de;
+
+	for (de = dcache_hash[hash]; de; de = de->next_hash) {
+		if (de->dir == dir->i_ino && de->dev == dir->i_dev &&
+		    de->name_len == len && !memcmp(de->name, name, len))
+			return de;
+	}
+	return NULL;
+}
+
+/*
+ * Returns 1 and sets *ino (0 for a name known not to exist) if the
+ * name is in the cache for this version of the directory.
+ */
+int dcache_lookup(struct inode * dir, const char * name, int len, unsigned long * ino)
+{
+	struct dir_cache_entry * de;
+
+	if (!dcache_ok(dir, len))
+		return 0;
+	dcache_lookups++;
+	de = find_entry(dir, name, len, dcache_hashfn(dir->i_dev, dir->i_ino, name, len));
+	if (!de || de->version != dir->i_version)
+		return 0;
+	make_most_recent(de);
+	dcache_hits++;
+	if (!de->ino)
+		dcache_negative++;
+	*ino = de->ino;
+	return 1;
+}
+
+/*
+ * Remember what a lookup found. "version" is that of the directory when
+ * the lookup started: if the directory changed while the filesystem
+ * was reading it, the entry is stale at once.
+ */
+void dcache_add(struct inode * dir, const char * name, int len,
+	unsigned long ino, unsigned long version)
+{
+	struct dir_cache_entry * de;
+	unsigned long hash;
+
+	if (!dcache_ok(dir, len))
+		return;
+	hash = dcache_hashfn(dir->i_dev, dir->i_ino, name, len);
+	if (!(de = find_entry(dir, name, len, hash))) {
+		de = dcache_lru->prev_lru;
+		if (de->name_len)
+			remove_hash(de);
+		de->dev = dir->i_dev;
+		de->dir = dir->i_ino;
+		de->name_len = len;
+		memcpy(de->name, name, len);
+		insert_hash(de, hash);
+	}
+	de->version = version;
+	de->ino = ino;
+	make_most_recent(de);
+}
+
+/*
+ * For /proc/vmstat.
+ */
+int get_dcache_stats(char * buffer)
+{
+	return sprintf(buffer,
+		"dcache_entries %d\n"
+		"dcache_lookups %lu\n"
+		"dcache_hits %lu\n"
+		"dcache_negative_hits %lu\n",
+		nr_dcache, dcache_lookups, dcache_hits, dcache_negative);
+}
+
+/*
+ * About one entry for every four pages of memory, with a hash bucket
+ * for every two entries. Like the buffer hash, this is carved out of
+ * memory_start before mem_init().
+ */
+unsigned long dcache_init(unsigned long start, unsigned long end)
+{
+	int i;
+
+	nr_dcache = (end >> PAGE_SHIFT) >> 2;
+	if (nr_dcache < 256)
+		nr_dcache = 256;
+	if (nr_dcache > 8192)
+		nr_dcache = 8192;
+	dcache_hash_bits = 7;
+	while ((1 << (dcache_hash_bits + 1)) < nr_dcache)
+		dcache_hash_bits++;
+	start = (start + 3) & ~3;
+	dcache_hash = (struct dir_cache_entry **) start;
+	memset(dcache_hash, 0, sizeof(struct dir_cache_entry *) << dcache_hash_bits);
+	start += sizeof(struct dir_cache_entry *) << dcache_hash_bits;
+	dcache = (struct dir_cache_entry *) start;
+	memset(dcache, 0, nr_dcache * sizeof(struct dir_cache_entry));
+	start += nr_dcache * sizeof(struct dir_cache_entry);
+	for (i = 0 ; i < nr_dcache ; i++) {
+		dcache[i].next_lru = dcache + (i + 1) % nr_dcache;
+		dcache[i].prev_lru = dcache + (i + nr_dcache - 1) % nr_dcache;
+	}
+	dcache_lru = dcache;
+	return start;
+}
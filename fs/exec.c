@@ -83,7 +83,7 @@ int open_inode(struct inode * inode, int mode)
 		error = f->f_op->open(inode,f);
 		if (error) {
 			*fpp = NULL;
-			f->f_count--;
+			put_filp(f);
 			return error;
 		}
 	}
@@ -271,7 +271,7 @@ unsigned long * create_tables(char * p,int argc,int envc,int ibcs)
 	unsigned long * sp;
 	struct vm_area_struct *mpnt;
 
-	mpnt = (struct vm_area_struct *)kmalloc(sizeof(*mpnt), GFP_KERNEL);
+	mpnt = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 	if (mpnt) {
 		mpnt->vm_task = current;
 		mpnt->vm_start = PAGE_MASK & (unsigned long) p;
@@ -494,12 +494,14 @@ void flush_old_exec(struct linux_binprm * bprm)
 
 	mpnt = current->mmap;
 	current->mmap = NULL;
+	current->mmap_avl = NULL;
+	current->mmap_cache = NULL;
 	current->stk_vma = NULL;
 	while (mpnt) {
 		mpnt1 = mpnt->vm_next;
 		if (mpnt->vm_ops && mpnt->vm_ops->close)
 			mpnt->vm_ops->close(mpnt);
-		kfree(mpnt);
+		kmem_cache_free(vm_area_cachep, mpnt);
 		mpnt = mpnt1;
 	}
 
@@ -533,6 +535,7 @@ void flush_old_exec(struct linux_binprm * bprm)
 			sys_close(i);
 	FD_ZERO(&current->close_on_exec);
 	clear_page_tables(current);
+	release_vfork_parent(current);
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
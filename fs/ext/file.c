@@ -247,11 +247,13 @@ static int ext_file_write(struct inode * inode, struct file * filp, char * buf,
 		memcpy_fromfs(p,buf,c);
 		buf += c;
 		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
 	}
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 	filp->f_pos = pos;
 	inode->i_dirt = 1;
+	if (written > 0)
+		file_pages_written(inode);
 	return written;
 }
@@ -29,17 +29,10 @@
 #include <linux/sched.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/malloc.h>
 
 #include <asm/bitops.h>
 
-#define clear_block(addr,size) \
-	__asm__("cld\n\t" \
-		"rep\n\t" \
-		"stosl" \
-		: \
-		:"a" (0), "c" (size / 4), "D" ((long) (addr)) \
-		)
-
 #define in_range(b, first, len)		((b) >= (first) && (b) <= (first) + (len) - 1)
 
 static inline int find_first_zero_bit (unsigned long * addr, unsigned size)
@@ -97,25 +90,6 @@ static inline int find_next_zero_bit (unsigned long * addr, int size,
 	return (offset + set + res);
 }
 
-static inline char * find_first_zero_byte (char * addr, int size)
-{
-	char *res;
-
-	if (!size)
-		return 0;
-	__asm__(
-"		cld\n\t"
-"		mov $0,%%eax\n\t"
-"		repnz; scasb\n\t"
-"		jnz 1f\n\t"
-"		dec %%edi\n\t"
-"1:		"
-		: "=D" (res)
-		: "0" (addr), "c" (size)
-		);
-	return res;
-}
-
 static struct ext2_group_desc * get_group_desc (struct super_block * sb,
 						unsigned int block_group,
 						struct buffer_head ** bh)
@@ -246,6 +220,85 @@ static inline int load_block_bitmap (struct super_block * sb,
 	return load__block_bitmap (sb, block_group);
 }
 
+/*
+ * Each group has an in-core summary of its longest free run, so that a
+ * search for a run can pass over the groups that can't hold it without
+ * reading their bitmaps. The summary is only known once the bitmap has
+ * been scanned in full. Allocating from the run it describes makes it
+ * unknown again, while freeing blocks can only lengthen it.
+ *
+ * The summaries are allocated one descriptor block's worth at a time, on
+ * first use. If there is no memory, the group is simply searched.
+ */
+static struct ext2_group_info * get_group_info (struct super_block * sb,
+						unsigned int block_group)
+{
+	unsigned long group_desc;
+	unsigned long desc;
+	struct ext2_group_info * gi;
+
+	group_desc = block_group / EXT2_DESC_PER_BLOCK(sb);
+	desc = block_group % EXT2_DESC_PER_BLOCK(sb);
+	gi = sb->u.ext2_sb.s_group_info[group_desc];
+	if (!gi) {
+		gi = (struct ext2_group_info *)
+		     kmalloc (EXT2_DESC_PER_BLOCK(sb) *
+			      sizeof (struct ext2_group_info), GFP_KERNEL);
+		if (!gi)
+			return NULL;
+		memset (gi, 0xff, EXT2_DESC_PER_BLOCK(sb) *
+				  sizeof (struct ext2_group_info));
+		sb->u.ext2_sb.s_group_info[group_desc] = gi;
+	}
+	return gi + desc;
+}
+
+/*
+ * Length of the free run at bit j of a bitmap, up to max
+ */
+static int free_run (char * map, int size, int j, int max)
+{
+	int k = j;
+
+	while (k < size && k - j < max) {
+		if (!(k & 7) && k + 8 <= size && !map[k >> 3]) {
+			k += 8;
+			continue;
+		}
+		if (test_bit (k, map))
+			break;
+		k++;
+	}
+	return k - j < max ? k - j : max;
+}
+
+/*
+ * Looks for a free run of want blocks from bit j on. Returns its start,
+ * with *len set to want; or, if there is none, the start of the longest
+ * shorter run and its length (-1 and 0 if the rest of the map is full).
+ */
+static int find_free_run (char * map, int size, int j, int want, int * len)
+{
+	int best = -1;
+	int k;
+
+	*len = 0;
+	while (j < size) {
+		j = find_next_zero_bit ((unsigned long *) map, size, j);
+		if (j >= size)
+			break;
+		k = free_run (map, size, j, want);
+		if (k > *len) {
+			best = j;
+			*len = k;
+			if (k >= want)
+				break;
+		}
+		j += k;
+	}
+	return best;
+}
+
 void ext2_free_blocks (struct super_block * sb, unsigned long block,
 		       unsigned long count)
 {
@@ -255,7 +308,9 @@ void ext2_free_blocks (struct super_block * sb, unsigned long block,
 	unsigned long bit;
 	unsigned long i;
 	int bitmap_nr;
+	int len;
 	struct ext2_group_desc * gdp;
+	struct ext2_group_info * gi;
 	struct ext2_super_block * es;
 
 	if (!sb) {
@@ -309,11 +364,22 @@ void ext2_free_blocks (struct super_block * sb, unsigned long block,
 			es->s_free_blocks_count++;
 		}
 	}
+	gi = get_group_info (sb, block_group);
+	if (gi && gi->gi_start != EXT2_GI_UNKNOWN) {
+		for (i = bit; i > 0 && !test_bit (i - 1, bh->b_data); i--)
+			;
+		len = free_run (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb), i,
+				EXT2_BLOCKS_PER_GROUP(sb));
+		if (len > gi->gi_len) {
+			gi->gi_start = i;
+			gi->gi_len = len;
+		}
+	}
 	
-	bh2->b_dirt = 1;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(bh2);
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (sb->s_flags & MS_SYNC) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -324,30 +390,34 @@ void ext2_free_blocks (struct super_block * sb, unsigned long block,
 }
 
 /*
- * ext2_new_block uses a goal block to assist allocation.  If the goal is
- * free, or there is a free block within 32 blocks of the goal, that block
- * is allocated.  Otherwise a forward search is made for a free block; within 
- * each block group the search first looks for an entire free byte in the block
- * bitmap, and then for any free bit if that fails.
+ * ext2_new_blocks allocates a run of up to *count blocks as near to goal
+ * as it can, and returns the first one with *count set to the number it
+ * got. The blocks are not cleared.
+ *
+ * If the goal is free, the run starts there however short it is, and a
+ * single block may also be taken within 32 blocks of the goal. Otherwise
+ * the search is for a run of the full size (at least 8 blocks, so that
+ * a new file starts where it has room to grow): first in the goal's
+ * group from the goal on, then through the other groups that neither
+ * the free blocks count nor the summary rule out.  If there is no such
+ * run, the longest one of the next group with any free block is used.
  */
-int ext2_new_block (struct super_block * sb, unsigned long goal,
-		    unsigned long * prealloc_count,
-		    unsigned long * prealloc_block)
+unsigned long ext2_new_blocks (struct super_block * sb, unsigned long goal,
+			       unsigned long * count)
 {
 	struct buffer_head * bh;
 	struct buffer_head * bh2;
-	char * p, * r;
-	int i, j, k, tmp;
-	unsigned long lmap;
+	int i, j, k, len, want, need;
 	int bitmap_nr;
+	unsigned long block;
 	struct ext2_group_desc * gdp;
+	struct ext2_group_info * gi;
 	struct ext2_super_block * es;
 
-#ifdef EXT2FS_DEBUG
-	static int goal_hits = 0, goal_attempts = 0;
-#endif
+	want = *count;
+	*count = 0;
 	if (!sb) {
-		printk ("ext2_new_block: nonexistent device");
+		printk ("ext2_new_blocks: nonexistent device");
 		return 0;
 	}
 	lock_super (sb);
@@ -356,8 +426,15 @@ int ext2_new_block (struct super_block * sb, unsigned long goal,
 		unlock_super (sb);
 		return 0;
 	}
+	if (!suser() && want > es->s_free_blocks_count - es->s_r_blocks_count)
+		want = es->s_free_blocks_count - es->s_r_blocks_count;
+	if (want > EXT2_BLOCKS_PER_GROUP(sb))
+		want = EXT2_BLOCKS_PER_GROUP(sb);
+	if (want < 1)
+		want = 1;
+	need = want < 8 ? 8 : want;
 
-	ext2_debug ("goal=%lu.\n", goal);
+	ext2_debug ("goal=%lu, count=%d.\n", goal, want);
 
 repeat:
 	/*
@@ -369,79 +446,71 @@ repeat:
 	gdp = get_group_desc (sb, i, &bh2);
 	if (gdp->bg_free_blocks_count > 0) {
 		j = ((goal - es->s_first_data_block) % EXT2_BLOCKS_PER_GROUP(sb));
-#ifdef EXT2FS_DEBUG
-		if (j)
-			goal_attempts++;
-#endif
 		bitmap_nr = load_block_bitmap (sb, i);
 		bh = sb->u.ext2_sb.s_block_bitmap[bitmap_nr];
 
 		ext2_debug ("goal is at %d:%d.\n", i, j);
 
 		if (!test_bit(j, bh->b_data)) {
-#ifdef EXT2FS_DEBUG
-			goal_hits++;
-			ext2_debug ("goal bit allocated.\n");
-#endif
-			goto got_block;
+			len = free_run (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb),
+					j, want);
+			goto got_run;
 		}
-		if (j) {
-			/*
-			 * The goal was occupied; search forward for a free 
-			 * block within the next 32 blocks
-			 */
-			lmap = ((((unsigned long *) bh->b_data)[j >> 5]) >>
-				((j & 31) + 1));
-			if (j < EXT2_BLOCKS_PER_GROUP(sb) - 32)
-				lmap |= (((unsigned long *) bh->b_data)[(j >> 5) + 1]) <<
-				 (31 - (j & 31));
-			else
-				lmap |= 0xffffffff << (31 - (j & 31));
-			if (lmap != 0xffffffffl) {
-				__asm__ ("bsfl %1,%0"
-					 : "=r" (k)
-					 : "r" (~lmap));
-				k++;
-				if ((j + k) < EXT2_BLOCKS_PER_GROUP(sb)) {
-					j += k;
-					goto got_block;
-				}
+		if (want == 1 && j + 1 < EXT2_BLOCKS_PER_GROUP(sb)) {
+			k = find_next_zero_bit ((unsigned long *) bh->b_data,
+						EXT2_BLOCKS_PER_GROUP(sb),
+						j + 1);
+			if (k <= j + 32 && k < EXT2_BLOCKS_PER_GROUP(sb)) {
+				j = k;
+				len = 1;
+				goto got_run;
 			}
 		}
-	
+
 		ext2_debug ("Bit not found near goal\n");
 
-		/*
-		 * There has been no free block found in the near vicinity
-		 * of the goal: do a search forward through the block groups,
-		 * searching in each group first for an entire free byte in
-		 * the bitmap and then for any free bit.
-		 * 
-		 * Search first in the remainder of the current group; then,
-		 * cyclicly search throught the rest of the groups.
-		 */
-		p = ((char *) bh->b_data) + (j >> 3);
-		r = find_first_zero_byte (p, 
-					  (EXT2_BLOCKS_PER_GROUP(sb) - j + 7) >> 3);
-		k = (r - ((char *) bh->b_data)) << 3;
-		if (k < EXT2_BLOCKS_PER_GROUP(sb)) {
-			j = k;
-			goto search_back;
-		}
-		k = find_next_zero_bit ((unsigned long *) bh->b_data, 
-					EXT2_BLOCKS_PER_GROUP(sb),
-					j);
-		if (k < EXT2_BLOCKS_PER_GROUP(sb)) {
-			j = k;
-			goto got_block;
+		gi = get_group_info (sb, i);
+		if (gdp->bg_free_blocks_count >= need &&
+		    (!gi || gi->gi_start == EXT2_GI_UNKNOWN ||
+		     gi->gi_len >= need)) {
+			j = find_free_run (bh->b_data,
+					   EXT2_BLOCKS_PER_GROUP(sb),
+					   j, need, &len);
+			if (len >= need)
+				goto got_run;
 		}
 	}
 
-	ext2_debug ("Bit not found in block group %d.\n", i);
+	ext2_debug ("Run not found in block group %d.\n", i);
+
+	/*
+	 * Now search the other groups, and the goal's group from its
+	 * start.  A full scan that fails leaves the group's summary known.
+	 */
+	for (k = 0; k < sb->u.ext2_sb.s_groups_count; k++) {
+		i++;
+		if (i >= sb->u.ext2_sb.s_groups_count)
+			i = 0;
+		gdp = get_group_desc (sb, i, &bh2);
+		if (gdp->bg_free_blocks_count < need)
+			continue;
+		gi = get_group_info (sb, i);
+		if (gi && gi->gi_start != EXT2_GI_UNKNOWN && gi->gi_len < need)
+			continue;
+		bitmap_nr = load_block_bitmap (sb, i);
+		bh = sb->u.ext2_sb.s_block_bitmap[bitmap_nr];
+		j = find_free_run (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb),
+				   0, need, &len);
+		if (len >= need)
+			goto got_run;
+		if (gi) {
+			gi->gi_start = j < 0 ? 0 : j;
+			gi->gi_len = len;
+		}
+	}
 
 	/*
-	 * Now search the rest of the groups.  We assume that 
-	 * i and gdp correctly point to the last group visited.
+	 * No group has a run that long: settle for a shorter one.
 	 */
 	for (k = 0; k < sb->u.ext2_sb.s_groups_count; k++) {
 		i++;
@@ -457,106 +526,73 @@ repeat:
 	}
 	bitmap_nr = load_block_bitmap (sb, i);
 	bh = sb->u.ext2_sb.s_block_bitmap[bitmap_nr];
-	r = find_first_zero_byte (bh->b_data, 
-				  EXT2_BLOCKS_PER_GROUP(sb) >> 3);
-	j = (r - bh->b_data) << 3;
-	if (j < EXT2_BLOCKS_PER_GROUP(sb))
-		goto search_back;
-	else
-		j = find_first_zero_bit ((unsigned long *) bh->b_data,
-					 EXT2_BLOCKS_PER_GROUP(sb));
-	if (j >= EXT2_BLOCKS_PER_GROUP(sb)) {
-		ext2_error (sb, "ext2_new_block",
+	j = find_free_run (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb), 0, want, &len);
+	if (j < 0) {
+		ext2_error (sb, "ext2_new_blocks",
 			    "Free blocks count corrupted for block group %d", i);
 		unlock_super (sb);
 		return 0;
 	}
 
-search_back:
-	/* 
-	 * We have succeeded in finding a free byte in the block
-	 * bitmap.  Now search backwards up to 7 bits to find the
-	 * start of this group of free blocks.
-	 */
-	for (k = 0; k < 7 && j > 0 && !test_bit (j - 1, bh->b_data); k++, j--);
-	
-got_block:
+got_run:
+	if (len > want)
+		len = want;
 
 	ext2_debug ("using block group %d(%d)\n", i, gdp->bg_free_blocks_count);
 
-	tmp = j + i * EXT2_BLOCKS_PER_GROUP(sb) + es->s_first_data_block;
+	block = j + i * EXT2_BLOCKS_PER_GROUP(sb) + es->s_first_data_block;
+	if (block >= es->s_blocks_count) {
+		ext2_error (sb, "ext2_new_blocks",
+			    "block >= blocks count\n"
+			    "block_group = %d, block=%lu", i, block);
+		unlock_super (sb);
+		return 0;
+	}
+	if (block + len > es->s_blocks_count)
+		len = es->s_blocks_count - block;
 
 	if (test_opt (sb, CHECK_STRICT) &&
-	    (tmp == gdp->bg_block_bitmap ||
-	     tmp == gdp->bg_inode_bitmap ||
-	     in_range (tmp, gdp->bg_inode_table, sb->u.ext2_sb.s_itb_per_group)))
-		ext2_panic (sb, "ext2_new_block",
+	    (in_range (gdp->bg_block_bitmap, block, len) ||
+	     in_range (gdp->bg_inode_bitmap, block, len) ||
+	     in_range (block, gdp->bg_inode_table,
+		       sb->u.ext2_sb.s_itb_per_group) ||
+	     in_range (block + len - 1, gdp->bg_inode_table,
+		       sb->u.ext2_sb.s_itb_per_group)))
+		ext2_panic (sb, "ext2_new_blocks",
 			    "Allocating block in system zone\n"
-			    "block = %u", tmp);
+			    "block = %lu, count = %d", block, len);
 
-	if (set_bit (j, bh->b_data)) {
-		ext2_warning (sb, "ext2_new_block",
+	for (k = 0; k < len; k++)
+		if (set_bit (j + k, bh->b_data))
+			break;
+	if (!k) {
+		ext2_warning (sb, "ext2_new_blocks",
 			      "bit already set for block %d", j);
 		goto repeat;
 	}
+	len = k;
 
-	ext2_debug ("found bit %d\n", j);
+	ext2_debug ("allocating blocks %lu-%lu.\n", block, block + len - 1);
 
-	/*
-	 * Do block preallocation now if required.
-	 */
-#ifdef EXT2_PREALLOCATE
-	if (prealloc_block) {
-		*prealloc_count = 0;
-		*prealloc_block = tmp + 1;
-		for (k = 1;
-		     k < 8 && (j + k) < EXT2_BLOCKS_PER_GROUP(sb); k++) {
-			if (set_bit (j + k, bh->b_data))
-				break;
-			(*prealloc_count)++;
-		}	
-		gdp->bg_free_blocks_count -= *prealloc_count;
-		es->s_free_blocks_count -= *prealloc_count;
-		ext2_debug ("Preallocated a further %lu bits.\n",
-			    *prealloc_count);
-	}
-#endif
+	gi = get_group_info (sb, i);
+	if (gi && gi->gi_start != EXT2_GI_UNKNOWN &&
+	    j < gi->gi_start + gi->gi_len && j + len > gi->gi_start)
+		gi->gi_start = EXT2_GI_UNKNOWN;
 
-	j = tmp;
-
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (sb->s_flags & MS_SYNC) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
 	}
 
-	if (j >= es->s_blocks_count) {
-		ext2_error (sb, "ext2_new_block",
-			    "block >= blocks count\n"
-			    "block_group = %d, block=%d", i, j);
-		unlock_super (sb);
-		return 0;
-	}
-	if (!(bh = getblk (sb->s_dev, j, sb->s_blocksize))) {
-		ext2_error (sb, "ext2_new_block", "cannot get block %d", j);
-		unlock_super (sb);
-		return 0;
-	}
-	clear_block (bh->b_data, sb->s_blocksize);
-	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
-	brelse (bh);
-
-	ext2_debug ("allocating block %d. "
-		    "Goal hits %d of %d.\n", j, goal_hits, goal_attempts);
-
-	gdp->bg_free_blocks_count--;
-	bh2->b_dirt = 1;
-	es->s_free_blocks_count--;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	gdp->bg_free_blocks_count -= len;
+	mark_buffer_dirty(bh2);
+	es->s_free_blocks_count -= len;
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	sb->s_dirt = 1;
 	unlock_super (sb);
-	return j;
+	*count = len;
+	return block;
 }
 
 unsigned long ext2_count_free_blocks (struct super_block * sb)
@@ -202,7 +202,7 @@ static void set_inode_dtime (struct inode * inode,
 			EXT2_INODES_PER_BLOCK(inode->i_sb));
 	raw_inode->i_links_count = 0;
 	raw_inode->i_dtime = CURRENT_TIME;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(inode)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -266,12 +266,12 @@ void ext2_free_inode (struct inode * inode)
 		gdp->bg_free_inodes_count++;
 		if (S_ISDIR(inode->i_mode))
 			gdp->bg_used_dirs_count--;
-		bh2->b_dirt = 1;
+		mark_buffer_dirty(bh2);
 		es->s_free_inodes_count++;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		set_inode_dtime (inode, gdp);
 	}
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (sb->s_flags & MS_SYNC) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -313,7 +313,7 @@ static void inc_inode_version (struct inode * inode,
 			EXT2_INODES_PER_BLOCK(inode->i_sb));
 	raw_inode->i_version++;
 	inode->u.ext2_i.i_version = raw_inode->i_version;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse (bh);
 }
 
@@ -438,7 +438,7 @@ repeat:
 				      "bit already set for inode %d", j);
 			goto repeat;
 		}
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		if (sb->s_flags & MS_SYNC) {
 			ll_rw_block (WRITE, 1, &bh);
 			wait_on_buffer (bh);
@@ -466,9 +466,9 @@ repeat:
 	gdp->bg_free_inodes_count--;
 	if (S_ISDIR(mode))
 		gdp->bg_used_dirs_count++;
-	bh2->b_dirt = 1;
+	mark_buffer_dirty(bh2);
 	es->s_free_inodes_count--;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	sb->s_dirt = 1;
 	inode->i_mode = mode;
 	inode->i_sb = sb;
@@ -489,7 +489,7 @@ repeat:
 	inode->i_blksize = sb->s_blocksize;
 	inode->i_blocks = 0;
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
-	inode->u.ext2_i.i_flags = dir->u.ext2_i.i_flags;
+	inode->u.ext2_i.i_flags = dir->u.ext2_i.i_flags & ~EXT2_INDEX_FL;
 	inode->u.ext2_i.i_faddr = 0;
 	inode->u.ext2_i.i_frag = 0;
 	inode->u.ext2_i.i_fsize = 0;
@@ -61,8 +61,8 @@ static int block_bmap (struct buffer_head * bh, int nr)
 /* 
  * ext2_discard_prealloc and ext2_alloc_block are atomic wrt. the
  * superblock in the same manner as are ext2_free_blocks and
- * ext2_new_block.  We just wait on the super rather than locking it
- * here, since ext2_new_block will do the necessary locking and we
+ * ext2_new_blocks.  We just wait on the super rather than locking it
+ * here, since ext2_new_blocks will do the necessary locking and we
  * can't block until then.
  */
 void ext2_discard_prealloc (struct inode * inode)
@@ -78,12 +78,21 @@ void ext2_discard_prealloc (struct inode * inode)
 #endif
 }
 
+/*
+ * On a preallocation miss, a regular file asks ext2_new_blocks for a
+ * whole run and keeps what it doesn't use yet as its window.  The window
+ * doubles, up to EXT2_MAX_PREALLOC, each time a file that is written
+ * sequentially uses one up, so that a big file gets long runs even when
+ * other files grow in the same group at the same time.  After a seek it
+ * starts again from EXT2_MIN_PREALLOC.
+ */
 static int ext2_alloc_block (struct inode * inode, unsigned long goal)
 {
 #ifdef EXT2FS_DEBUG
 	static unsigned long alloc_hits = 0, alloc_attempts = 0;
 #endif
 	unsigned long result;
+	unsigned long count = 1;
 	struct buffer_head * bh;
 
 	wait_on_super (inode->i_sb);
@@ -97,36 +106,47 @@ static int ext2_alloc_block (struct inode * inode, unsigned long goal)
 		inode->u.ext2_i.i_prealloc_count--;
 		ext2_debug ("preallocation hit (%lu/%lu).\n",
 			    ++alloc_hits, ++alloc_attempts);
-
-		/* It doesn't matter if we block in getblk() since
-		   we have already atomically allocated the block, and
-		   are only clearing it now. */
-		if (!(bh = getblk (inode->i_sb->s_dev, result,
-				   inode->i_sb->s_blocksize))) {
-			ext2_error (inode->i_sb, "ext2_alloc_block",
-				    "cannot get block %lu", result);
-			return 0;
-		}
-		clear_block (bh->b_data, inode->i_sb->s_blocksize);
-		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
-		brelse (bh);
 	} else {
 		ext2_discard_prealloc (inode);
 		ext2_debug ("preallocation miss (%lu/%lu).\n",
 			    alloc_hits, ++alloc_attempts);
-		if (S_ISREG(inode->i_mode))
-			result = ext2_new_block
-				(inode->i_sb, goal,
-				 &inode->u.ext2_i.i_prealloc_count,
-				 &inode->u.ext2_i.i_prealloc_block);
-		else
-			result = ext2_new_block (inode->i_sb, goal, 0, 0);
+		if (S_ISREG(inode->i_mode)) {
+			if (inode->u.ext2_i.i_prealloc_window &&
+			    (goal == inode->u.ext2_i.i_prealloc_block ||
+			     goal + 1 == inode->u.ext2_i.i_prealloc_block)) {
+				if (inode->u.ext2_i.i_prealloc_window <
+				    EXT2_MAX_PREALLOC)
+					inode->u.ext2_i.i_prealloc_window <<= 1;
+			} else
+				inode->u.ext2_i.i_prealloc_window =
+					EXT2_MIN_PREALLOC;
+			count = inode->u.ext2_i.i_prealloc_window;
+		}
+		result = ext2_new_blocks (inode->i_sb, goal, &count);
+		if (result) {
+			inode->u.ext2_i.i_prealloc_block = result + 1;
+			inode->u.ext2_i.i_prealloc_count = count - 1;
+		}
 	}
 #else
-	result = ext2_new_block (inode->i_sb, goal, 0, 0);
+	result = ext2_new_blocks (inode->i_sb, goal, &count);
 #endif
+	if (!result)
+		return 0;
 
+	/* It doesn't matter if we block in getblk() since
+	   we have already atomically allocated the block, and
+	   are only clearing it now. */
+	if (!(bh = getblk (inode->i_sb->s_dev, result,
+			   inode->i_sb->s_blocksize))) {
+		ext2_error (inode->i_sb, "ext2_alloc_block",
+			    "cannot get block %lu", result);
+		return 0;
+	}
+	clear_block (bh->b_data, inode->i_sb->s_blocksize);
+	bh->b_uptodate = 1;
+	mark_buffer_dirty(bh);
+	brelse (bh);
 	return result;
 }
 
@@ -186,6 +206,89 @@ int ext2_bmap (struct inode * inode, int block)
 			   block & (addr_per_block - 1));
 }
 
+/*
+ * ext2_bmap_run is ext2_bmap for runs: it maps block and sets *len to
+ * the number of blocks from there, up to count, that follow it on the
+ * disk.  A run ends with its block of pointers, so each call walks the
+ * indirect chain only once.
+ */
+static int array_run (unsigned long * p, int nr, int count, int * len)
+{
+	unsigned long first = p[nr];
+	int i;
+
+	for (i = 1; i < count; i++)
+		if (p[nr + i] != (first ? first + i : 0))
+			break;
+	*len = i;
+	return first;
+}
+
+static int block_bmap_run (struct inode * inode, int i, int nr, int count,
+			   int * len)
+{
+	struct buffer_head * bh;
+	int addr_per_block = EXT2_ADDR_PER_BLOCK(inode->i_sb);
+	int tmp;
+
+	if (count > addr_per_block - nr)
+		count = addr_per_block - nr;
+	if (!i || !(bh = bread (inode->i_dev, i, inode->i_sb->s_blocksize))) {
+		*len = count;
+		return 0;
+	}
+	tmp = array_run ((unsigned long *) bh->b_data, nr, count, len);
+	brelse (bh);
+	return tmp;
+}
+
+int ext2_bmap_run (struct inode * inode, int block, int count, int * len)
+{
+	int i;
+	int addr_per_block = EXT2_ADDR_PER_BLOCK(inode->i_sb);
+
+	*len = 1;
+	if (block < 0) {
+		ext2_warning (inode->i_sb, "ext2_bmap_run", "block < 0");
+		return 0;
+	}
+	if (block >= EXT2_NDIR_BLOCKS + addr_per_block +
+		     addr_per_block * addr_per_block +
+		     addr_per_block * addr_per_block * addr_per_block) {
+		ext2_warning (inode->i_sb, "ext2_bmap_run", "block > big");
+		return 0;
+	}
+	if (block < EXT2_NDIR_BLOCKS) {
+		if (count > EXT2_NDIR_BLOCKS - block)
+			count = EXT2_NDIR_BLOCKS - block;
+		return array_run (inode->u.ext2_i.i_data, block, count, len);
+	}
+	block -= EXT2_NDIR_BLOCKS;
+	if (block < addr_per_block)
+		return block_bmap_run (inode, inode_bmap (inode, EXT2_IND_BLOCK),
+				       block, count, len);
+	block -= addr_per_block;
+	if (block < addr_per_block * addr_per_block) {
+		i = inode_bmap (inode, EXT2_DIND_BLOCK);
+		if (i)
+			i = block_bmap (bread (inode->i_dev, i,
+					       inode->i_sb->s_blocksize),
+					block / addr_per_block);
+		return block_bmap_run (inode, i, block & (addr_per_block - 1),
+				       count, len);
+	}
+	block -= addr_per_block * addr_per_block;
+	i = inode_bmap (inode, EXT2_TIND_BLOCK);
+	if (i)
+		i = block_bmap (bread (inode->i_dev, i, inode->i_sb->s_blocksize),
+				block / (addr_per_block * addr_per_block));
+	if (i)
+		i = block_bmap (bread (inode->i_dev, i, inode->i_sb->s_blocksize),
+				(block / addr_per_block) & (addr_per_block - 1));
+	return block_bmap_run (inode, i, block & (addr_per_block - 1),
+			       count, len);
+}
+
 static struct buffer_head * inode_getblk (struct inode * inode, int nr,
 					  int create, int new_block, int * err)
 {
@@ -314,7 +417,7 @@ repeat:
 		goto repeat;
 	}
 	*p = tmp;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(inode)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -549,7 +652,7 @@ static struct buffer_head * ext2_update_inode (struct inode * inode)
 		raw_inode->i_block[0] = inode->i_rdev;
 	else for (block = 0; block < EXT2_N_BLOCKS; block++)
 		raw_inode->i_block[block] = inode->u.ext2_i.i_data[block];
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	inode->i_dirt = 0;
 	return bh;
 }
@@ -29,7 +29,11 @@ int ext2_ioctl (struct inode * inode, struct file * filp, unsigned int cmd,
 			return -EPERM;
 		if (IS_RDONLY(inode))
 			return -EROFS;
-		inode->u.ext2_i.i_flags = get_fs_long ((long *) arg);
+		/* the index flag describes the blocks, it isn't settable */
+		inode->u.ext2_i.i_flags = (get_fs_long ((long *) arg) &
+					   ~EXT2_INDEX_FL) |
+					  (inode->u.ext2_i.i_flags &
+					   EXT2_INDEX_FL);
 		inode->i_ctime = CURRENT_TIME;
 		inode->i_dirt = 1;
 		return 0;
@@ -22,6 +22,7 @@
 #include <linux/stat.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/mm.h>
 
 /*
  * comment out this line if you want names > EXT2_NAME_LEN chars to be
@@ -64,6 +65,640 @@ static int ext2_match (int len, const char * const name,
 	return (int) same;
 }
 
+/*
+ * Look for a name in one directory block. Returns 1 and the entry if
+ * it is there, 0 if not, and -1 if the block is corrupted.
+ */
+static int search_dirblock (struct inode * dir, struct buffer_head * bh,
+			    const char * name, int namelen,
+			    unsigned long offset, struct ext2_dir_entry ** res_dir)
+{
+	struct ext2_dir_entry * de;
+	char * dlimit;
+
+	de = (struct ext2_dir_entry *) bh->b_data;
+	dlimit = bh->b_data + dir->i_sb->s_blocksize;
+	while ((char *) de < dlimit) {
+		if (!ext2_check_dir_entry ("ext2_find_entry", dir,
+					   de, bh, offset))
+			return -1;
+		if (de->inode != 0 && ext2_match (namelen, name, de)) {
+			*res_dir = de;
+			return 1;
+		}
+		offset += de->rec_len;
+		de = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+	}
+	return 0;
+}
+
+/*
+ * Make room for a name in one directory block. Returns the entry, with
+ * the name filled in and the inode left at 0, or NULL with *err set to
+ * -ENOSPC if the block is full.
+ */
+static struct ext2_dir_entry * add_dirent_to_buf (struct inode * dir,
+	const char * name, int namelen, struct buffer_head * bh,
+	unsigned long offset, int * err)
+{
+	unsigned short rec_len = EXT2_DIR_REC_LEN(namelen);
+	struct ext2_dir_entry * de, * de1;
+	char * top = bh->b_data + dir->i_sb->s_blocksize;
+
+	for (de = (struct ext2_dir_entry *) bh->b_data; (char *) de < top;
+	     de = (struct ext2_dir_entry *) ((char *) de + de->rec_len)) {
+		if (!ext2_check_dir_entry ("ext2_add_entry", dir, de, bh,
+					   offset)) {
+			*err = -ENOENT;
+			return NULL;
+		}
+		if (de->inode != 0 && ext2_match (namelen, name, de)) {
+			*err = -EEXIST;
+			return NULL;
+		}
+		if ((de->inode == 0 && de->rec_len >= rec_len) ||
+		    (de->rec_len >= EXT2_DIR_REC_LEN(de->name_len) + rec_len)) {
+			if (de->inode) {
+				de1 = (struct ext2_dir_entry *) ((char *) de +
+					EXT2_DIR_REC_LEN(de->name_len));
+				de1->rec_len = de->rec_len -
+					EXT2_DIR_REC_LEN(de->name_len);
+				de->rec_len = EXT2_DIR_REC_LEN(de->name_len);
+				de = de1;
+			}
+			de->inode = 0;
+			de->name_len = namelen;
+			memcpy (de->name, name, namelen);
+			/*
+			 * XXX shouldn't update any times until successful
+			 * completion of syscall, but too many callers depend
+			 * on this.
+			 *
+			 * XXX similarly, too many callers depend on
+			 * ext2_new_inode() setting the times, but error
+			 * recovery deletes the inode, so the worst that can
+			 * happen is that the times are slightly out of date
+			 * and/or different from the directory change time.
+			 */
+			dir->i_mtime = dir->i_ctime = CURRENT_TIME;
+			dir->i_dirt = 1;
+			mark_buffer_dirty(bh);
+			*err = 0;
+			return de;
+		}
+		offset += de->rec_len;
+	}
+	*err = -ENOSPC;
+	return NULL;
+}
+
+/*
+ *	Hashed directory indexes
+ *
+ * A directory that has grown past its first block, on a file system
+ * with the dir_index feature, is turned into a tree keyed by a hash of
+ * the names. Block 0 keeps "." and "..", with ".." covering the rest of
+ * the block, which holds the root of the index. The leaves are ordinary
+ * directory blocks, each holding the names in one range of hashes, and
+ * with more than about 100 leaves there is one level of index blocks in
+ * between; an index block is a single empty entry spanning the block.
+ * Kernels that don't know about the index just see directory blocks
+ * with a lot of free space, and can still read the directory linearly.
+ *
+ * The layout, the hash and the flag are those of the "htree" indexes
+ * e2fsck knows, using the legacy hash.
+ */
+#define DX_HASH_LEGACY	0
+#define DX_MAX_LEVELS	2
+
+/* returned when an index can't be used: fall back to a linear search */
+#define ERR_BAD_DX_DIR	-75000
+
+struct fake_dirent {
+	unsigned long inode;
+	unsigned short rec_len;
+	unsigned short name_len;
+};
+
+struct dx_entry {
+	unsigned long hash;	/* low bit: names with this hash continue here */
+	unsigned long block;
+};
+
+/*
+ * The first entry of an index has no hash (it covers everything below
+ * the second one); its hash field holds the limit and count instead.
+ */
+struct dx_countlimit {
+	unsigned short limit;
+	unsigned short count;
+};
+
+struct dx_root {
+	struct fake_dirent dot;
+	char dot_name[4];
+	struct fake_dirent dotdot;
+	char dotdot_name[4];
+	struct dx_root_info {
+		unsigned long reserved_zero;
+		unsigned char hash_version;
+		unsigned char info_length;	/* 8 */
+		unsigned char indirect_levels;
+		unsigned char unused_flags;
+	} info;
+	struct dx_entry entries[0];
+};
+
+struct dx_node {
+	struct fake_dirent fake;
+	struct dx_entry entries[0];
+};
+
+struct dx_frame {
+	struct buffer_head * bh;
+	struct dx_entry * entries;
+	struct dx_entry * at;
+};
+
+#define dx_count(e)	(((struct dx_countlimit *) (e))->count)
+#define dx_limit(e)	(((struct dx_countlimit *) (e))->limit)
+#define dx_root_limit(sb) \
+	(((sb)->s_blocksize - sizeof (struct dx_root)) / sizeof (struct dx_entry))
+#define dx_node_limit(sb) \
+	(((sb)->s_blocksize - sizeof (struct dx_node)) / sizeof (struct dx_entry))
+
+#define is_dx(dir)	((dir)->u.ext2_i.i_flags & EXT2_INDEX_FL)
+#define is_dot(name,len) \
+	(!(len) || ((name)[0] == '.' && ((len) == 1 || \
+	 ((len) == 2 && (name)[1] == '.'))))
+
+static unsigned long dx_hash (const char * name, int len)
+{
+	unsigned long hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+	while (len--) {
+		hash = hash1 + (hash0 ^
+			((unsigned long) (signed char) *name++ * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+static void dx_release (struct dx_frame * frames)
+{
+	int i;
+
+	for (i = 0; i < DX_MAX_LEVELS; i++) {
+		brelse (frames[i].bh);
+		frames[i].bh = NULL;
+	}
+}
+
+/*
+ * Walk the index down to the leaf whose range holds "hash", filling in
+ * one frame per level. Returns the frame of the lowest index block, or
+ * NULL with *err set.
+ */
+static struct dx_frame * dx_probe (struct inode * dir, unsigned long hash,
+				   struct dx_frame * frames, int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct dx_frame * frame = frames;
+	struct dx_root * root;
+	struct dx_entry * entries, * p, * q, * m;
+	struct buffer_head * bh;
+	unsigned long nblocks;
+	int levels, count;
+
+	frames[0].bh = frames[1].bh = NULL;
+	nblocks = dir->i_size >> EXT2_BLOCK_SIZE_BITS(sb);
+	if (!(bh = ext2_bread (dir, 0, 0, err)))
+		return NULL;
+	root = (struct dx_root *) bh->b_data;
+	levels = root->info.indirect_levels;
+	entries = root->entries;
+	if (root->info.hash_version != DX_HASH_LEGACY ||
+	    root->info.info_length != sizeof (root->info) ||
+	    levels >= DX_MAX_LEVELS || dx_limit (entries) != dx_root_limit (sb)) {
+		ext2_warning (sb, "dx_probe", "unsupported directory index "
+			      "(dir %lu)", dir->i_ino);
+		brelse (bh);
+		*err = ERR_BAD_DX_DIR;
+		return NULL;
+	}
+	for (;;) {
+		frame->bh = bh;
+		count = dx_count (entries);
+		if (!count || count > dx_limit (entries))
+			goto bad;
+		p = entries + 1;
+		q = entries + count - 1;
+		while (p <= q) {
+			m = p + (q - p) / 2;
+			if (m->hash > hash)
+				q = m - 1;
+			else
+				p = m + 1;
+		}
+		frame->entries = entries;
+		frame->at = p - 1;
+		if (frame->at->block >= nblocks)
+			goto bad;
+		if (!levels--)
+			return frame;
+		if (!(bh = ext2_bread (dir, frame->at->block, 0, err))) {
+			dx_release (frames);
+			return NULL;
+		}
+		frame++;
+		frame->bh = bh;
+		entries = ((struct dx_node *) bh->b_data)->entries;
+		if (dx_limit (entries) != dx_node_limit (sb))
+			goto bad;
+	}
+bad:
+	ext2_warning (sb, "dx_probe", "corrupted directory index (dir %lu)",
+		      dir->i_ino);
+	dx_release (frames);
+	*err = ERR_BAD_DX_DIR;
+	return NULL;
+}
+
+/*
+ * Names with one hash can spill over into the next leaf. Step "frame"
+ * on to the next leaf if it starts with "hash": returns 1 if it did,
+ * 0 if there is no such leaf and -1 on a read error.
+ */
+static int dx_next_block (struct inode * dir, unsigned long hash,
+			  struct dx_frame * frames, struct dx_frame * frame)
+{
+	struct dx_frame * p = frame;
+	struct buffer_head * bh;
+	int err, levels = 0;
+
+	while (++p->at >= p->entries + dx_count (p->entries)) {
+		if (p == frames)
+			return 0;
+		p--;
+		levels++;
+	}
+	if ((p->at->hash & ~1) != hash)
+		return 0;
+	while (levels--) {
+		if (!(bh = ext2_bread (dir, p->at->block, 0, &err)))
+			return -1;
+		p++;
+		brelse (p->bh);
+		p->bh = bh;
+		p->entries = p->at = ((struct dx_node *) bh->b_data)->entries;
+	}
+	return 1;
+}
+
+static struct buffer_head * ext2_dx_find_entry (struct inode * dir,
+						const char * name, int namelen,
+						struct ext2_dir_entry ** res_dir,
+						int * err)
+{
+	struct dx_frame frames[DX_MAX_LEVELS], * frame;
+	struct buffer_head * bh;
+	unsigned long hash, block;
+	int found;
+
+	hash = dx_hash (name, namelen);
+	if (!(frame = dx_probe (dir, hash, frames, err)))
+		return NULL;
+	*err = -ENOENT;
+	do {
+		block = frame->at->block;
+		if (!(bh = ext2_bread (dir, block, 0, err)))
+			break;
+		found = search_dirblock (dir, bh, name, namelen,
+			block << EXT2_BLOCK_SIZE_BITS(dir->i_sb), res_dir);
+		if (found > 0) {
+			dx_release (frames);
+			return bh;
+		}
+		brelse (bh);
+		if (found < 0)
+			break;
+	} while (dx_next_block (dir, hash, frames, frame) > 0);
+	dx_release (frames);
+	return NULL;
+}
+
+/*
+ * Add a block to the end of a directory.
+ */
+static struct buffer_head * ext2_append (struct inode * dir,
+					 unsigned long * block, int * err)
+{
+	struct buffer_head * bh;
+
+	*block = dir->i_size >> EXT2_BLOCK_SIZE_BITS(dir->i_sb);
+	if (!(bh = ext2_bread (dir, *block, 1, err)))
+		return NULL;
+	dir->i_size += dir->i_sb->s_blocksize;
+	dir->i_dirt = 1;
+	return bh;
+}
+
+/*
+ * Insert an index entry after frame->at.
+ */
+static void dx_insert_block (struct dx_frame * frame, unsigned long hash,
+			     unsigned long block)
+{
+	struct dx_entry * entries = frame->entries;
+	struct dx_entry * new = frame->at + 1;
+	int count = dx_count (entries);
+
+	memmove (new + 1, new, (char *) (entries + count) - (char *) new);
+	new->hash = hash;
+	new->block = block;
+	dx_count (entries) = count + 1;
+	mark_buffer_dirty(frame->bh);
+}
+
+/*
+ * Make room in a full index block: split it, or if it is the root of a
+ * one-level index, move the root's entries into a new index block below
+ * it. Returns the frame that now holds the entry for the leaf, or NULL.
+ */
+static struct dx_frame * dx_grow_index (struct inode * dir,
+					struct dx_frame * frames,
+					struct dx_frame * frame, int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct dx_entry * entries = frame->entries, * entries2;
+	struct buffer_head * bh2;
+	struct dx_node * node2;
+	unsigned long block, hash2;
+	int count = dx_count (entries), count1;
+
+	if (frame != frames &&
+	    dx_count (frames->entries) == dx_limit (frames->entries)) {
+		ext2_warning (sb, "ext2_dx_add_entry", "directory index full "
+			      "(dir %lu)", dir->i_ino);
+		*err = -ENOSPC;
+		return NULL;
+	}
+	if (!(bh2 = ext2_append (dir, &block, err)))
+		return NULL;
+	node2 = (struct dx_node *) bh2->b_data;
+	node2->fake.inode = 0;
+	node2->fake.rec_len = sb->s_blocksize;
+	node2->fake.name_len = 0;
+	entries2 = node2->entries;
+	mark_buffer_dirty(bh2);
+	if (frame == frames) {
+		memcpy (entries2, entries, count * sizeof (struct dx_entry));
+		dx_limit (entries2) = dx_node_limit (sb);
+		dx_count (entries) = 1;
+		entries[0].block = block;
+		((struct dx_root *) frame->bh->b_data)->info.indirect_levels = 1;
+		mark_buffer_dirty(frame->bh);
+		frames[1].bh = bh2;
+		frames[1].entries = entries2;
+		frames[1].at = entries2 + (frame->at - entries);
+		frame->at = entries;
+		return frames + 1;
+	}
+	count1 = count / 2;
+	hash2 = entries[count1].hash;
+	memcpy (entries2, entries + count1,
+		(count - count1) * sizeof (struct dx_entry));
+	dx_limit (entries2) = dx_node_limit (sb);
+	dx_count (entries2) = count - count1;
+	dx_count (entries) = count1;
+	mark_buffer_dirty(frame->bh);
+	dx_insert_block (frame - 1, hash2, block);
+	if (frame->at - entries >= count1) {
+		frame->at = entries2 + (frame->at - entries - count1);
+		frame->entries = entries2;
+		brelse (frame->bh);
+		frame->bh = bh2;
+	} else
+		brelse (bh2);
+	return frame;
+}
+
+struct dx_map {
+	unsigned long hash;
+	unsigned short offs;
+	unsigned short size;
+};
+
+/*
+ * Move the upper half (by hash) of the entries in a full leaf to a new
+ * block, and enter that block in the index after frame->at. Consumes
+ * bh.
+ */
+static int dx_split_leaf (struct inode * dir, struct buffer_head * bh,
+			  struct dx_frame * frame)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * bh2;
+	struct ext2_dir_entry * de, * de2, * last;
+	struct dx_map * map, tmp;
+	unsigned long block, hash2;
+	char * data1 = bh->b_data, * data2, * to;
+	int count, split, size, gap, i, j, err;
+
+	map = (struct dx_map *) __get_free_page(GFP_KERNEL);
+	if (!map) {
+		brelse (bh);
+		return -ENOMEM;
+	}
+	count = 0;
+	for (de = (struct ext2_dir_entry *) data1;
+	     (char *) de < data1 + sb->s_blocksize;
+	     de = (struct ext2_dir_entry *) ((char *) de + de->rec_len)) {
+		if (!de->inode)
+			continue;
+		map[count].hash = dx_hash (de->name, de->name_len);
+		map[count].offs = (char *) de - data1;
+		map[count].size = EXT2_DIR_REC_LEN(de->name_len);
+		count++;
+	}
+	err = -ENOSPC;
+	if (count < 2)
+		goto out;
+	for (gap = count / 2; gap > 0; gap /= 2)
+		for (i = gap; i < count; i++)
+			for (j = i - gap; j >= 0 &&
+			     map[j].hash > map[j + gap].hash; j -= gap) {
+				tmp = map[j];
+				map[j] = map[j + gap];
+				map[j + gap] = tmp;
+			}
+	/* split by size, so that both halves have room */
+	for (split = 0, size = 0; split < count - 1; split++) {
+		size += map[split].size;
+		if (size > sb->s_blocksize / 2)
+			break;
+	}
+	if (!split)
+		split = 1;
+	hash2 = map[split].hash;
+	if (hash2 == map[split - 1].hash)
+		hash2 |= 1;
+	if (!(bh2 = ext2_append (dir, &block, &err)))
+		goto out;
+	data2 = bh2->b_data;
+	to = data2;
+	last = NULL;
+	for (i = split; i < count; i++) {
+		de = (struct ext2_dir_entry *) (data1 + map[i].offs);
+		memcpy (to, de, map[i].size);
+		last = (struct ext2_dir_entry *) to;
+		last->rec_len = map[i].size;
+		to += map[i].size;
+		de->inode = 0;
+	}
+	last->rec_len += data2 + sb->s_blocksize - to;
+	/* pack what is left at the start of the old block */
+	to = data1;
+	last = NULL;
+	for (de = (struct ext2_dir_entry *) data1;
+	     (char *) de < data1 + sb->s_blocksize; de = de2) {
+		de2 = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+		if (!de->inode)
+			continue;
+		size = EXT2_DIR_REC_LEN(de->name_len);
+		memmove (to, de, size);
+		last = (struct ext2_dir_entry *) to;
+		last->rec_len = size;
+		to += size;
+	}
+	last->rec_len += data1 + sb->s_blocksize - to;
+	dx_insert_block (frame, hash2, block);
+	mark_buffer_dirty(bh2);
+	brelse (bh2);
+	err = 0;
+out:
+	mark_buffer_dirty(bh);
+	brelse (bh);
+	free_page ((unsigned long) map);
+	return err;
+}
+
+/*
+ * Add a name to an indexed directory: find its leaf, and split the leaf
+ * first if it is full.
+ */
+static struct buffer_head * ext2_dx_add_entry (struct inode * dir,
+					       const char * name, int namelen,
+					       struct ext2_dir_entry ** res_dir,
+					       int * err)
+{
+	struct dx_frame frames[DX_MAX_LEVELS], * frame;
+	struct ext2_dir_entry * de;
+	struct buffer_head * bh;
+	unsigned long hash, block;
+	int tries;
+
+	hash = dx_hash (name, namelen);
+	for (tries = 0; tries < 3; tries++) {
+		if (!(frame = dx_probe (dir, hash, frames, err)))
+			return NULL;
+		block = frame->at->block;
+		if (!(bh = ext2_bread (dir, block, 0, err)))
+			break;
+		de = add_dirent_to_buf (dir, name, namelen, bh,
+			block << EXT2_BLOCK_SIZE_BITS(dir->i_sb), err);
+		if (de) {
+			dx_release (frames);
+			*res_dir = de;
+			return bh;
+		}
+		if (*err != -ENOSPC) {
+			brelse (bh);
+			break;
+		}
+		if (dx_count (frame->entries) == dx_limit (frame->entries) &&
+		    !(frame = dx_grow_index (dir, frames, frame, err))) {
+			brelse (bh);
+			break;
+		}
+		*err = dx_split_leaf (dir, bh, frame);
+		dx_release (frames);
+		if (*err)
+			return NULL;
+		*err = -ENOSPC;
+	}
+	dx_release (frames);
+	return NULL;
+}
+
+/*
+ * Turn a one-block directory into an indexed one: the entries after ".."
+ * move to a new leaf, and the rest of block 0 becomes the index root.
+ */
+static struct buffer_head * ext2_dx_make_indexed (struct inode * dir,
+						  const char * name, int namelen,
+						  struct ext2_dir_entry ** res_dir,
+						  int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * bh, * bh2;
+	struct ext2_dir_entry * de;
+	struct dx_root * root;
+	struct dx_entry * entries;
+	unsigned long block;
+	char * top;
+	int len;
+
+	if (!(bh = ext2_bread (dir, 0, 0, err)))
+		return NULL;
+	root = (struct dx_root *) bh->b_data;
+	if (root->dot.rec_len != EXT2_DIR_REC_LEN(1) ||
+	    root->dot.name_len != 1 || root->dot_name[0] != '.' ||
+	    root->dotdot.name_len != 2 || root->dotdot_name[0] != '.' ||
+	    root->dotdot_name[1] != '.') {
+		brelse (bh);
+		*err = ERR_BAD_DX_DIR;
+		return NULL;
+	}
+	if (!(bh2 = ext2_append (dir, &block, err))) {
+		brelse (bh);
+		return NULL;
+	}
+	de = (struct ext2_dir_entry *) ((char *) &root->dotdot +
+					root->dotdot.rec_len);
+	len = bh->b_data + sb->s_blocksize - (char *) de;
+	top = bh2->b_data + len;
+	memcpy (bh2->b_data, de, len);
+	de = (struct ext2_dir_entry *) bh2->b_data;
+	if (!len) {
+		de->inode = 0;
+		de->name_len = 0;
+		de->rec_len = 0;
+	} else
+		while ((char *) de + de->rec_len < top)
+			de = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+	de->rec_len += sb->s_blocksize - len;
+	mark_buffer_dirty(bh2);
+	brelse (bh2);
+
+	root->dotdot.rec_len = sb->s_blocksize - EXT2_DIR_REC_LEN(1);
+	memset (&root->info, 0, sizeof (root->info));
+	root->info.info_length = sizeof (root->info);
+	root->info.hash_version = DX_HASH_LEGACY;
+	entries = root->entries;
+	dx_limit (entries) = dx_root_limit (sb);
+	dx_count (entries) = 1;
+	entries[0].block = block;
+	mark_buffer_dirty(bh);
+	brelse (bh);
+	dir->u.ext2_i.i_flags |= EXT2_INDEX_FL;
+	dir->i_dirt = 1;
+	return ext2_dx_add_entry (dir, name, namelen, res_dir, err);
+}
+
 /*
  *	ext2_find_entry()
  *
@@ -71,6 +706,9 @@ static int ext2_match (int len, const char * const name,
  * returns the cache buffer in which the entry was found, and the entry
  * itself (as a parameter - res_dir). It does NOT read the inode of the
  * entry - you'll have to do that yourself if you want to.
+ *
+ * Indexed directories are searched through the index, except for "."
+ * and "..", which are in the first block anyway.
  */
 static struct buffer_head * ext2_find_entry (struct inode * dir,
 					     const char * const name, int namelen,
@@ -95,6 +733,14 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 		namelen = EXT2_NAME_LEN;
 #endif
 
+	if (is_dx(dir) && !is_dot(name, namelen)) {
+		struct buffer_head * bh;
+
+		bh = ext2_dx_find_entry (dir, name, namelen, res_dir, &err);
+		if (bh || err != ERR_BAD_DX_DIR)
+			return bh;
+	}
+
 	memset (bh_use, 0, sizeof (bh_use));
 	toread = 0;
 	for (block = 0; block < NAMEI_RA_SIZE; ++block) {
@@ -112,8 +758,6 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 	offset = 0;
 	while (offset < dir->i_size) {
 		struct buffer_head * bh;
-		struct ext2_dir_entry * de;
-		char * dlimit;
 
 		if ((block % NAMEI_RA_BLOCKS) == 0 && toread) {
 			ll_rw_block (READ, toread, bh_read);
@@ -131,24 +775,17 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 			break;
 		}
 
-		de = (struct ext2_dir_entry *) bh->b_data;
-		dlimit = bh->b_data + sb->s_blocksize;
-		while ((char *) de < dlimit) {
-			if (!ext2_check_dir_entry ("ext2_find_entry", dir,
-						   de, bh, offset))
-				goto failure;
-			if (de->inode != 0 && ext2_match (namelen, name, de)) {
-				for (i = 0; i < NAMEI_RA_SIZE; ++i) {
-					if (bh_use[i] != bh)
-						brelse (bh_use[i]);
-				}
-				*res_dir = de;
-				return bh;
+		i = search_dirblock (dir, bh, name, namelen, offset, res_dir);
+		if (i > 0) {
+			for (i = 0; i < NAMEI_RA_SIZE; ++i) {
+				if (bh_use[i] != bh)
+					brelse (bh_use[i]);
 			}
-			offset += de->rec_len;
-			de = (struct ext2_dir_entry *)
-				((char *) de + de->rec_len);
+			return bh;
 		}
+		if (i < 0)
+			goto failure;
+		offset += sb->s_blocksize;
 
 		brelse (bh);
 		if (((block + NAMEI_RA_SIZE) << EXT2_BLOCK_SIZE_BITS (sb)) >=
@@ -181,22 +818,12 @@ int ext2_lookup (struct inode * dir, const char * name, int len,
 		iput (dir);
 		return -ENOENT;
 	}
-#ifndef DONT_USE_DCACHE
-	if (!(ino = ext2_dcache_lookup (dir->i_dev, dir->i_ino, name, len))) {
-#endif
-		if (!(bh = ext2_find_entry (dir, name, len, &de))) {
-			iput (dir);
-			return -ENOENT;
-		}
-		ino = de->inode;
-#ifndef DONT_USE_DCACHE
-		ext2_dcache_add (dir->i_dev, dir->i_ino, de->name,
-				 de->name_len, ino);
-#endif
-		brelse (bh);
-#ifndef DONT_USE_DCACHE
+	if (!(bh = ext2_find_entry (dir, name, len, &de))) {
+		iput (dir);
+		return -ENOENT;
 	}
-#endif
+	ino = de->inode;
+	brelse (bh);
 	if (!(*result = iget (dir->i_sb, ino))) {
 		iput (dir);
 		return -EACCES;
@@ -211,6 +838,9 @@ int ext2_lookup (struct inode * dir, const char * name, int len,
  * adds a file entry to the specified directory, using the same
  * semantics as ext2_find_entry(). It returns NULL if it failed.
  *
+ * A directory about to grow a second block is indexed instead if the
+ * file system has the dir_index feature.
+ *
  * NOTE!! The inode part of 'de' is left at 0 - which means you
  * may not sleep between calling this and putting something into
  * the entry, as someone else might have used it while you slept.
@@ -221,9 +851,8 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 					    int *err)
 {
 	unsigned long offset;
-	unsigned short rec_len;
 	struct buffer_head * bh;
-	struct ext2_dir_entry * de, * de1;
+	struct ext2_dir_entry * de;
 	struct super_block * sb;
 
 	*err = -EINVAL;
@@ -248,91 +877,52 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 		*err = -ENOENT;
 		return NULL;
 	}
-	bh = ext2_bread (dir, 0, 0, err);
-	if (!bh)
-		return NULL;
-	rec_len = EXT2_DIR_REC_LEN(namelen);
-	offset = 0;
-	de = (struct ext2_dir_entry *) bh->b_data;
-	*err = -ENOSPC;
-	while (1) {
-		if ((char *)de >= sb->s_blocksize + bh->b_data) {
-			brelse (bh);
-			bh = NULL;
-			bh = ext2_bread (dir, offset >> EXT2_BLOCK_SIZE_BITS(sb), 1, err);
-			if (!bh)
-				return NULL;
-			if (dir->i_size <= offset) {
-				if (dir->i_size == 0) {
-					*err = -ENOENT;
-					return NULL;
-				}
-
-				ext2_debug ("creating next block\n");
-
-				de = (struct ext2_dir_entry *) bh->b_data;
-				de->inode = 0;
-				de->rec_len = sb->s_blocksize;
-				dir->i_size = offset + sb->s_blocksize;
-				dir->i_dirt = 1;
-#if 0 /* XXX don't update any times until successful completion of syscall */
-				dir->i_ctime = CURRENT_TIME;
-#endif
-			} else {
-
-				ext2_debug ("skipping to next block\n");
-
-				de = (struct ext2_dir_entry *) bh->b_data;
-			}
+	if (is_dx(dir)) {
+		bh = ext2_dx_add_entry (dir, name, namelen, res_dir, err);
+		if (bh || *err != ERR_BAD_DX_DIR)
+			return bh;
+		/* the index is no use: forget it, the blocks are still valid */
+		dir->u.ext2_i.i_flags &= ~EXT2_INDEX_FL;
+		dir->i_dirt = 1;
+	}
+	for (offset = 0; ; offset += sb->s_blocksize) {
+		if (offset == sb->s_blocksize && dir->i_size == offset &&
+		    EXT2_HAS_COMPAT_FEATURE(sb, EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+			bh = ext2_dx_make_indexed (dir, name, namelen, res_dir,
+						   err);
+			if (bh || *err != ERR_BAD_DX_DIR)
+				return bh;
 		}
-		if (!ext2_check_dir_entry ("ext2_add_entry", dir, de, bh,
-					   offset)) {
-			*err = -ENOENT;
-			brelse (bh);
+		bh = ext2_bread (dir, offset >> EXT2_BLOCK_SIZE_BITS(sb), 1, err);
+		if (!bh)
 			return NULL;
-		}
-		if (de->inode != 0 && ext2_match (namelen, name, de)) {
-				*err = -EEXIST;
+		if (dir->i_size <= offset) {
+			if (dir->i_size == 0) {
 				brelse (bh);
+				*err = -ENOENT;
 				return NULL;
-		}
-		if ((de->inode == 0 && de->rec_len >= rec_len) ||
-		    (de->rec_len >= EXT2_DIR_REC_LEN(de->name_len) + rec_len)) {
-			offset += de->rec_len;
-			if (de->inode) {
-				de1 = (struct ext2_dir_entry *) ((char *) de +
-					EXT2_DIR_REC_LEN(de->name_len));
-				de1->rec_len = de->rec_len -
-					EXT2_DIR_REC_LEN(de->name_len);
-				de->rec_len = EXT2_DIR_REC_LEN(de->name_len);
-				de = de1;
 			}
+
+			ext2_debug ("creating next block\n");
+
+			de = (struct ext2_dir_entry *) bh->b_data;
 			de->inode = 0;
-			de->name_len = namelen;
-			memcpy (de->name, name, namelen);
-			/*
-			 * XXX shouldn't update any times until successful
-			 * completion of syscall, but too many callers depend
-			 * on this.
-			 *
-			 * XXX similarly, too many callers depend on
-			 * ext2_new_inode() setting the times, but error
-			 * recovery deletes the inode, so the worst that can
-			 * happen is that the times are slightly out of date
-			 * and/or different from the directory change time.
-			 */
-			dir->i_mtime = dir->i_ctime = CURRENT_TIME;
+			de->rec_len = sb->s_blocksize;
+			dir->i_size = offset + sb->s_blocksize;
 			dir->i_dirt = 1;
-			bh->b_dirt = 1;
+#if 0 /* XXX don't update any times until successful completion of syscall */
+			dir->i_ctime = CURRENT_TIME;
+#endif
+		}
+		de = add_dirent_to_buf (dir, name, namelen, bh, offset, err);
+		if (de) {
 			*res_dir = de;
-			*err = 0;
 			return bh;
 		}
-		offset += de->rec_len;
-		de = (struct ext2_dir_entry *) ((char *) de + de->rec_len);
+		brelse (bh);
+		if (*err != -ENOSPC)
+			return NULL;
 	}
-	brelse (bh);
-	return NULL;
 }
 
 /*
@@ -393,11 +983,7 @@ int ext2_create (struct inode * dir,const char * name, int len, int mode,
 		return err;
 	}
 	de->inode = inode->i_ino;
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
-			 de->inode);
-#endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -467,11 +1053,7 @@ int ext2_mknod (struct inode * dir, const char * name, int len, int mode,
 		return err;
 	}
 	de->inode = inode->i_ino;
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
-			 de->inode);
-#endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -531,7 +1113,7 @@ int ext2_mkdir (struct inode * dir, const char * name, int len, int mode)
 	de->name_len = 2;
 	strcpy (de->name, "..");
 	inode->i_nlink = 2;
-	dir_block->b_dirt = 1;
+	mark_buffer_dirty(dir_block);
 	brelse (dir_block);
 	inode->i_mode = S_IFDIR | (mode & S_IRWXUGO & ~current->umask);
 	if (dir->i_mode & S_ISGID)
@@ -546,11 +1128,7 @@ int ext2_mkdir (struct inode * dir, const char * name, int len, int mode)
 		return err;
 	}
 	de->inode = inode->i_ino;
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
-			 de->inode);
-#endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -674,22 +1252,15 @@ repeat:
 	up(&inode->i_sem);
 	if (retval)
 		goto end_rmdir;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
 	}
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_remove(inode->i_dev, inode->i_ino, ".", 1);
-	ext2_dcache_remove(inode->i_dev, inode->i_ino, "..", 2);
-#endif
 	if (inode->i_nlink != 2)
 		ext2_warning (inode->i_sb, "ext2_rmdir",
 			      "empty directory has nlink!=2 (%d)",
 			      inode->i_nlink);
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_remove (dir->i_dev, dir->i_ino, de->name, de->name_len);
-#endif
 	inode->i_nlink = 0;
 	inode->i_dirt = 1;
 	dir->i_nlink--;
@@ -742,14 +1313,11 @@ repeat:
 	retval = ext2_delete_entry (de, bh);
 	if (retval)
 		goto end_unlink;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
 	}
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_remove (dir->i_dev, dir->i_ino, de->name, de->name_len);
-#endif
 	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
 	dir->i_dirt = 1;
 	inode->i_nlink--;
@@ -807,7 +1375,7 @@ int ext2_symlink (struct inode * dir, const char * name, int len,
 		link[i++] = c;
 	link[i] = 0;
 	if (name_block) {
-		name_block->b_dirt = 1;
+		mark_buffer_dirty(name_block);
 		brelse (name_block);
 	}
 	inode->i_size = i;
@@ -830,11 +1398,7 @@ int ext2_symlink (struct inode * dir, const char * name, int len,
 		return err;
 	}
 	de->inode = inode->i_ino;
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
-			 de->inode);
-#endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -876,11 +1440,7 @@ int ext2_link (struct inode * oldinode, struct inode * dir,
 		return err;
 	}
 	de->inode = oldinode->i_ino;
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
-			 de->inode);
-#endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -1025,6 +1585,16 @@ start_up:
 					 &retval);
 	if (!new_bh)
 		goto end_rename;
+	/*
+	 * adding to an indexed directory may have split the leaf the old
+	 * entry was in and moved it: look it up again
+	 */
+	if (new_dir == old_dir && is_dx (old_dir)) {
+		brelse (old_bh);
+		old_bh = ext2_find_entry (old_dir, old_name, old_len, &old_de);
+		if (!old_bh)
+			goto try_again;
+	}
 	/*
 	 * sanity checking before doing the rename - avoid races
 	 */
@@ -1038,12 +1608,6 @@ start_up:
 	 * ok, that's it
 	 */
 	new_de->inode = old_inode->i_ino;
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_remove (old_dir->i_dev, old_dir->i_ino, old_de->name,
-			    old_de->name_len);
-	ext2_dcache_add (new_dir->i_dev, new_dir->i_ino, new_de->name,
-			 new_de->name_len, new_de->inode);
-#endif
 	retval = ext2_delete_entry (old_de, old_bh);
 	if (retval == -ENOENT)
 		goto try_again;
@@ -1056,19 +1620,19 @@ start_up:
 	}
 	old_dir->i_ctime = old_dir->i_mtime = CURRENT_TIME;
 	old_dir->i_dirt = 1;
-	old_bh->b_dirt = 1;
+	mark_buffer_dirty(old_bh);
 	if (IS_SYNC(old_dir)) {
 		ll_rw_block (WRITE, 1, &old_bh);
 		wait_on_buffer (old_bh);
 	}
-	new_bh->b_dirt = 1;
+	mark_buffer_dirty(new_bh);
 	if (IS_SYNC(new_dir)) {
 		ll_rw_block (WRITE, 1, &new_bh);
 		wait_on_buffer (new_bh);
 	}
 	if (dir_bh) {
 		PARENT_INO(dir_bh->b_data) = new_dir->i_ino;
-		dir_bh->b_dirt = 1;
+		mark_buffer_dirty(dir_bh);
 		old_dir->i_nlink--;
 		old_dir->i_dirt = 1;
 		if (new_inode) {
@@ -24,6 +24,7 @@
 #include <linux/stat.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/malloc.h>
 
 extern int vsprintf (char *, const char *, va_list);
 
@@ -36,7 +37,7 @@ void ext2_error (struct super_block * sb, const char * function,
 	if (!(sb->s_flags & MS_RDONLY)) {
 		sb->u.ext2_sb.s_mount_state |= EXT2_ERROR_FS;
 		sb->u.ext2_sb.s_es->s_state |= EXT2_ERROR_FS;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
 	}
 	va_start (args, fmt);
@@ -66,7 +67,7 @@ NORET_TYPE void ext2_panic (struct super_block * sb, const char * function,
 	if (!(sb->s_flags & MS_RDONLY)) {
 		sb->u.ext2_sb.s_mount_state |= EXT2_ERROR_FS;
 		sb->u.ext2_sb.s_es->s_state |= EXT2_ERROR_FS;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
 	}
 	va_start (args, fmt);
@@ -89,6 +90,23 @@ void ext2_warning (struct super_block * sb, const char * function,
 		MAJOR(sb->s_dev), MINOR(sb->s_dev), function, buf);
 }
 
+/*
+ * The free run summaries (see balloc.c) are dropped when the fs goes
+ * read-only, as e2fsck may change the bitmaps before it is rw again.
+ */
+static void ext2_put_group_info (struct super_block * sb)
+{
+	int i;
+
+	for (i = 0; i < EXT2_MAX_GROUP_DESC; i++)
+		if (sb->u.ext2_sb.s_group_info[i]) {
+			kfree_s (sb->u.ext2_sb.s_group_info[i],
+				 EXT2_DESC_PER_BLOCK(sb) *
+				 sizeof (struct ext2_group_info));
+			sb->u.ext2_sb.s_group_info[i] = NULL;
+		}
+}
+
 void ext2_put_super (struct super_block * sb)
 {
 	int i;
@@ -96,15 +114,13 @@ void ext2_put_super (struct super_block * sb)
 	lock_super (sb);
 	if (!(sb->s_flags & MS_RDONLY)) {
 		sb->u.ext2_sb.s_es->s_state = sb->u.ext2_sb.s_mount_state;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	}
-#ifndef DONT_USE_DCACHE
-	ext2_dcache_invalidate (sb->s_dev);
-#endif
 	sb->s_dev = 0;
 	for (i = 0; i < EXT2_MAX_GROUP_DESC; i++)
 		if (sb->u.ext2_sb.s_group_desc[i])
 			brelse (sb->u.ext2_sb.s_group_desc[i]);
+	ext2_put_group_info (sb);
 	for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
 		if (sb->u.ext2_sb.s_inode_bitmap[i])
 			brelse (sb->u.ext2_sb.s_inode_bitmap[i]);
@@ -159,10 +175,10 @@ static int convert_pre_02b_fs (struct super_block * sb,
 		gdp[i].bg_free_blocks_count = old_group_desc[i].bg_free_blocks_count;
 		gdp[i].bg_free_inodes_count = old_group_desc[i].bg_free_inodes_count;
 	}
-	bh2->b_dirt = 1;
+	mark_buffer_dirty(bh2);
 	brelse (bh2);
 	es->s_magic = EXT2_SUPER_MAGIC;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	sb->s_magic = EXT2_SUPER_MAGIC;
 	return 1;
 }
@@ -206,6 +222,8 @@ static int parse_options (char * options, unsigned long * sb_block,
 		}
 		else if (!strcmp (this_char, "debug"))
 			set_opt (*mount_options, DEBUG);
+		else if (!strcmp (this_char, "dirindex"))
+			set_opt (*mount_options, DIR_INDEX);
 		else if (!strcmp (this_char, "errors")) {
 			if (!value || !*value) {
 				printk ("EXT2-fs: the errors option requires "
@@ -264,6 +282,29 @@ static int parse_options (char * options, unsigned long * sb_block,
 	return 1;
 }
 
+/*
+ * The "dirindex" mount option turns on the directory index feature. It
+ * is a compatible feature, so the super block has to be at least at the
+ * dynamic revision for e2fsck to believe it.
+ */
+static void ext2_enable_dir_index (struct super_block * sb,
+				   struct ext2_super_block * es)
+{
+	if (!test_opt (sb, DIR_INDEX) ||
+	    EXT2_HAS_COMPAT_FEATURE (sb, EXT2_FEATURE_COMPAT_DIR_INDEX))
+		return;
+	if (es->s_rev_level < EXT2_DYNAMIC_REV) {
+		es->s_rev_level = EXT2_DYNAMIC_REV;
+		es->s_first_ino = EXT2_FIRST_INO;
+		es->s_inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+	}
+	es->s_feature_compat |= EXT2_FEATURE_COMPAT_DIR_INDEX;
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
+	sb->s_dirt = 1;
+	printk ("EXT2-fs: directory indexes enabled on dev %d/%d\n",
+		MAJOR(sb->s_dev), MINOR(sb->s_dev));
+}
+
 static void ext2_setup_super (struct super_block * sb,
 			      struct ext2_super_block * es)
 {
@@ -287,8 +328,9 @@ static void ext2_setup_super (struct super_block * sb,
 			es->s_max_mnt_count = EXT2_DFL_MAX_MNT_COUNT;
 		es->s_mnt_count++;
 		es->s_mtime = CURRENT_TIME;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
+		ext2_enable_dir_index (sb, es);
 		if (test_opt (sb, DEBUG))
 			printk ("[EXT II FS %s, %s, bs=%lu, fs=%lu, gc=%lu, "
 				"bpg=%lu, ipg=%lu, mo=%04lx]\n",
@@ -498,6 +540,28 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 		return NULL;
 	}
 
+	if (es->s_rev_level > EXT2_GOOD_OLD_REV) {
+		if (es->s_feature_incompat) {
+			sb->s_dev = 0;
+			unlock_super (sb);
+			brelse (bh);
+			printk ("EXT2-fs: dev %d/%d: unsupported optional "
+				"features (%lx)\n", MAJOR(dev), MINOR(dev),
+				es->s_feature_incompat);
+			return NULL;
+		}
+		if (es->s_feature_ro_compat && !(sb->s_flags & MS_RDONLY)) {
+			sb->s_dev = 0;
+			unlock_super (sb);
+			brelse (bh);
+			printk ("EXT2-fs: dev %d/%d: unsupported optional "
+				"features (%lx), mount read-only\n",
+				MAJOR(dev), MINOR(dev),
+				es->s_feature_ro_compat);
+			return NULL;
+		}
+	}
+
 	if (sb->s_blocksize != sb->u.ext2_sb.s_frag_size) {
 		sb->s_dev = 0;
 		unlock_super (sb);
@@ -511,8 +575,10 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 				        es->s_first_data_block +
 				       EXT2_BLOCKS_PER_GROUP(sb) - 1) /
 				       EXT2_BLOCKS_PER_GROUP(sb);
-	for (i = 0; i < EXT2_MAX_GROUP_DESC; i++)
+	for (i = 0; i < EXT2_MAX_GROUP_DESC; i++) {
 		sb->u.ext2_sb.s_group_desc[i] = NULL;
+		sb->u.ext2_sb.s_group_info[i] = NULL;
+	}
 	bh_count = (sb->u.ext2_sb.s_groups_count + EXT2_DESC_PER_BLOCK(sb) - 1) /
 		   EXT2_DESC_PER_BLOCK(sb);
 	if (bh_count > EXT2_MAX_GROUP_DESC) {
@@ -570,7 +636,7 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 #ifdef EXT2FS_PRE_02B_COMPAT
 	if (fs_converted) {
 		for (i = 0; i < bh_count; i++)
-			sb->u.ext2_sb.s_group_desc[i]->b_dirt = 1;
+			mark_buffer_dirty(sb->u.ext2_sb.s_group_desc[i]);
 		sb->s_dirt = 1;
 	}
 #endif
@@ -582,7 +648,7 @@ static void ext2_commit_super (struct super_block * sb,
 			       struct ext2_super_block * es)
 {
 	es->s_wtime = CURRENT_TIME;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	sb->s_dirt = 0;
 }
 
@@ -627,9 +693,15 @@ int ext2_remount (struct super_block * sb, int * flags, char * data)
 	parse_options (data, &tmp, &sb->u.ext2_sb.s_mount_opt);
 
 	es = sb->u.ext2_sb.s_es;
-	if ((*flags & MS_RDONLY) == (sb->s_flags & MS_RDONLY))
+	if ((*flags & MS_RDONLY) == (sb->s_flags & MS_RDONLY)) {
+		if (!(sb->s_flags & MS_RDONLY))
+			ext2_enable_dir_index (sb, es);
 		return 0;
+	}
 	if (*flags & MS_RDONLY) {
+		lock_super (sb);
+		ext2_put_group_info (sb);
+		unlock_super (sb);
 		if (es->s_state & EXT2_VALID_FS ||
 		    !(sb->u.ext2_sb.s_mount_state & EXT2_VALID_FS))
 			return 0;
@@ -639,7 +711,7 @@ int ext2_remount (struct super_block * sb, int * flags, char * data)
 		 */
 		es->s_state = sb->u.ext2_sb.s_mount_state;
 		es->s_mtime = CURRENT_TIME;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
 		ext2_commit_super (sb, es);
 	}
@@ -649,6 +721,9 @@ int ext2_remount (struct super_block * sb, int * flags, char * data)
 		 * store the current valid flag.  (It may have been changed 
 		 * by e2fsck since we originally mounted the partition.)
 		 */
+		if (es->s_rev_level > EXT2_GOOD_OLD_REV &&
+		    es->s_feature_ro_compat)
+			return -EROFS;
 		sb->u.ext2_sb.s_mount_state = es->s_state;
 		sb->s_flags &= ~MS_RDONLY;
 		ext2_setup_super (sb, es);
@@ -0,0 +1,131 @@
+/*
+ *  linux/fs/file_read.c
+ *
+ * read() for the block mapped filesystems (minix, xiafs and ext2). It
+ * maps the file with bmap_run(), so that where the file lies in one run
+ * on the disk the indirect blocks are walked once per run rather than
+ * once per block, and it starts the reads of all the buffers it wants
+ * with a single ll_rw_block(): the blocks of a run then go out as one
+ * merged request instead of one request each.
+ */
+
+#include <asm/segment.h>
+#include <asm/system.h>
+
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/stat.h>
+#include <linux/locks.h>
+
+#define NBUF	32
+
+int generic_file_read(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	int read, left, chars;
+	int block, blocks, offset;
+	int phys, run, i, nr, bhrequest;
+	struct buffer_head * bh;
+	struct buffer_head * bhreq[NBUF];
+	struct buffer_head * buflist[NBUF];
+	struct super_block * sb;
+	unsigned int size;
+
+	if (!inode) {
+		printk("generic_file_read: inode = NULL\n");
+		return -EINVAL;
+	}
+	if (!S_ISREG(inode->i_mode)) {
+		printk("generic_file_read: mode = %07o\n",inode->i_mode);
+		return -EINVAL;
+	}
+	sb = inode->i_sb;
+	offset = filp->f_pos;
+	size = inode->i_size;
+	if (offset > size)
+		left = 0;
+	else
+		left = size - offset;
+	if (left > count)
+		left = count;
+	if (left <= 0)
+		return 0;
+	read = 0;
+	block = offset >> sb->s_blocksize_bits;
+	offset &= sb->s_blocksize - 1;
+	size = (size + sb->s_blocksize - 1) >> sb->s_blocksize_bits;
+	blocks = (left + offset + sb->s_blocksize - 1) >> sb->s_blocksize_bits;
+	if (filp->f_reada) {
+		blocks += read_ahead[MAJOR(inode->i_dev)] >> (sb->s_blocksize_bits - 9);
+		if (block + blocks > size)
+			blocks = size - block;
+	}
+
+	while (left > 0 && blocks > 0) {
+		/*
+		 * Map up to NBUF blocks, and start reading those that
+		 * aren't in the cache.
+		 */
+		nr = bhrequest = 0;
+		while (nr < NBUF && blocks > 0) {
+			phys = bmap_run(inode, block, NBUF - nr < blocks ? NBUF - nr : blocks, &run);
+			block += run;
+			blocks -= run;
+			for (i = 0 ; i < run ; i++) {
+				bh = NULL;
+				if (phys) {
+					bh = getblk(inode->i_dev, phys + i, sb->s_blocksize);
+					if (bh && !bh->b_uptodate)
+						bhreq[bhrequest++] = bh;
+				}
+				buflist[nr++] = bh;
+			}
+		}
+		if (bhrequest)
+			ll_rw_block(READ, bhrequest, bhreq);
+
+		/*
+		 * Copy out what was asked for, and let go of the read-ahead.
+		 */
+		for (i = 0 ; i < nr ; i++) {
+			bh = buflist[i];
+			if (left <= 0) {
+				brelse(bh);
+				continue;
+			}
+			if (bh) {
+				wait_on_buffer(bh);
+				if (!bh->b_uptodate) {	/* read error? */
+					brelse(bh);
+					left = 0;
+					continue;
+				}
+			}
+			if (left < sb->s_blocksize - offset)
+				chars = left;
+			else
+				chars = sb->s_blocksize - offset;
+			filp->f_pos += chars;
+			left -= chars;
+			read += chars;
+			if (bh) {
+				memcpy_tofs(buf,offset+bh->b_data,chars);
+				brelse(bh);
+				buf += chars;
+			} else {
+				while (chars-- > 0)
+					put_fs_byte(0,buf++);
+			}
+			offset = 0;
+		}
+	}
+	if (!read)
+		return -EIO;
+	filp->f_reada = 1;
+	if (!IS_RDONLY(inode)) {
+		inode->i_atime = CURRENT_TIME;
+		inode->i_dirt = 1;
+	}
+	return read;
+}
@@ -5,11 +5,16 @@
  */
 
 #include <linux/fs.h>
+#include <linux/kernel.h>
 #include <linux/string.h>
 #include <linux/mm.h>
 
 struct file * first_file;
 int nr_files = 0;
+int max_files = 0;
+
+/* files with f_count == 0, linked through f_next_free */
+static struct file * free_filps = NULL;
 
 static void insert_file_free(struct file *file)
 {
@@ -40,6 +45,12 @@ static void put_last_free(struct file *file)
 	file->f_next->f_prev = file;
 }
 
+static inline void put_free_filp(struct file * file)
+{
+	file->f_next_free = free_filps;
+	free_filps = file;
+}
+
 void grow_files(void)
 {
 	struct file * file;
@@ -52,38 +63,66 @@ void grow_files(void)
 
 	nr_files+=i= PAGE_SIZE/sizeof(struct file);
 
-	if (!first_file)
-		file->f_next = file->f_prev = first_file = file++, i--;
+	if (!first_file) {
+		file->f_next = file->f_prev = first_file = file;
+		put_free_filp(file++);
+		i--;
+	}
+
+	for (; i ; i--) {
+		insert_file_free(file);
+		put_free_filp(file++);
+	}
+}
 
-	for (; i ; i--)
-		insert_file_free(file++);
+/*
+ * "files=" on the command line sets the size the file table may grow
+ * to. The default is a file for every four pages of memory.
+ */
+void files_setup(char *str, int *ints)
+{
+	if (ints[0] > 0 && ints[1] >= 64)
+		max_files = ints[1];
 }
 
 unsigned long file_table_init(unsigned long start, unsigned long end)
 {
 	first_file = NULL;
+	free_filps = NULL;
+	if (!max_files) {
+		max_files = (end >> PAGE_SHIFT) >> 2;
+		if (max_files < NR_FILE)
+			max_files = NR_FILE;
+	}
 	return start;
 }
 
 struct file * get_empty_filp(void)
 {
-	int i;
 	struct file * f;
 
-	if (!first_file)
+	if (!free_filps && nr_files < max_files)
 		grow_files();
-repeat:
-	for (f = first_file, i=0; i < nr_files; i++, f = f->f_next)
-		if (!f->f_count) {
-			remove_file_free(f);
-			memset(f,0,sizeof(*f));
-			put_last_free(f);
-			f->f_count = 1;
-			return f;
-		}
-	if (nr_files < NR_FILE) {
-		grow_files();
-		goto repeat;
+	if (!(f = free_filps))
+		return NULL;
+	free_filps = f->f_next_free;
+	remove_file_free(f);
+	memset(f,0,sizeof(*f));
+	put_last_free(f);
+	f->f_count = 1;
+	return f;
+}
+
+/*
+ * Drop a reference to a file, making it free if that was the last one.
+ * Whatever the file was open on has to be released by the caller.
+ */
+void put_filp(struct file * f)
+{
+	if (!f->f_count) {
+		printk("VFS: put_filp: file count is 0\n");
+		return;
 	}
-	return NULL;
+	if (!--f->f_count)
+		put_free_filp(f);
 }
@@ -442,6 +442,7 @@ struct super_block *hpfs_read_super(struct super_block *s,
 	 */
 
 	s->s_magic = HPFS_SUPER_MAGIC;
+	s->s_nocache = 1;	/* lookup fills in new inodes from the dirent */
 	s->s_blocksize = 512;
 	s->s_blocksize_bits = 9;
 	s->s_op = (struct super_operations *) &hpfs_sops;
@@ -19,7 +19,20 @@ static struct inode_hash_entry {
 
 static struct inode * first_inode;
 static struct wait_queue * inode_wait = NULL;
-static int nr_inodes = 0, nr_free_inodes = 0;
+static int nr_free_inodes = 0;
+int nr_inodes = 0;
+int max_inodes = 0;
+
+/*
+ * Inodes with i_count == 0 are also on one of these lists, oldest first,
+ * so that get_empty_inode() doesn't have to search the whole table. An
+ * inode's i_list says which list it is on, or 0 for none.
+ */
+#define INODE_FREE	1	/* not hashed: nothing to lose by reusing it */
+#define INODE_UNUSED	2	/* hashed and clean: a cached inode */
+#define INODE_DIRTY	3	/* has to be written before reuse */
+
+static struct inode * inode_list[4];
 
 static inline int const hashfn(dev_t dev, unsigned int i)
 {
@@ -77,6 +90,53 @@ static void remove_inode_hash(struct inode *inode)
 	inode->i_hash_prev = inode->i_hash_next = NULL;
 }
 
+static void add_inode_list(struct inode * inode, int list)
+{
+	struct inode * first = inode_list[list];
+
+	inode->i_list = list;
+	if (!first) {
+		inode->i_lru_next = inode->i_lru_prev = inode;
+		inode_list[list] = inode;
+		return;
+	}
+	inode->i_lru_next = first;
+	inode->i_lru_prev = first->i_lru_prev;
+	first->i_lru_prev->i_lru_next = inode;
+	first->i_lru_prev = inode;
+}
+
+static void del_inode_list(struct inode * inode)
+{
+	int list = inode->i_list;
+
+	if (!list)
+		return;
+	if (inode->i_lru_next == inode)
+		inode_list[list] = NULL;
+	else {
+		inode->i_lru_next->i_lru_prev = inode->i_lru_prev;
+		inode->i_lru_prev->i_lru_next = inode->i_lru_next;
+		if (inode_list[list] == inode)
+			inode_list[list] = inode->i_lru_next;
+	}
+	inode->i_lru_next = inode->i_lru_prev = NULL;
+	inode->i_list = 0;
+}
+
+/*
+ * Put an inode that has just lost its last user on the right list.
+ */
+static void put_unused_inode(struct inode * inode)
+{
+	if (!inode->i_hash_prev && hash(inode->i_dev, inode->i_ino)->inode != inode)
+		add_inode_list(inode, INODE_FREE);
+	else if (inode->i_dirt)
+		add_inode_list(inode, INODE_DIRTY);
+	else
+		add_inode_list(inode, INODE_UNUSED);
+}
+
 static void put_last_free(struct inode *inode)
 {
 	remove_inode_free(inode);
@@ -98,17 +158,38 @@ void grow_inodes(void)
 	nr_inodes += i;
 	nr_free_inodes += i;
 
-	if (!first_inode)
-		inode->i_next = inode->i_prev = first_inode = inode++, i--;
+	if (!first_inode) {
+		inode->i_next = inode->i_prev = first_inode = inode;
+		add_inode_list(inode++, INODE_FREE);
+		i--;
+	}
+
+	for ( ; i ; i-- ) {
+		insert_inode_free(inode);
+		add_inode_list(inode++, INODE_FREE);
+	}
+}
 
-	for ( ; i ; i-- )
-		insert_inode_free(inode++);
+/*
+ * "inodes=" on the command line sets the size the inode table may grow
+ * to. The default is two inodes for every file, see file_table_init().
+ */
+void inodes_setup(char *str, int *ints)
+{
+	if (ints[0] > 0 && ints[1] >= 64)
+		max_inodes = ints[1];
 }
 
 unsigned long inode_init(unsigned long start, unsigned long end)
 {
 	memset(hash_table, 0, sizeof(hash_table));
+	memset(inode_list, 0, sizeof(inode_list));
 	first_inode = NULL;
+	if (!max_inodes) {
+		max_inodes = (end >> PAGE_SHIFT) >> 1;
+		if (max_inodes < NR_INODE)
+			max_inodes = NR_INODE;
+	}
 	return start;
 }
 
@@ -149,14 +230,18 @@ void clear_inode(struct inode * inode)
 	struct wait_queue * wait;
 
 	wait_on_inode(inode);
+	invalidate_inode_pages(inode);
 	remove_inode_hash(inode);
 	remove_inode_free(inode);
+	del_inode_list(inode);
 	wait = ((volatile struct inode *) inode)->i_wait;
 	if (inode->i_count)
 		nr_free_inodes++;
 	memset(inode,0,sizeof(*inode));
 	((volatile struct inode *) inode)->i_wait = wait;
+	inode->i_version = ++event;
 	insert_inode_free(inode);
+	add_inode_list(inode, INODE_FREE);
 }
 
 int fs_may_mount(dev_t dev)
@@ -266,6 +351,21 @@ int bmap(struct inode * inode, int block)
 	return 0;
 }
 
+/*
+ * Like bmap(), but also sets *len to the number of blocks from "block"
+ * on, up to count, that follow it on the disk (or are holes like it).
+ * A filesystem without a bmap_run operation gets runs of one block.
+ */
+int bmap_run(struct inode * inode, int block, int count, int * len)
+{
+	*len = 1;
+	if (count < 1)
+		count = 1;
+	if (inode->i_op && inode->i_op->bmap_run)
+		return inode->i_op->bmap_run(inode,block,count,len);
+	return bmap(inode,block);
+}
+
 void invalidate_inodes(dev_t dev)
 {
 	struct inode * inode, * next;
@@ -337,35 +437,31 @@ repeat:
 	}
 	inode->i_count--;
 	nr_free_inodes++;
+	put_unused_inode(inode);
 	return;
 }
 
+/*
+ * Prefer an inode with no identity to a cached one, and grow the table
+ * rather than write out a dirty one.
+ */
 struct inode * get_empty_inode(void)
 {
-	struct inode * inode, * best;
-	int i;
+	struct inode * inode;
 
-	if (nr_inodes < NR_INODE && nr_free_inodes < (nr_inodes >> 2))
+	if (nr_inodes < max_inodes && nr_free_inodes < (nr_inodes >> 2))
 		grow_inodes();
 repeat:
-	inode = first_inode;
-	best = NULL;
-	for (i = 0; i<nr_inodes; inode = inode->i_next, i++) {
-		if (!inode->i_count) {
-			if (!best)
-				best = inode;
-			if (!inode->i_dirt && !inode->i_lock) {
-				best = inode;
-				break;
-			}
-		}
-	}
-	if (!best || best->i_dirt || best->i_lock)
-		if (nr_inodes < NR_INODE) {
-			grow_inodes();
+	inode = inode_list[INODE_FREE];
+	if (!inode)
+		inode = inode_list[INODE_UNUSED];
+	if (!inode && nr_inodes < max_inodes) {
+		grow_inodes();
+		if (inode_list[INODE_FREE])
 			goto repeat;
-		}
-	inode = best;
+	}
+	if (!inode)
+		inode = inode_list[INODE_DIRTY];
 	if (!inode) {
 		printk("VFS: No free inodes - contact Linus\n");
 		sleep_on(&inode_wait);
@@ -382,6 +478,7 @@ repeat:
 	if (inode->i_count)
 		goto repeat;
 	clear_inode(inode);
+	del_inode_list(inode);
 	inode->i_count = 1;
 	inode->i_nlink = 1;
 	inode->i_sem.count = 1;
@@ -458,8 +555,10 @@ repeat:
 	goto return_it;
 
 found_it:
-	if (!inode->i_count)
+	if (!inode->i_count) {
 		nr_free_inodes--;
+		del_inode_list(inode);
+	}
 	inode->i_count++;
 	wait_on_inode(inode);
 	if (inode->i_dev != sb->s_dev || inode->i_ino != nr) {
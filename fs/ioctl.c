@@ -91,6 +91,11 @@ asmlinkage int sys_ioctl(unsigned int fd, unsigned int cmd, unsigned long arg)
 			if (filp->f_inode && S_ISREG(filp->f_inode->i_mode))
 				return file_ioctl(filp,cmd,arg);
 
+			if (filp->f_inode && S_ISBLK(filp->f_inode->i_mode) &&
+			    (cmd == BLKELVGET || cmd == BLKELVSET))
+				return blk_elevator_ioctl(filp->f_inode->i_rdev,
+					cmd, arg);
+
 			if (filp->f_op && filp->f_op->ioctl)
 				return filp->f_op->ioctl(filp->f_inode, filp, cmd,arg);
 
@@ -229,6 +229,7 @@ struct super_block *isofs_read_super(struct super_block *s,void *data,
 	s->u.isofs_sb.s_firstdatazone = isonum_733( rootp->extent) << 
 		(ISOFS_BLOCK_BITS - blocksize_bits);
 	s->s_magic = ISOFS_SUPER_MAGIC;
+	s->s_nocache = 1;	/* lookup sets up i_backlink for ".." */
 	
 	/* The CDROM is read-only, has no nodes (devices) on it, and since
 	   all of the files appear to be owned by root, we really do not want
@@ -19,6 +19,7 @@
 #include <linux/errno.h>
 #include <linux/stat.h>
 #include <linux/fcntl.h>
+#include <linux/malloc.h>
 
 #define OFFSET_MAX	((off_t)0x7fffffff)	/* FIXME: move elsewhere? */
 
@@ -31,24 +32,24 @@ static struct file_lock *alloc_lock(struct file_lock **pos, struct file_lock *fl
                                     unsigned int fd);
 static void free_lock(struct file_lock **fl);
 
-static struct file_lock file_lock_table[NR_FILE_LOCKS];
-static struct file_lock *file_lock_free_list;
+/*
+ * Locks come from a slab cache instead of a fixed table. A freed lock
+ * that still has F_SETLKW sleepers on its fl_wait can't go back to the
+ * cache yet, as they unhook themselves from it when they run: it waits
+ * on file_lock_dead until they have.
+ */
+static struct kmem_cache *file_lock_cachep;
+static struct file_lock *file_lock_dead;
 
 /*
- * Called at boot time to initialize the lock table ...
+ * Called at boot time to set up the lock cache ...
  */
 
 void fcntl_init_locks(void)
 {
-	struct file_lock *fl;
-
-	for (fl = &file_lock_table[0]; fl < file_lock_table + NR_FILE_LOCKS - 1; fl++) {
-		fl->fl_next = fl + 1;
-		fl->fl_owner = NULL;
-	}
-	file_lock_table[NR_FILE_LOCKS - 1].fl_next = NULL;
-	file_lock_table[NR_FILE_LOCKS - 1].fl_owner = NULL;
-	file_lock_free_list = &file_lock_table[0];
+	file_lock_cachep = kmem_cache_create("file_lock", sizeof(struct file_lock), 0, NULL);
+	if (!file_lock_cachep)
+		panic("fcntl_init_locks: cannot create lock cache");
 }
 
 int fcntl_getlk(unsigned int fd, struct flock *l)
@@ -410,16 +411,21 @@ static struct file_lock *alloc_lock(struct file_lock **pos,
 				    struct file_lock *fl,
                                     unsigned int     fd)
 {
-	struct file_lock *tmp;
+	struct file_lock *tmp, **p;
 
-	tmp = file_lock_free_list;
+	for (p = &file_lock_dead; (tmp = *p) != NULL; ) {
+		if (tmp->fl_wait) {
+			p = &tmp->fl_next;
+			continue;
+		}
+		*p = tmp->fl_next;
+		kmem_cache_free(file_lock_cachep, tmp);
+	}
+
+	/* lock_it() holds pointers into the list: don't sleep */
+	tmp = (struct file_lock *) kmem_cache_alloc(file_lock_cachep, GFP_ATOMIC);
 	if (tmp == NULL)
 		return NULL;			/* no available entry */
-	if (tmp->fl_owner != NULL)
-		panic("alloc_lock: broken free list\n");
-
-	/* remove from free list */
-	file_lock_free_list = tmp->fl_next;
 
 	*tmp = *fl;
 
@@ -433,7 +439,7 @@ static struct file_lock *alloc_lock(struct file_lock **pos,
 }
 
 /*
- * Add a lock to the free list ...
+ * Give a lock back to the cache ...
  */
 
 static void free_lock(struct file_lock **fl_p)
@@ -446,9 +452,12 @@ static void free_lock(struct file_lock **fl_p)
 
 	*fl_p = (*fl_p)->fl_next;
 
-	fl->fl_next = file_lock_free_list;	/* add to free list */
-	file_lock_free_list = fl;
 	fl->fl_owner = NULL;			/* for sanity checks */
 
 	wake_up(&fl->fl_wait);
+	if (fl->fl_wait) {
+		fl->fl_next = file_lock_dead;
+		file_lock_dead = fl;
+	} else
+		kmem_cache_free(file_lock_cachep, fl);
 }
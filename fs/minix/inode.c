@@ -28,7 +28,7 @@ void minix_put_inode(struct inode *inode)
 static void minix_commit_super (struct super_block * sb,
 			       struct minix_super_block * ms)
 {
-	sb->u.minix_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(sb->u.minix_sb.s_sbh);
 	sb->s_dirt = 0;
 }
 
@@ -54,7 +54,7 @@ void minix_put_super(struct super_block *sb)
 	lock_super(sb);
 	if (!(sb->s_flags & MS_RDONLY)) {
 		sb->u.minix_sb.s_ms->s_state = sb->u.minix_sb.s_mount_state;
-		sb->u.minix_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.minix_sb.s_sbh);
 	}
 	sb->s_dev = 0;
 	for(i = 0 ; i < MINIX_I_MAP_SLOTS ; i++)
@@ -90,7 +90,7 @@ int minix_remount (struct super_block * sb, int * flags, char * data)
 			return 0;
 		/* Mounting a rw partition read-only. */
 		ms->s_state = sb->u.minix_sb.s_mount_state;
-		sb->u.minix_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.minix_sb.s_sbh);
 		sb->s_dirt = 1;
 		minix_commit_super (sb, ms);
 	}
@@ -98,7 +98,7 @@ int minix_remount (struct super_block * sb, int * flags, char * data)
 	  	/* Mount a partition which is read-only, read-write. */
 		sb->u.minix_sb.s_mount_state = ms->s_state;
 		ms->s_state &= ~MINIX_VALID_FS;
-		sb->u.minix_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.minix_sb.s_sbh);
 		sb->s_dirt = 1;
 
 		if (!(sb->u.minix_sb.s_mount_state & MINIX_VALID_FS))
@@ -197,7 +197,7 @@ struct super_block *minix_read_super(struct super_block *s,void *data,
 	}
 	if (!(s->s_flags & MS_RDONLY)) {
 		ms->s_state &= ~MINIX_VALID_FS;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		s->s_dirt = 1;
 	}
 	if (!(s->u.minix_sb.s_mount_state & MINIX_VALID_FS))
@@ -271,6 +271,67 @@ int minix_bmap(struct inode * inode,int block)
 	return block_bmap(bread(inode->i_dev,i,BLOCK_SIZE),block & 511);
 }
 
+/*
+ * minix_bmap_run maps block and sets *len to the number of blocks from
+ * there, up to count, that follow it on the disk.  A run ends with its
+ * block of pointers, so each call walks the indirect chain only once.
+ */
+static int array_run(unsigned short * p, int nr, int count, int * len)
+{
+	int first = p[nr];
+	int i;
+
+	for (i = 1; i < count; i++)
+		if (p[nr+i] != (first ? first+i : 0))
+			break;
+	*len = i;
+	return first;
+}
+
+static int block_bmap_run(struct inode * inode, int i, int nr, int count, int * len)
+{
+	struct buffer_head * bh;
+	int tmp;
+
+	if (count > 512-nr)
+		count = 512-nr;
+	if (!i || !(bh = bread(inode->i_dev,i,BLOCK_SIZE))) {
+		*len = count;
+		return 0;
+	}
+	tmp = array_run((unsigned short *) bh->b_data,nr,count,len);
+	brelse(bh);
+	return tmp;
+}
+
+int minix_bmap_run(struct inode * inode,int block,int count,int * len)
+{
+	int i;
+
+	*len = 1;
+	if (block<0) {
+		printk("minix_bmap_run: block<0");
+		return 0;
+	}
+	if (block >= 7+512+512*512) {
+		printk("minix_bmap_run: block>big");
+		return 0;
+	}
+	if (block < 7) {
+		if (count > 7-block)
+			count = 7-block;
+		return array_run(inode->u.minix_i.i_data,block,count,len);
+	}
+	block -= 7;
+	if (block < 512)
+		return block_bmap_run(inode,inode_bmap(inode,7),block,count,len);
+	block -= 512;
+	i = inode_bmap(inode,8);
+	if (i)
+		i = block_bmap(bread(inode->i_dev,i,BLOCK_SIZE),block>>9);
+	return block_bmap_run(inode,i,block & 511,count,len);
+}
+
 static struct buffer_head * inode_getblk(struct inode * inode, int nr, int create)
 {
 	int tmp;
@@ -349,7 +410,7 @@ repeat:
 		goto repeat;
 	}
 	*p = tmp;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	return result;
 }
@@ -477,7 +538,7 @@ static struct buffer_head * minix_update_inode(struct inode * inode)
 	else for (block = 0; block < 9; block++)
 		raw_inode->i_zone[block] = inode->u.minix_i.i_data[block];
 	inode->i_dirt=0;
-	bh->b_dirt=1;
+	mark_buffer_dirty(bh);
 	return bh;
 }
 
@@ -250,6 +250,7 @@ struct super_block *msdos_read_super(struct super_block *s,void *data,
 	MSDOS_SB(s)->fat_wait = NULL;
 	MSDOS_SB(s)->fat_lock = 0;
 	MSDOS_SB(s)->prev_free = 0;
+	s->s_nocache = 1;	/* lookup follows i_old to renamed-over files */
 	if (!(s->s_mounted = iget(s,MSDOS_ROOT_INO))) {
 		s->s_dev = 0;
 		printk("get root inode failed\n");
@@ -415,7 +416,7 @@ void msdos_write_inode(struct inode *inode)
 	date_unix2dos(inode->i_mtime,&raw_entry->time,&raw_entry->date);
 	raw_entry->time = CT_LE_W(raw_entry->time);
 	raw_entry->date = CT_LE_W(raw_entry->date);
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 }
 
@@ -86,6 +86,41 @@ int permission(struct inode * inode,int mask)
 	return 0;
 }
 
+/*
+ * Look a name up through the name cache (fs/dcache.c). The directory
+ * is held across the filesystem's lookup so that what it found can be
+ * entered under the version the directory had when we started. "." and
+ * ".." aren't cached, nor are mount points: iget() of the cached inode
+ * number covers those, but the mounted root has another device.
+ */
+static int cached_lookup(struct inode * dir, const char * name, int len,
+	struct inode ** result)
+{
+	unsigned long ino, version;
+	int error;
+
+	if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.')))
+		return dir->i_op->lookup(dir,name,len,result);
+	if (dcache_lookup(dir,name,len,&ino)) {
+		if (!ino) {
+			iput(dir);
+			return -ENOENT;
+		}
+		*result = iget(dir->i_sb,ino);
+		iput(dir);
+		return *result ? 0 : -EACCES;
+	}
+	version = dir->i_version;
+	dir->i_count++;
+	error = dir->i_op->lookup(dir,name,len,result);
+	if (!error && *result && (*result)->i_dev == dir->i_dev)
+		dcache_add(dir,name,len,(*result)->i_ino,version);
+	else if (error == -ENOENT)
+		dcache_add(dir,name,len,0,version);
+	iput(dir);
+	return error;
+}
+
 /*
  * lookup() looks up one part of a pathname, using the fs-dependent
  * routines (currently minix_lookup) for it. It also checks for
@@ -127,7 +162,7 @@ int lookup(struct inode * dir,const char * name, int len,
 		*result = dir;
 		return 0;
 	}
-	return dir->i_op->lookup(dir,name,len,result);
+	return cached_lookup(dir,name,len,result);
 }
 
 int follow_link(struct inode * dir, struct inode * inode,
@@ -315,6 +350,7 @@ int open_namei(const char * pathname, int flag, int mode,
 		else {
 			dir->i_count++;		/* create eats the dir */
 			error = dir->i_op->create(dir,basename,namelen,mode,res_inode);
+			dir->i_version = ++event;
 			up(&dir->i_sem);
 			iput(dir);
 			return error;
@@ -371,6 +407,7 @@ int open_namei(const char * pathname, int flag, int mode,
 	      inode->i_size = 0;
 	      if (inode->i_op && inode->i_op->truncate)
 	           inode->i_op->truncate(inode);
+	      file_pages_written(inode);
 	      if ((error = notify_change(NOTIFY_SIZE, inode))) {
 		   iput(inode);
 		   return error;
@@ -407,9 +444,12 @@ int do_mknod(const char * filename, int mode, dev_t dev)
 		iput(dir);
 		return -EPERM;
 	}
+	dir->i_count++;
 	down(&dir->i_sem);
 	error = dir->i_op->mknod(dir,basename,namelen,mode,dev);
+	dir->i_version = ++event;
 	up(&dir->i_sem);
+	iput(dir);
 	return error;
 }
 
@@ -462,9 +502,12 @@ static int do_mkdir(const char * pathname, int mode)
 		iput(dir);
 		return -EPERM;
 	}
+	dir->i_count++;
 	down(&dir->i_sem);
 	error = dir->i_op->mkdir(dir,basename,namelen,mode);
+	dir->i_version = ++event;
 	up(&dir->i_sem);
+	iput(dir);
 	return error;
 }
 
@@ -506,7 +549,11 @@ static int do_rmdir(const char * name)
 		iput(dir);
 		return -EPERM;
 	}
-	return dir->i_op->rmdir(dir,basename,namelen);
+	dir->i_count++;
+	error = dir->i_op->rmdir(dir,basename,namelen);
+	dir->i_version = ++event;
+	iput(dir);
+	return error;
 }
 
 asmlinkage int sys_rmdir(const char * pathname)
@@ -547,7 +594,11 @@ static int do_unlink(const char * name)
 		iput(dir);
 		return -EPERM;
 	}
-	return dir->i_op->unlink(dir,basename,namelen);
+	dir->i_count++;
+	error = dir->i_op->unlink(dir,basename,namelen);
+	dir->i_version = ++event;
+	iput(dir);
+	return error;
 }
 
 asmlinkage int sys_unlink(const char * pathname)
@@ -588,9 +639,12 @@ static int do_symlink(const char * oldname, const char * newname)
 		iput(dir);
 		return -EPERM;
 	}
+	dir->i_count++;
 	down(&dir->i_sem);
 	error = dir->i_op->symlink(dir,basename,namelen,oldname);
+	dir->i_version = ++event;
 	up(&dir->i_sem);
+	iput(dir);
 	return error;
 }
 
@@ -647,9 +701,12 @@ static int do_link(struct inode * oldinode, const char * newname)
 		iput(oldinode);
 		return -EPERM;
 	}
+	dir->i_count++;
 	down(&dir->i_sem);
 	error = dir->i_op->link(oldinode, dir, basename, namelen);
+	dir->i_version = ++event;
 	up(&dir->i_sem);
+	iput(dir);
 	return error;
 }
 
@@ -723,10 +780,16 @@ static int do_rename(const char * oldname, const char * newname)
 		iput(new_dir);
 		return -EPERM;
 	}
+	old_dir->i_count++;
+	new_dir->i_count++;
 	down(&new_dir->i_sem);
 	error = old_dir->i_op->rename(old_dir, old_base, old_len, 
 		new_dir, new_base, new_len);
+	old_dir->i_version = ++event;
+	new_dir->i_version = ++event;
 	up(&new_dir->i_sem);
+	iput(old_dir);
+	iput(new_dir);
 	return error;
 }
 
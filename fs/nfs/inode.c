@@ -92,6 +92,7 @@ struct super_block *nfs_read_super(struct super_block *sb, void *raw_data,
 	sb->s_blocksize = 1024; /* XXX */
 	sb->s_blocksize_bits = 10;
 	sb->s_magic = NFS_SUPER_MAGIC;
+	sb->s_nocache = 1;	/* the server can change names under us */
 	sb->s_dev = dev;
 	sb->s_op = &nfs_sops;
 	server = &sb->u.nfs_sb.s_server;
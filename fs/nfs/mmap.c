@@ -64,7 +64,7 @@ int nfs_mmap(struct inode * inode, struct file * file,
 		inode->i_dirt = 1;
 	}
 
-	mpnt = (struct vm_area_struct * ) kmalloc(sizeof(struct vm_area_struct), GFP_KERNEL);
+	mpnt = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 	if (!mpnt)
 		return -ENOMEM;
 
@@ -79,7 +79,7 @@ int nfs_mmap(struct inode * inode, struct file * file,
 	mpnt->vm_offset = off;
 	mpnt->vm_ops = &nfs_file_mmap;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, NULL, NULL);
+	merge_segments(current, addr, addr + len, NULL, NULL);
 	return 0;
 }
 
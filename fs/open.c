@@ -84,6 +84,7 @@ asmlinkage int sys_truncate(const char * path, unsigned int length)
 	inode->i_size = length;
 	if (inode->i_op && inode->i_op->truncate)
 		inode->i_op->truncate(inode);
+	file_pages_written(inode);
 	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
 	inode->i_dirt = 1;
 	error = notify_change(NOTIFY_SIZE, inode);
@@ -105,6 +106,7 @@ asmlinkage int sys_ftruncate(unsigned int fd, unsigned int length)
 	inode->i_size = length;
 	if (inode->i_op && inode->i_op->truncate)
 		inode->i_op->truncate(inode);
+	file_pages_written(inode);
 	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
 	inode->i_dirt = 1;
 	return notify_change(NOTIFY_SIZE, inode);
@@ -398,7 +400,7 @@ int do_open(const char * filename,int flags,int mode)
 	error = open_namei(filename,flag,mode,&inode,NULL);
 	if (error) {
 		current->filp[fd]=NULL;
-		f->f_count--;
+		put_filp(f);
 		return error;
 	}
 
@@ -412,7 +414,7 @@ int do_open(const char * filename,int flags,int mode)
 		error = f->f_op->open(inode,f);
 		if (error) {
 			iput(inode);
-			f->f_count--;
+			put_filp(f);
 			current->filp[fd]=NULL;
 			return error;
 		}
@@ -456,8 +458,8 @@ int close_fp(struct file *filp, unsigned int fd)
 	}
 	if (filp->f_op && filp->f_op->release)
 		filp->f_op->release(inode,filp);
-	filp->f_count--;
 	filp->f_inode = NULL;
+	put_filp(filp);
 	iput(inode);
 	return 0;
 }
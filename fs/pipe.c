@@ -389,7 +389,7 @@ asmlinkage int sys_pipe(unsigned long * fildes)
 		if (!(f[j] = get_empty_filp()))
 			break;
 	if (j==1)
-		f[0]->f_count--;
+		put_filp(f[0]);
 	if (j<2)
 		return -ENFILE;
 	j=0;
@@ -401,15 +401,15 @@ asmlinkage int sys_pipe(unsigned long * fildes)
 	if (j==1)
 		current->filp[fd[0]]=NULL;
 	if (j<2) {
-		f[0]->f_count--;
-		f[1]->f_count--;
+		put_filp(f[0]);
+		put_filp(f[1]);
 		return -EMFILE;
 	}
 	if (!(inode=get_pipe_inode())) {
 		current->filp[fd[0]] = NULL;
 		current->filp[fd[1]] = NULL;
-		f[0]->f_count--;
-		f[1]->f_count--;
+		put_filp(f[0]);
+		put_filp(f[1]);
 		return -ENFILE;
 	}
 	f[0]->f_inode = f[1]->f_inode = inode;
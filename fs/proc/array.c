@@ -130,14 +130,23 @@ static int get_uptime(char * buffer)
 static int get_meminfo(char * buffer)
 {
 	struct sysinfo i;
+	unsigned long counts[NR_MEM_LISTS];
+	int len, order;
 
 	si_meminfo(&i);
 	si_swapinfo(&i);
-	return sprintf(buffer, "        total:   used:    free:   shared:  buffers:\n"
+	len = sprintf(buffer, "        total:   used:    free:   shared:  buffers:\n"
 		"Mem:  %8lu %8lu %8lu %8lu %8lu\n"
 		"Swap: %8lu %8lu %8lu\n",
 		i.totalram, i.totalram-i.freeram, i.freeram, i.sharedram, i.bufferram,
 		i.totalswap, i.totalswap-i.freeswap, i.freeswap);
+	free_area_counts(counts);
+	len += sprintf(buffer+len, "Free:");
+	for (order = 0; order < NR_MEM_LISTS; order++)
+		len += sprintf(buffer+len, " %lu*%lukB", counts[order], PAGE_SIZE >> (10 - order));
+	len += sprintf(buffer+len, "\nPageCache: %d pages, %lu hits, %lu misses\n",
+		page_cache_size, page_cache_hits, page_cache_misses);
+	return len;
 }
 
 static int get_version(char * buffer)
@@ -169,9 +178,13 @@ static unsigned long get_phys_addr(struct task_struct ** p, unsigned long ptr)
 	page = *PAGE_DIR_OFFSET((*p)->tss.cr3,ptr);
 	if (!(page & 1))
 		return 0;
-	page &= PAGE_MASK;
-	page += PAGE_PTR(ptr);
-	page = *(unsigned long *) page;
+	if (page & PAGE_4M)
+		page = LARGE_PTE(page, ptr);
+	else {
+		page &= PAGE_MASK;
+		page += PAGE_PTR(ptr);
+		page = *(unsigned long *) page;
+	}
 	if (!(page & 1))
 		return 0;
 	page &= PAGE_MASK;
@@ -256,12 +269,19 @@ static int get_stat(int pid, char * buffer)
 {
 	struct task_struct ** p = get_task(pid);
 	unsigned long sigignore=0, sigcatch=0, bit=1, wchan;
-	unsigned long vsize, eip, esp;
+	unsigned long vsize, eip, esp, it_real_value;
 	int i,tty_pgrp;
 	char state;
 
 	if (!p || !*p)
 		return 0;
+	/* it_real_value is when the real timer expires, not the ticks left */
+	it_real_value = (*p)->it_real_value;
+	if (it_real_value) {
+		it_real_value -= jiffies;
+		if ((long) it_real_value < 0)
+			it_real_value = 0;
+	}
 	if ((*p)->state < 0 || (*p)->state > 5)
 		state = '.';
 	else
@@ -290,7 +310,7 @@ static int get_stat(int pid, char * buffer)
 		tty_pgrp = -1;
 	return sprintf(buffer,"%d (%s) %c %d %d %d %d %d %lu %lu \
 %lu %lu %lu %ld %ld %ld %ld %ld %ld %lu %lu %ld %lu %u %u %lu %lu %lu %lu %lu %lu \
-%lu %lu %lu %lu\n",
+%lu %lu %lu %lu %lu\n",
 		pid,
 		(*p)->comm,
 		state,
@@ -313,7 +333,7 @@ static int get_stat(int pid, char * buffer)
 		(*p)->priority, /* this is the nice value ---
 				   subtract 15 in your user-level program. */
 		(*p)->timeout,
-		(*p)->it_real_value,
+		it_real_value,
 		(*p)->start_time,
 		vsize,
 		(*p)->rss, /* you might want to shift this left 3 */
@@ -327,7 +347,8 @@ static int get_stat(int pid, char * buffer)
 		(*p)->blocked,
 		sigignore,
 		sigcatch,
-		wchan);
+		wchan,
+		(*p)->reclaim_time);
 }
 
 static int get_statm(int pid, char * buffer)
@@ -347,6 +368,13 @@ static int get_statm(int pid, char * buffer)
 	      tpag -= PTRS_PER_PAGE;
 	      continue;
 	    }
+	    if (ptbl & PAGE_4M) {		/* a large shm page */
+	      size += PTRS_PER_PAGE;
+	      resident += PTRS_PER_PAGE;
+	      share += PTRS_PER_PAGE;
+	      tpag -= PTRS_PER_PAGE;
+	      continue;
+	    }
 	    buf = (unsigned long *)(ptbl & PAGE_MASK);
 	    for (pte = buf; pte < (buf + PTRS_PER_PAGE); ++pte) {
 	      if (*pte != 0) {
@@ -442,6 +470,11 @@ static int get_maps(int pid, char *buf)
 }
 
 extern int get_module_list(char *);
+extern int get_timer_stats(char *);
+extern int get_buffer_stats(char *);
+extern int get_bdflush_stats(char *);
+extern int get_slabinfo(char *);
+extern int get_vmstat(char *);
 
 static int array_read(struct inode * inode, struct file * file,char * buf, int count)
 {
@@ -499,6 +532,21 @@ static int array_read(struct inode * inode, struct file * file,char * buf, int c
 		case 17:
 			length = get_kstat(page);
 			break;
+		case 18:
+			length = get_timer_stats(page);
+			break;
+		case 19:
+			length = get_buffer_stats(page);
+			break;
+		case 20:
+			length = get_bdflush_stats(page);
+			break;
+		case 21:
+			length = get_slabinfo(page);
+			break;
+		case 22:
+			length = get_vmstat(page);
+			break;
 		default:
 			free_page((unsigned long) page);
 			return -EBADF;
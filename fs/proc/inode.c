@@ -48,6 +48,7 @@ struct super_block *proc_read_super(struct super_block *s,void *data,
 	s->s_blocksize = 1024;
 	s->s_blocksize_bits = 10;
 	s->s_magic = PROC_SUPER_MAGIC;
+	s->s_nocache = 1;	/* names come and go with processes */
 	s->s_op = &proc_sops;
 	unlock_super(s);
 	if (!(s->s_mounted = iget(s,PROC_ROOT_INO))) {
@@ -47,9 +47,13 @@ static int mem_read(struct inode * inode, struct file * file,char * buf, int cou
 		pte = *PAGE_DIR_OFFSET(cr3,addr);
 		if (!(pte & PAGE_PRESENT))
 			break;
-		pte &= PAGE_MASK;
-		pte += PAGE_PTR(addr);
-		page = *(unsigned long *) pte;
+		if (pte & PAGE_4M)
+			page = LARGE_PTE(pte, addr);
+		else {
+			pte &= PAGE_MASK;
+			pte += PAGE_PTR(addr);
+			page = *(unsigned long *) pte;
+		}
 		if (!(page & 1))
 			break;
 		page &= PAGE_MASK;
@@ -95,9 +99,16 @@ static int mem_write(struct inode * inode, struct file * file,char * buf, int co
 		pte = *PAGE_DIR_OFFSET(cr3,addr);
 		if (!(pte & PAGE_PRESENT))
 			break;
-		pte &= PAGE_MASK;
-		pte += PAGE_PTR(addr);
-		page = *(unsigned long *) pte;
+		if (pte & PAGE_4M) {
+			/* large pages are never copy-on-write */
+			if (!(pte & PAGE_RW))
+				break;
+			page = LARGE_PTE(pte, addr);
+		} else {
+			pte &= PAGE_MASK;
+			pte += PAGE_PTR(addr);
+			page = *(unsigned long *) pte;
+		}
 		if (!(page & PAGE_PRESENT))
 			break;
 		if (!(page & 2)) {
@@ -150,6 +150,7 @@ static struct super_block * read_super(dev_t dev,char *name,int flags,
 	}
 	s->s_dev = dev;
 	s->s_flags = flags;
+	s->s_nocache = 0;
 	if (!type->read_super(s,data, silent)) {
 		s->s_dev = 0;
 		return NULL;
@@ -390,15 +391,9 @@ static int copy_mount_options (const void * data, unsigned long *where)
 	if (!data)
 		return 0;
 
-	for (vma = current->mmap ; ; ) {
-		if (!vma ||
-		    (unsigned long) data < vma->vm_start) {
-			return -EFAULT;
-		}
-		if ((unsigned long) data < vma->vm_end)
-			break;
-		vma = vma->vm_next;
-	}
+	vma = find_vma(current, (unsigned long) data);
+	if (!vma || (unsigned long) data < vma->vm_start)
+		return -EFAULT;
 	i = vma->vm_end - (unsigned long) data;
 	if (PAGE_SIZE <= (unsigned long) i)
 		i = PAGE_SIZE-1;
@@ -301,12 +301,14 @@ static int sysv_file_write(struct inode * inode, struct file * filp, char * buf,
 		memcpy_fromfs(p,buf,c);
 		buf += c;
 		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
 	}
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 	filp->f_pos = pos;
 	inode->i_dirt = 1;
+	if (written > 0)
+		file_pages_written(inode);
 	if (sb->sv_block_size_ratio_bits > 0) /* block_size < BLOCK_SIZE ? */
 		coh_unlock_inode(inode);
 	return written;
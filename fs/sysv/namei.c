@@ -193,7 +193,7 @@ static int sysv_add_entry(struct inode * dir,
 			dir->i_mtime = dir->i_ctime = CURRENT_TIME;
 			for (i = 0; i < SYSV_NAMELEN ; i++)
 				de->name[i] = (i < namelen) ? name[i] : 0;
-			bh->b_dirt = 1;
+			mark_buffer_dirty(bh);
 			*res_dir = de;
 			break;
 		}
@@ -238,7 +238,7 @@ int sysv_create(struct inode * dir,const char * name, int len, int mode,
 		return error;
 	}
 	de->inode = inode->i_ino;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	*result = inode;
@@ -298,7 +298,7 @@ int sysv_mknod(struct inode * dir, const char * name, int len, int mode, int rde
 		return error;
 	}
 	de->inode = inode->i_ino;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	iput(inode);
@@ -349,7 +349,7 @@ int sysv_mkdir(struct inode * dir, const char * name, int len, int mode)
 	de->inode = dir->i_ino;
 	strcpy(de->name,".."); /* rest of de->name is zero, see sysv_new_block */
 	inode->i_nlink = 2;
-	dir_block->b_dirt = 1;
+	mark_buffer_dirty(dir_block);
 	brelse(dir_block);
 	inode->i_mode = S_IFDIR | (mode & 0777 & ~current->umask);
 	if (dir->i_mode & S_ISGID)
@@ -363,7 +363,7 @@ int sysv_mkdir(struct inode * dir, const char * name, int len, int mode)
 		return error;
 	}
 	de->inode = inode->i_ino;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	dir->i_nlink++;
 	dir->i_dirt = 1;
 	iput(dir);
@@ -473,7 +473,7 @@ int sysv_rmdir(struct inode * dir, const char * name, int len)
 	if (inode->i_nlink != 2)
 		printk("empty directory has nlink!=2 (%d)\n",inode->i_nlink);
 	de->inode = 0;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	inode->i_nlink=0;
 	inode->i_dirt=1;
 	dir->i_nlink--;
@@ -526,7 +526,7 @@ repeat:
 		inode->i_nlink=1;
 	}
 	de->inode = 0;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
 	dir->i_dirt = 1;
 	inode->i_nlink--;
@@ -570,7 +570,7 @@ int sysv_symlink(struct inode * dir, const char * name, int len, const char * sy
 	while (i < sb->sv_block_size_1 && (c = *(symname++)))
 		name_block_data[i++] = c;
 	name_block_data[i] = 0;
-	name_block->b_dirt = 1;
+	mark_buffer_dirty(name_block);
 	brelse(name_block);
 	inode->i_size = i;
 	inode->i_dirt = 1;
@@ -592,7 +592,7 @@ int sysv_symlink(struct inode * dir, const char * name, int len, const char * sy
 		return i;
 	}
 	de->inode = inode->i_ino;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	iput(inode);
@@ -629,7 +629,7 @@ int sysv_link(struct inode * oldinode, struct inode * dir, const char * name, in
 		return error;
 	}
 	de->inode = oldinode->i_ino;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	oldinode->i_nlink++;
@@ -782,11 +782,11 @@ start_up:
 		new_inode->i_ctime = CURRENT_TIME;
 		new_inode->i_dirt = 1;
 	}
-	old_bh->b_dirt = 1;
-	new_bh->b_dirt = 1;
+	mark_buffer_dirty(old_bh);
+	mark_buffer_dirty(new_bh);
 	if (dir_bh) {
 		PARENT_INO(dir_bh_data) = new_dir->i_ino;
-		dir_bh->b_dirt = 1;
+		mark_buffer_dirty(dir_bh);
 		old_dir->i_nlink--;
 		old_dir->i_dirt = 1;
 		if (new_inode) {
@@ -218,6 +218,69 @@ int xiafs_bmap(struct inode * inode,int zone)
     return i;
 }
 
+/*
+ * xiafs_bmap_run maps a zone and sets *len to the number of zones from
+ * there, up to count, that follow it on the disk.  A run ends with its
+ * zone of pointers, so each call walks the indirect chain only once.
+ */
+static int zone_run(u_long * lp, int nr, int count, int * len)
+{
+    u_long first = lp[nr];
+    int i;
+
+    for (i = 1; i < count; i++)
+        if (lp[nr+i] != (first ? first+i : 0))
+	    break;
+    *len = i;
+    return first;
+}
+
+static int ind_zone_run(struct inode * inode, int i, int nr, int count, int * len)
+{
+    struct buffer_head * bh;
+    int tmp;
+
+    if (count > XIAFS_ADDRS_PER_Z(inode->i_sb) - nr)
+        count = XIAFS_ADDRS_PER_Z(inode->i_sb) - nr;
+    if (!i || !(bh = bread(inode->i_dev, i, XIAFS_ZSIZE(inode->i_sb)))) {
+        *len = count;
+	return 0;
+    }
+    tmp = zone_run((u_long *) bh->b_data, nr, count, len);
+    brelse(bh);
+    return tmp;
+}
+
+int xiafs_bmap_run(struct inode * inode, int zone, int count, int * len)
+{
+    int i;
+
+    *len = 1;
+    if (zone < 0) {
+        printk("XIA-FS: block < 0 (%s %d)\n", WHERE_ERR);
+	return 0;
+    }
+    if (zone >= 8+(1+XIAFS_ADDRS_PER_Z(inode->i_sb))*XIAFS_ADDRS_PER_Z(inode->i_sb)) {
+        printk("XIA-FS: zone > big (%s %d)\n", WHERE_ERR);
+	return 0;
+    }
+    if (zone < 8) {
+        if (count > 8 - zone)
+	    count = 8 - zone;
+        return zone_run(inode->u.xiafs_i.i_zone, zone, count, len);
+    }
+    zone -= 8;
+    if (zone < XIAFS_ADDRS_PER_Z(inode->i_sb))
+        return ind_zone_run(inode, inode->u.xiafs_i.i_ind_zone, zone, count, len);
+    zone -= XIAFS_ADDRS_PER_Z(inode->i_sb);
+    i = inode->u.xiafs_i.i_dind_zone;
+    if (i)
+      i = zone_bmap(bread(inode->i_dev, i, XIAFS_ZSIZE(inode->i_sb)), 
+		    zone >> XIAFS_ADDRS_PER_Z_BITS(inode->i_sb));
+    return ind_zone_run(inode, i, zone & (XIAFS_ADDRS_PER_Z(inode->i_sb)-1),
+			count, len);
+}
+
 static u_long get_prev_addr(struct inode * inode, int zone)
 {
     u_long tmp;
@@ -306,7 +369,7 @@ repeat:
     }
     *lp = tmp;
     inode->i_blocks+=2 << XIAFS_ZSHIFT(inode->i_sb);
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     brelse(bh);
     return result;
 }
@@ -466,7 +529,7 @@ static struct buffer_head *  xiafs_update_inode(struct inode * inode)
 	                             | (inode->u.xiafs_i.i_dind_zone  & 0xffffff);
     }
     inode->i_dirt=0;
-    bh->b_dirt=1;
+    mark_buffer_dirty(bh);
     return bh;
 }
 
@@ -39,15 +39,12 @@
  */
 #undef EXT2FS_PRE_02B_COMPAT
 
-/*
- * Define DONT_USE_DCACHE to inhibit the directory cache
- */
-#define DONT_USE_DCACHE
-
 /*
  * Define EXT2_PREALLOCATE to preallocate data blocks for expanding files
  */
 #define EXT2_PREALLOCATE
+#define EXT2_MIN_PREALLOC	8	/* Blocks, window after a seek */
+#define EXT2_MAX_PREALLOC	256	/* Blocks, window of a long stream */
 
 /*
  * The second extended file system version
@@ -199,6 +196,7 @@ struct ext2_group_desc
 #define	EXT2_UNRM_FL			0x0002	/* Undelete */
 #define	EXT2_COMPR_FL			0x0004	/* Compress file */
 #define EXT2_SYNC_FL			0x0008	/* Synchronous updates */
+#define EXT2_INDEX_FL			0x1000	/* Hash-indexed directory */
 
 /*
  * ioctl commands
@@ -253,6 +251,7 @@ struct ext2_inode {
 #define EXT2_MOUNT_ERRORS_CONT		0x0010	/* Continue on errors */
 #define EXT2_MOUNT_ERRORS_RO		0x0020	/* Remount fs ro on errors */
 #define EXT2_MOUNT_ERRORS_PANIC		0x0040	/* Panic on errors */
+#define EXT2_MOUNT_DIR_INDEX		0x0080	/* Turn on directory indexes */
 
 #define clear_opt(o, opt)		o &= ~EXT2_MOUNT_##opt
 #define set_opt(o, opt)			o |= EXT2_MOUNT_##opt
@@ -297,9 +296,41 @@ struct ext2_super_block {
 	unsigned short s_pad;
 	unsigned long  s_lastcheck;	/* time of last check */
 	unsigned long  s_checkinterval;	/* max. time between checks */
-	unsigned long  s_reserved[238];	/* Padding to the end of the block */
+	unsigned long  s_creator_os;	/* OS */
+	unsigned long  s_rev_level;	/* Revision level */
+	unsigned short s_def_resuid;	/* Default uid for reserved blocks */
+	unsigned short s_def_resgid;	/* Default gid for reserved blocks */
+	/*
+	 * These fields are only valid in EXT2_DYNAMIC_REV super blocks
+	 */
+	unsigned long  s_first_ino;	/* First non-reserved inode */
+	unsigned short s_inode_size;	/* size of inode structure */
+	unsigned short s_block_group_nr;/* block group # of this superblock */
+	unsigned long  s_feature_compat;	/* compatible feature set */
+	unsigned long  s_feature_incompat;	/* incompatible feature set */
+	unsigned long  s_feature_ro_compat;	/* readonly-compatible feature set */
+	unsigned long  s_reserved[230];	/* Padding to the end of the block */
 };
 
+/*
+ * Revision levels
+ */
+#define EXT2_GOOD_OLD_REV	0	/* The good old (original) format */
+#define EXT2_DYNAMIC_REV	1	/* V2 format w/ dynamic inode sizes */
+
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+
+/*
+ * Feature set. Kernels that don't know a compatible feature may still
+ * mount the file system read-write; unknown incompatible features
+ * prevent mounting, unknown read-only compatible ones writing.
+ */
+#define EXT2_HAS_COMPAT_FEATURE(sb,mask)			\
+	((sb)->u.ext2_sb.s_es->s_rev_level >= EXT2_DYNAMIC_REV &&	\
+	 ((sb)->u.ext2_sb.s_es->s_feature_compat & (mask)))
+
+#define EXT2_FEATURE_COMPAT_DIR_INDEX		0x0020
+
 /*
  * Structure of a directory entry
  */
@@ -345,8 +376,8 @@ struct ext2_dir_entry {
 extern int ext2_permission (struct inode *, int);
 
 /* balloc.c */
-extern int ext2_new_block (struct super_block *, unsigned long,
-			   unsigned long *, unsigned long *);
+extern unsigned long ext2_new_blocks (struct super_block *, unsigned long,
+				      unsigned long *);
 extern void ext2_free_blocks (struct super_block *, unsigned long,
 			      unsigned long);
 extern unsigned long ext2_count_free_blocks (struct super_block *);
@@ -355,17 +386,6 @@ extern void ext2_check_blocks_bitmap (struct super_block *);
 /* bitmap.c */
 extern unsigned long ext2_count_free (struct buffer_head *, unsigned);
 
-#ifndef DONT_USE_DCACHE
-/* dcache.c */
-extern void ext2_dcache_invalidate (unsigned short);
-extern unsigned long ext2_dcache_lookup (unsigned short, unsigned long,
-					 const char *, int);
-extern void ext2_dcache_add (unsigned short, unsigned long, const char *,
-			     int, unsigned long);
-extern void ext2_dcache_remove (unsigned short, unsigned long, const char *,
-				int);
-#endif
-
 /* dir.c */
 extern int ext2_check_dir_entry (char *, struct inode *,
 				 struct ext2_dir_entry *, struct buffer_head *,
@@ -386,6 +406,7 @@ extern void ext2_check_inodes_bitmap (struct super_block *);
 
 /* inode.c */
 extern int ext2_bmap (struct inode *, int);
+extern int ext2_bmap_run (struct inode *, int, int, int *);
 
 extern struct buffer_head * ext2_getblk (struct inode *, long, int, int *);
 extern struct buffer_head * ext2_bread (struct inode *, int, int, int *);
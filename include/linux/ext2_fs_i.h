@@ -34,6 +34,7 @@ struct ext2_inode_info {
 	unsigned long  i_next_alloc_goal;
 	unsigned long  i_prealloc_block;
 	unsigned long  i_prealloc_count;
+	unsigned long  i_prealloc_window;
 };
 
 #endif	/* _LINUX_EXT2_FS_I */
@@ -18,6 +18,16 @@
 #define EXT2_MAX_GROUP_DESC	8
 #define EXT2_MAX_GROUP_LOADED	8
 
+/*
+ * In-core summary of the longest free run of blocks in a group
+ */
+struct ext2_group_info {
+	unsigned short gi_start;	/* First block of the run in the group */
+	unsigned short gi_len;		/* Its length */
+};
+
+#define EXT2_GI_UNKNOWN		0xffff	/* gi_start if not scanned since */
+
 /*
  * second extended-fs super-block data in memory
  */
@@ -34,6 +44,7 @@ struct ext2_sb_info {
 	struct buffer_head * s_sbh;	/* Buffer containing the super block */
 	struct ext2_super_block * s_es;	/* Pointer to the super block in the buffer */
 	struct buffer_head * s_group_desc[EXT2_MAX_GROUP_DESC];
+	struct ext2_group_info * s_group_info[EXT2_MAX_GROUP_DESC];
 	unsigned short s_loaded_inode_bitmaps;
 	unsigned short s_loaded_block_bitmaps;
 	unsigned long s_inode_bitmap_number[EXT2_MAX_GROUP_LOADED];
@@ -25,12 +25,10 @@
 #undef NR_OPEN
 #define NR_OPEN 256
 
-#define NR_INODE 2048	/* this should be bigger than NR_FILE */
-#define NR_FILE 1024	/* this can well be larger on a larger system */
+#define NR_INODE 2048	/* default minimum of max_inodes, see inode_init() */
+#define NR_FILE 1024	/* default minimum of max_files, see file_table_init() */
 #define NR_SUPER 32
-#define NR_HASH 997
 #define NR_IHASH 131
-#define NR_FILE_LOCKS 64
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
 
@@ -46,6 +44,8 @@
 extern void buffer_init(void);
 extern unsigned long inode_init(unsigned long start, unsigned long end);
 extern unsigned long file_table_init(unsigned long start, unsigned long end);
+extern unsigned long buffer_hash_init(unsigned long start, unsigned long end);
+extern unsigned long dcache_init(unsigned long start, unsigned long end);
 
 #define MAJOR(a) (int)((unsigned short)(a) >> 8)
 #define MINOR(a) (int)((unsigned short)(a) & 0xFF)
@@ -103,6 +103,8 @@ extern unsigned long file_table_init(unsigned long start, unsigned long end);
 #define BLKRRPART 4703 /* re-read partition table */
 #define BLKGETSIZE 4704 /* return device size */
 #define BLKFLSBUF 4705 /* flush buffer cache */
+#define BLKELVGET 4706 /* get I/O scheduler of the device's queue */
+#define BLKELVSET 4707 /* set it: 0 = elevator, 1 = deadline, 2 = fifo */
 
 /* These are a few other constants  only used by scsi  devices */
 
@@ -127,6 +129,12 @@ extern unsigned long file_table_init(unsigned long start, unsigned long end);
 
 typedef char buffer_block[BLOCK_SIZE];
 
+/* LRU lists a buffer can be on (b_list): see refile_buffer() */
+#define BUF_CLEAN	0
+#define BUF_LOCKED	1
+#define BUF_DIRTY	2
+#define NR_LIST		3
+
 struct buffer_head {
 	char * b_data;			/* pointer to data block (1024 bytes) */
 	unsigned long b_size;		/* block size */
@@ -137,6 +145,7 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
 	unsigned char b_req;		/* 0 if the buffer has been invalidated */
+	unsigned char b_list;		/* LRU list this buffer is on */
 	struct wait_queue * b_wait;
 	struct buffer_head * b_prev;		/* doubly linked list of hash-queue */
 	struct buffer_head * b_next;
@@ -144,6 +153,7 @@ struct buffer_head {
 	struct buffer_head * b_next_free;
 	struct buffer_head * b_this_page;	/* circular list of buffers in one page */
 	struct buffer_head * b_reqnext;		/* request queue */
+	unsigned long b_flushtime;	/* when bdflush should write it (jiffies) */
 };
 
 #include <linux/pipe_fs_i.h>
@@ -177,7 +187,11 @@ struct inode {
 	struct wait_queue * i_wait;
 	struct file_lock * i_flock;
 	struct vm_area_struct * i_mmap;
+	struct page_cache * i_pages;
+	unsigned long i_write_gen;	/* see mm/filemap.c */
+	unsigned long i_version;	/* see fs/dcache.c */
 	struct inode * i_next, * i_prev;
+	struct inode * i_lru_next, * i_lru_prev;	/* unused inodes, see inode.c */
 	struct inode * i_hash_next, * i_hash_prev;
 	struct inode * i_bound_to, * i_bound_by;
 	struct inode * i_mount;
@@ -189,6 +203,7 @@ struct inode {
 	unsigned char i_pipe;
 	unsigned char i_seek;
 	unsigned char i_update;
+	unsigned char i_list;
 	union {
 		struct pipe_inode_info pipe_i;
 		struct minix_inode_info minix_i;
@@ -211,6 +226,7 @@ struct file {
 	unsigned short f_count;
 	unsigned short f_reada;
 	struct file *f_next, *f_prev;
+	struct file *f_next_free;
 	struct inode * f_inode;
 	struct file_operations * f_op;
 };
@@ -243,6 +259,7 @@ struct super_block {
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt;
+	unsigned char s_nocache;	/* lookups bypass fs/dcache.c */
 	struct super_operations *s_op;
 	unsigned long s_flags;
 	unsigned long s_magic;
@@ -292,6 +309,7 @@ struct inode_operations {
 	int (*bmap) (struct inode *,int);
 	void (*truncate) (struct inode *);
 	int (*permission) (struct inode *, int);
+	int (*bmap_run) (struct inode *,int,int,int *);
 };
 
 struct super_operations {
@@ -348,7 +366,8 @@ extern int fs_may_umount(dev_t dev, struct inode * mount_root);
 extern int fs_may_remount_ro(dev_t dev);
 
 extern struct file *first_file;
-extern int nr_files;
+extern int nr_files, max_files;
+extern int nr_inodes, max_inodes;
 extern struct super_block super_blocks[NR_SUPER];
 
 extern int shrink_buffers(unsigned int priority);
@@ -366,6 +385,7 @@ extern void sync_dev(dev_t dev);
 extern int fsync_dev(dev_t dev);
 extern void sync_supers(dev_t dev);
 extern int bmap(struct inode * inode,int block);
+extern int bmap_run(struct inode * inode,int block,int count,int * len);
 extern int notify_change(int flags, struct inode * inode);
 extern int namei(const char * pathname, struct inode ** res_inode);
 extern int lnamei(const char * pathname, struct inode ** res_inode);
@@ -379,17 +399,34 @@ extern struct inode * iget(struct super_block * sb,int nr);
 extern struct inode * get_empty_inode(void);
 extern void insert_inode_hash(struct inode *);
 extern void clear_inode(struct inode *);
+extern unsigned long event;
+extern int dcache_lookup(struct inode * dir, const char * name, int len, unsigned long * ino);
+extern void dcache_add(struct inode * dir, const char * name, int len,
+	unsigned long ino, unsigned long version);
+extern int get_dcache_stats(char * buffer);
 extern struct inode * get_pipe_inode(void);
 extern struct file * get_empty_filp(void);
+extern void put_filp(struct file * f);
 extern struct buffer_head * get_hash_table(dev_t dev, int block, int size);
 extern struct buffer_head * getblk(dev_t dev, int block, int size);
 extern void ll_rw_block(int rw, int nr, struct buffer_head * bh[]);
 extern void ll_rw_page(int rw, int dev, int nr, char * buffer);
 extern void ll_rw_swap_file(int rw, int dev, unsigned int *b, int nb, char *buffer);
 extern void brelse(struct buffer_head * buf);
+extern void refile_buffer(struct buffer_head * buf);
+
+static inline void mark_buffer_dirty(struct buffer_head * bh)
+{
+	bh->b_dirt = 1;
+	if (bh->b_list == BUF_CLEAN)
+		refile_buffer(bh);
+}
+
 extern void set_blocksize(dev_t dev, int size);
+extern int blk_elevator_ioctl(dev_t dev, unsigned int cmd, unsigned long arg);
 extern struct buffer_head * bread(dev_t dev, int block, int size);
 extern unsigned long bread_page(unsigned long addr,dev_t dev,int b[],int size,int prot);
+extern void read_page_blocks(unsigned long addr,dev_t dev,int b[],int size);
 extern struct buffer_head * breada(dev_t dev,int block,...);
 extern void put_super(dev_t dev);
 extern dev_t ROOT_DEV;
@@ -405,6 +442,7 @@ extern int char_write(struct inode *, struct file *, char *, int);
 extern int block_write(struct inode *, struct file *, char *, int);
 
 extern int generic_mmap(struct inode *, struct file *, unsigned long, size_t, int, unsigned long);
+extern int generic_file_read(struct inode *, struct file *, char *, int);
 
 extern int block_fsync(struct inode *, struct file *);
 extern int file_fsync(struct inode *, struct file *);
@@ -23,4 +23,32 @@ struct kernel_stat {
 
 extern struct kernel_stat kstat;
 
+/*
+ * Paging statistics for /proc/vmstat. The reclaim sources are the
+ * steps of try_to_free_page() in mm/swap.c, and allocation failures
+ * are counted by GFP priority (GFP_BUFFER .. GFP_KERNEL).
+ */
+#define VM_BUFFERS	0
+#define VM_PAGE_CACHE	1
+#define VM_SHM		2
+#define VM_SWAP_OUT	3
+#define VM_NR_SOURCES	4
+
+#define VM_NR_GFP	4
+
+struct vm_stat {
+	unsigned int reclaim_tries[VM_NR_SOURCES];
+	unsigned int reclaim_freed[VM_NR_SOURCES];
+	unsigned int reclaim_rounds;	/* try_to_free_page() calls */
+	unsigned int reclaim_failed;	/* ... that found nothing */
+	unsigned int reclaim_jiffies;
+	unsigned int buffers_scanned;	/* by shrink_buffers() */
+	unsigned int pages_scanned;	/* clock steps in swap_out() */
+	unsigned int alloc_slow;	/* __get_free_pages() passes that reclaim */
+	unsigned int alloc_failed[VM_NR_GFP];
+	unsigned int dma_migrated;
+};
+
+extern struct vm_stat vmstat;
+
 #endif /* _LINUX_KERNEL_STAT_H */
@@ -27,4 +27,21 @@ void kfree_s(void * obj, int size);
 
 #endif
 
+/*
+ * Object caches for frequently allocated fixed-size structures (mm/slab.c).
+ */
+struct kmem_cache;
+
+struct kmem_cache * kmem_cache_create(const char * name, int size, int align,
+	void (*ctor)(void *));
+int kmem_cache_destroy(struct kmem_cache * cachep);
+void * kmem_cache_alloc(struct kmem_cache * cachep, int priority);
+void kmem_cache_free(struct kmem_cache * cachep, void * obj);
+void kmem_cache_init(void);
+
+int get_kmalloc_stats(char * buffer);
+int get_slabinfo(char * buffer);
+
+extern struct kmem_cache * vm_area_cachep;
+
 #endif /* _LINUX_MALLOC_H */
@@ -47,6 +47,9 @@ struct vm_area_struct {
 	struct inode * vm_inode;
 	unsigned long vm_offset;
 	struct vm_operations_struct * vm_ops;
+	short vm_avl_height;			/* AVL tree of the task's areas, */
+	struct vm_area_struct * vm_avl_left;	/* sorted by vm_end */
+	struct vm_area_struct * vm_avl_right;
 };
 
 /*
@@ -67,28 +70,40 @@ struct vm_operations_struct {
 
 extern unsigned long __bad_page(void);
 extern unsigned long __bad_pagetable(void);
-extern unsigned long __zero_page(void);
+extern char empty_zero_page[];
 
 #define BAD_PAGETABLE __bad_pagetable()
 #define BAD_PAGE __bad_page()
-#define ZERO_PAGE __zero_page()
+#define ZERO_PAGE ((unsigned long) empty_zero_page)
 
 extern volatile short free_page_ptr; /* used by malloc and tcp/ip. */
 
 extern int nr_swap_pages;
 extern int nr_free_pages;
-extern unsigned long free_page_list;
-extern int nr_secondary_pages;
-extern unsigned long secondary_page_list;
 
+/*
+ * Free pages are kept in buddy lists of 2^order page blocks, for
+ * order 0 .. NR_MEM_LISTS-1. The last MAX_SECONDARY_PAGES free pages
+ * are held back for GFP_ATOMIC and for allocations that have failed to
+ * reclaim anything. The top order is a 4MB-aligned 4MB block, which is
+ * what a large page needs.
+ */
+#define NR_MEM_LISTS 11
 #define MAX_SECONDARY_PAGES 20
 
+extern unsigned long free_area_init(unsigned long start_mem, unsigned long end_mem);
+extern void free_area_counts(unsigned long * counts);
+extern unsigned long __get_free_pages(int priority, unsigned long order);
+extern void free_pages(unsigned long addr, unsigned long order);
+
+#define __get_free_page(priority) __get_free_pages((priority),0)
+#define __get_dma_pages(priority, order) __get_free_pages((priority) | GFP_DMA,(order))
+
 /*
  * This is timing-critical - most of the time in getting a new page
  * goes to clearing the page. If you want a page without the clearing
  * overhead, just use __get_free_page() directly..
  */
-extern unsigned long __get_free_page(int priority);
 static inline unsigned long get_free_page(int priority)
 {
 	unsigned long page;
@@ -101,15 +116,27 @@ static inline unsigned long get_free_page(int priority)
 	return page;
 }
 
+/* filemap.c */
+
+extern int page_cache_size;
+extern unsigned long page_cache_hits, page_cache_misses;
+extern unsigned long find_page(struct inode * inode, unsigned long offset);
+extern unsigned long read_cached_page(struct inode * inode, unsigned long offset);
+extern void invalidate_inode_pages(struct inode * inode);
+extern void file_pages_written(struct inode * inode);
+extern int shrink_page_cache(int priority);
+extern void page_cache_init(void);
+
 /* memory.c */
 
-extern void free_page(unsigned long addr);
+#define free_page(addr) free_pages((addr),0)
 extern unsigned long put_dirty_page(struct task_struct * tsk,unsigned long page,
 	unsigned long address);
 extern void free_page_tables(struct task_struct * tsk);
 extern void clear_page_tables(struct task_struct * tsk);
 extern int copy_page_tables(struct task_struct * to);
 extern int clone_page_tables(struct task_struct * to);
+extern unsigned long unshare_page_table(struct task_struct * tsk, unsigned long * pde);
 extern int unmap_page_range(unsigned long from, unsigned long size);
 extern int remap_page_range(unsigned long from, unsigned long to, unsigned long size, int mask);
 extern int zeromap_page_range(unsigned long from, unsigned long size, int mask);
@@ -136,7 +163,10 @@ extern int vread(char *buf, char *addr, int count);
 
 extern void swap_free(unsigned long page_nr);
 extern unsigned long swap_duplicate(unsigned long page_nr);
-extern void swap_in(unsigned long *table_ptr);
+extern void swap_in(unsigned long *table_ptr, int write_access);
+extern void delete_from_swap_cache(unsigned long page);
+extern void swap_add_rmap(unsigned long entry, unsigned long * ptep);
+extern void swap_remove_rmap(unsigned long entry, unsigned long * ptep);
 extern void si_swapinfo(struct sysinfo * val);
 extern void rw_swap_page(int rw, unsigned long nr, char * buf);
 
@@ -145,8 +175,13 @@ extern int do_mmap(struct file * file, unsigned long addr, unsigned long len,
 	unsigned long prot, unsigned long flags, unsigned long off);
 typedef int (*map_mergep_fnp)(const struct vm_area_struct *,
 			      const struct vm_area_struct *, void *);
-extern void merge_segments(struct vm_area_struct *, map_mergep_fnp, void *);
+extern void merge_segments(struct task_struct *, unsigned long, unsigned long,
+			   map_mergep_fnp, void *);
 extern void insert_vm_struct(struct task_struct *, struct vm_area_struct *);
+extern struct vm_area_struct * find_vma(struct task_struct *, unsigned long);
+extern struct vm_area_struct * find_vma_prev(struct task_struct *, unsigned long,
+					     struct vm_area_struct **);
+extern void build_mmap_avl(struct task_struct *);
 extern int ignoff_mergep(const struct vm_area_struct *,
 			 const struct vm_area_struct *, void *);
 extern int do_munmap(unsigned long, size_t);
@@ -166,6 +201,46 @@ extern unsigned long high_memory;
 
 extern unsigned short * mem_map;
 
+/*
+ * Reverse map, one entry per page like mem_map: the page table entries
+ * that map a user page, and for a page table, the task it belongs to.
+ * Swap slots have chains of the entries that hold them too. See rmap.c.
+ */
+struct pte_chain {
+	unsigned long * ptep;
+	struct pte_chain * next;
+};
+
+struct mem_rmap {
+	struct pte_chain * chain;
+	struct task_struct * owner;
+	unsigned long swap_entry;	/* swap cache slot holding a copy, or 0 */
+	unsigned char age;		/* for the reclaim clock in swap.c */
+};
+
+#define PAGE_AGE_START	3
+#define PAGE_AGE_ADVANCE 3
+#define PAGE_AGE_MAX	20
+
+extern struct mem_rmap * mem_rmap;
+
+/* rmap.c */
+extern int pte_chain_add(struct pte_chain ** chain, unsigned long * ptep);
+extern void pte_chain_remove(struct pte_chain ** chain, unsigned long * ptep);
+extern void page_add_rmap(unsigned long page, unsigned long * ptep);
+extern void page_remove_rmap(unsigned long page, unsigned long * ptep);
+extern int page_rmap_count(unsigned long page);
+extern int page_rmap_mapped(unsigned long page, unsigned long * ptep);
+extern void disown_page_table(unsigned long pg_table, struct task_struct * tsk);
+extern unsigned long rmap_area_init(unsigned long start_mem, unsigned long end_mem);
+extern void rmap_init(void);
+
+#define set_page_table_owner(pg_table,tsk) \
+	(mem_rmap[MAP_NR(pg_table)].owner = (tsk))
+
+#define in_swap_cache(page) \
+	((page) < high_memory && mem_rmap[MAP_NR(page)].swap_entry)
+
 #define PAGE_PRESENT	0x001
 #define PAGE_RW		0x002
 #define PAGE_USER	0x004
@@ -173,6 +248,7 @@ extern unsigned short * mem_map;
 #define PAGE_PCD	0x010	/* 486 only - not used currently */
 #define PAGE_ACCESSED	0x020
 #define PAGE_DIRTY	0x040
+#define PAGE_4M		0x080	/* directory entry maps 4MB directly (PSE) */
 #define PAGE_COW	0x200	/* implemented in software (one of the AVL bits) */
 
 #define PAGE_PRIVATE	(PAGE_PRESENT | PAGE_RW | PAGE_USER | PAGE_ACCESSED | PAGE_COW)
@@ -181,11 +257,27 @@ extern unsigned short * mem_map;
 #define PAGE_READONLY	(PAGE_PRESENT | PAGE_USER | PAGE_ACCESSED)
 #define PAGE_TABLE	(PAGE_PRESENT | PAGE_RW | PAGE_USER | PAGE_ACCESSED)
 
+/*
+ * A large page is mapped by one directory entry with PAGE_4M set, and
+ * has no page table: code that walks the tables must check for it.
+ */
+#define LARGE_PAGE_SHIFT	22
+#define LARGE_PAGE_SIZE		(1UL << LARGE_PAGE_SHIFT)
+#define LARGE_PAGE_MASK		(~(LARGE_PAGE_SIZE-1))
+#define LARGE_PAGE_ORDER	(LARGE_PAGE_SHIFT - PAGE_SHIFT)
+
+/* the page table entry that a large page directory entry stands for at addr */
+#define LARGE_PTE(pde,addr) \
+	(((pde) & ~PAGE_4M) + ((addr) & ~LARGE_PAGE_MASK & PAGE_MASK))
+
 #define GFP_BUFFER	0x00
 #define GFP_ATOMIC	0x01
 #define GFP_USER	0x02
 #define GFP_KERNEL	0x03
 
+/* or'ed into the above for memory an ISA device can DMA to (below 16MB) */
+#define GFP_DMA		0x80
+
 
 /* vm_ops not present page codes */
 #define SHM_SWP_TYPE 0x41        
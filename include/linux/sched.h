@@ -1,8 +1,6 @@
 #ifndef _LINUX_SCHED_H
 #define _LINUX_SCHED_H
 
-#define NEW_SWAP
-
 /*
  * define DEBUG if you want the wait-queues to have some extra
  * debugging code. It's not normally used, but might catch some
@@ -18,8 +16,12 @@
  */
 extern int hard_math;
 extern int x86;
+extern int x86_capability;
 extern int ignore_irq13;
 extern int wp_works_ok;
+extern int pse_works_ok;
+
+#define X86_FEATURE_PSE	0x00000008	/* 4MB pages */
 
 /*
  * Bus types (default is ISA, but people can check others with these..)
@@ -66,6 +68,13 @@ extern unsigned long avenrun[];		/* Load averages */
 	load += n*(FIXED_1-exp); \
 	load >>= FSHIFT;
 
+/*
+ * One run-queue per counter value. The counter of a task never gets
+ * above 2*priority (70 at nice -20), so 128 queues are plenty: anything
+ * larger just ends up on the last one.
+ */
+#define NR_RUN_QUEUES	128
+
 #define CT_TO_SECS(x)	((x) / HZ)
 #define CT_TO_USECS(x)	(((x) % HZ) * 1000000/HZ)
 
@@ -81,6 +90,7 @@ extern unsigned long avenrun[];		/* Load averages */
 #include <linux/resource.h>
 #include <linux/vm86.h>
 #include <linux/math_emu.h>
+#include <linux/timer.h>
 
 #define TASK_RUNNING		0
 #define TASK_INTERRUPTIBLE	1
@@ -220,7 +230,9 @@ struct task_struct {
 	struct inode * pwd;
 	struct inode * root;
 	struct inode * executable;
-	struct vm_area_struct * mmap;
+	struct vm_area_struct * mmap;		/* list of areas, sorted by address */
+	struct vm_area_struct * mmap_avl;	/* the same areas as a tree */
+	struct vm_area_struct * mmap_cache;	/* last find_vma() result */
 	struct shm_desc *shm;
 	struct sem_undo *semun;
 	struct file * filp[NR_OPEN];
@@ -229,14 +241,13 @@ struct task_struct {
 	struct desc_struct *ldt;
 /* tss for this task */
 	struct tss_struct tss;
-#ifdef NEW_SWAP
-	unsigned long old_maj_flt;	/* old value of maj_flt */
-	unsigned long dec_flt;		/* page fault count of the last time */
-	unsigned long swap_cnt;		/* number of pages to swap on next pass */
-	short swap_table;		/* current page table */
-	short swap_page;		/* current page */
-#endif /* NEW_SWAP */
 	struct vm_area_struct *stk_vma;
+/* run-queue links: next_run is NULL when the task isn't queued */
+	struct task_struct *next_run, *prev_run;
+	int run_level;			/* run_queue[] index we are on */
+	unsigned long sched_epoch;	/* last counter recalculation seen */
+	struct timer_list real_timer;	/* ITIMER_REAL */
+	unsigned long reclaim_time;	/* jiffies spent freeing memory */
 };
 
 /*
@@ -246,6 +257,7 @@ struct task_struct {
 					/* Not implemented yet, only for 486*/
 #define PF_PTRACED	0x00000010	/* set if ptrace (0) has been called. */
 #define PF_TRACESYS	0x00000020	/* tracing system calls */
+#define PF_VFORK	0x00000040	/* parent waits in vfork() for exec or exit */
 
 /*
  * cloning flags:
@@ -279,7 +291,7 @@ struct task_struct {
 /* rss */	2, \
 /* comm */	"swapper", \
 /* vm86_info */	NULL, 0, \
-/* fs info */	0,-1,0022,NULL,NULL,NULL,NULL, \
+/* fs info */	0,-1,0022,NULL,NULL,NULL,NULL,NULL,NULL, \
 /* ipc */	NULL, NULL, \
 /* filp */	{NULL,}, \
 /* cloe */	{{ 0, }}, \
@@ -303,10 +315,10 @@ extern struct task_struct *task[NR_TASKS];
 extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
 extern unsigned long volatile jiffies;
-extern unsigned long itimer_ticks;
-extern unsigned long itimer_next;
 extern volatile struct timeval xtime;
 extern int need_resched;
+extern int nr_running;
+extern unsigned long sched_epoch;
 
 #define CURRENT_TIME (xtime.tv_sec)
 
@@ -314,10 +326,13 @@ extern void sleep_on(struct wait_queue ** p);
 extern void interruptible_sleep_on(struct wait_queue ** p);
 extern void wake_up(struct wait_queue ** p);
 extern void wake_up_interruptible(struct wait_queue ** p);
+extern void wake_up_process(struct task_struct * p);
+extern void release_vfork_parent(struct task_struct * p);
 
 extern void notify_parent(struct task_struct * tsk);
 extern int send_sig(unsigned long sig,struct task_struct * p,int priv);
 extern int in_group_p(gid_t grp);
+extern void it_real_fn(unsigned long);
 
 extern int request_irq(unsigned int irq,void (*handler)(int));
 extern void free_irq(unsigned int irq);
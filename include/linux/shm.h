@@ -17,6 +17,9 @@ struct shmid_ds {
 	struct shm_desc *attaches;    /* descriptors for attaches */
 };
 
+/* flag for shmget */
+#define SHM_LARGEPAGE	04000	/* back with 4MB pages, needs a CPU with PSE */
+
 /* mode for attach */
 #define	SHM_RDONLY	010000	/* read-only access */
 #define	SHM_RND		020000	/* round attach address to SHMLBA boundary */
@@ -64,6 +67,7 @@ struct	shminfo {
 #define SHM_READ_ONLY	(1<<(BITS_PER_PTR-1))
 
 #define SHMMAX 0x3fa000				/* max shared seg size (bytes) */
+#define SHMMAX_LARGE 0x2000000			/* same for SHM_LARGEPAGE segs */
 #define SHMMIN 1	 /* really PAGE_SIZE */	/* min shared seg size (bytes) */
 #define SHMMNI (1<<_SHM_ID_BITS)		/* max num of segs system wide */
 #define SHMALL (1<<(_SHM_IDX_BITS+_SHM_ID_BITS))/* max shm system wide (pages) */
@@ -75,6 +79,7 @@ struct	shminfo {
 /* shm_mode upper byte flags */
 #define	SHM_DEST	01000	/* segment will be destroyed on last detach */
 #define SHM_LOCKED      02000   /* segment will not be swapped */
+#define SHM_LARGE	04000	/* segment is made of 4MB pages */
 
 /* ipcs ctl commands */
 #define SHM_STAT 	13
@@ -5,6 +5,7 @@
  */
 
 #define sys_clone sys_fork
+#define sys_vfork sys_fork
 
 #ifdef __cplusplus
 extern "C" {
@@ -144,7 +145,8 @@ extern int sys_get_kernel_syms(); /* 130 */
 extern int sys_quotactl();
 extern int sys_getpgid();
 extern int sys_fchdir();
-extern int sys_bdflush();
+extern int sys_bdflush();        /* 134 */
+extern int sys_vfork();
 
 /*
  * These are system calls that will be removed at some time
@@ -168,7 +170,6 @@ extern int sys_bdflush();
  */
 
 #define sys_quotactl	sys_ni_syscall
-#define sys_bdflush	sys_ni_syscall
 
 typedef int (*fn_ptr)();
 
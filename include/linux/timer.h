@@ -1,6 +1,8 @@
 #ifndef _LINUX_TIMER_H
 #define _LINUX_TIMER_H
 
+#include <linux/stddef.h>
+
 /*
  * DON'T CHANGE THESE!! Most of them are hardcoded into some assembly language
  * as well as being defined here.
@@ -84,4 +86,15 @@ struct timer_list {
 extern void add_timer(struct timer_list * timer);
 extern int  del_timer(struct timer_list * timer);
 
+/*
+ * A timer that is pending has a non-NULL prev pointer, so timers that
+ * don't live in static (zeroed) storage need this before del_timer()
+ * can be used on them.
+ */
+static inline void init_timer(struct timer_list * timer)
+{
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
 #endif
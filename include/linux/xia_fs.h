@@ -86,6 +86,7 @@ extern void xiafs_free_zone(struct super_block * sb, int block);
 extern unsigned long xiafs_count_free_zones(struct super_block *sb);
 
 extern int xiafs_bmap(struct inode *,int);
+extern int xiafs_bmap_run(struct inode *,int,int,int *);
 
 extern struct buffer_head * xiafs_getblk(struct inode *, int, int);
 extern struct buffer_head * xiafs_bread(struct inode *, int, int);
@@ -57,6 +57,7 @@ static inline _syscall3(int,open,const char *,file,int,flag,int,mode);
 static inline _syscall1(int,close,int,fd);
 static inline _syscall1(int,_exit,int,exitcode);
 static inline _syscall3(pid_t,waitpid,pid_t,pid,int *,wait_stat,int,options);
+static inline _syscall2(int,bdflush,int,func,int,data);
 
 static inline pid_t wait(int * wait_stat)
 {
@@ -75,6 +76,7 @@ extern long kmalloc_init (long,long);
 extern long blk_dev_init(long,long);
 extern long chr_dev_init(long,long);
 extern void floppy_init(void);
+extern void kmem_cache_init(void);
 extern void sock_init(void);
 extern long rd_init(long mem_start, int length);
 unsigned long net_dev_init(unsigned long, unsigned long);
@@ -91,6 +93,8 @@ extern void t128_setup(char *str, int *ints);
 extern void generic_NCR5380_setup(char *str, int *intr);
 extern void aha152x_setup(char *str, int *ints);
 extern void sound_setup(char *str, int *ints);
+extern void inodes_setup(char *str, int *ints);
+extern void files_setup(char *str, int *ints);
 #ifdef CONFIG_SBPCD
 extern void sbpcd_setup(char *str, int *ints);
 #endif /* CONFIG_SBPCD */
@@ -170,6 +174,8 @@ struct {
 	void (*setup_func)(char *, int *);
 } bootsetups[] = {
 	{ "reserve=", reserve_setup },
+	{ "inodes=", inodes_setup },
+	{ "files=", files_setup },
 #ifdef CONFIG_INET
 	{ "ether=", eth_setup },
 #endif
@@ -403,8 +409,13 @@ asmlinkage void start_kernel(void)
 #endif
 	memory_start = inode_init(memory_start,memory_end);
 	memory_start = file_table_init(memory_start,memory_end);
+	memory_start = buffer_hash_init(memory_start,memory_end);
+	memory_start = dcache_init(memory_start,memory_end);
 	mem_init(low_memory_start,memory_start,memory_end);
 	buffer_init();
+	kmem_cache_init();
+	page_cache_init();
+	rmap_init();
 	time_init();
 	floppy_init();
 	sock_init();
@@ -482,6 +493,8 @@ void init(void)
 	int pid,i;
 
 	setup((void *) &drive_info);
+	if (!fork())		/* the dirty buffer flush daemon */
+		_exit(bdflush(0,0));
 	sprintf(term, "TERM=con%dx%d", ORIG_VIDEO_COLS, ORIG_VIDEO_LINES);
 	(void) open("/dev/tty1",O_RDWR,0);
 	(void) dup(0);
@@ -12,12 +12,15 @@
 #include <linux/shm.h>
 #include <linux/stat.h>
 #include <linux/malloc.h>
+#include <linux/mm.h>
+#include <linux/string.h>
 
 extern int ipcperms (struct ipc_perm *ipcp, short semflg);
 extern unsigned int get_swap_page(void);
 static int findkey (key_t key);
 static int newseg (key_t key, int shmflg, int size);
 static int shm_map (struct shm_desc *shmd, int remap);
+static int shm_map_large (struct shm_desc *shmd, struct shmid_ds *shp);
 static void killseg (int id);
 
 static int shm_tot = 0;  /* total number of shared memory pages */
@@ -61,6 +64,32 @@ static int findkey (key_t key)
 	return -1;
 }
 
+/*
+ * A SHM_LARGEPAGE segment gets all its memory up front, as 4MB buddy
+ * blocks: each is physically contiguous and 4MB aligned, so an attach
+ * can map it with a single directory entry. The pages are never
+ * swapped, and are freed as whole blocks in killseg().
+ */
+static int shm_alloc_large (ulong *pages, int numpages)
+{
+	unsigned long page;
+	int i, j;
+
+	for (i = 0; i < numpages; i += PTRS_PER_PAGE) {
+		page = __get_free_pages(GFP_KERNEL, LARGE_PAGE_ORDER);
+		if (!page) {
+			while ((i -= PTRS_PER_PAGE) >= 0)
+				free_pages(pages[i] & PAGE_MASK, LARGE_PAGE_ORDER);
+			return -ENOMEM;
+		}
+		memset((void *) page, 0, LARGE_PAGE_SIZE);
+		for (j = 0; j < PTRS_PER_PAGE; j++)
+			pages[i+j] = (page + j*PAGE_SIZE) | (PAGE_SHARED | PAGE_DIRTY);
+	}
+	shm_rss += numpages;
+	return 0;
+}
+
 /* 
  * allocate new shmid_ds and pgtable. protected by shm_segs[id] = NOID.
  */
@@ -72,6 +101,11 @@ static int newseg (key_t key, int shmflg, int size)
 
 	if (size < SHMMIN)
 		return -EINVAL;
+	if (shmflg & SHM_LARGEPAGE) {
+		if (!pse_works_ok)
+			return -EINVAL;
+		numpages = (numpages + PTRS_PER_PAGE - 1) & ~(PTRS_PER_PAGE - 1);
+	}
 	if (shm_tot + numpages >= SHMALL)
 		return -ENOSPC;
 	for (id=0; id < SHMMNI; id++)
@@ -100,9 +134,19 @@ found:
 	}
 
 	for (i=0; i< numpages; shp->shm_pages[i++] = 0);
+	if ((shmflg & SHM_LARGEPAGE) && shm_alloc_large (shp->shm_pages, numpages)) {
+		shm_segs[id] = (struct shmid_ds *) IPC_UNUSED;
+		if (shm_lock)
+			wake_up (&shm_lock);
+		kfree_s (shp->shm_pages, numpages * sizeof (ulong));
+		kfree_s (shp, sizeof (*shp));
+		return -ENOMEM;
+	}
 	shm_tot += numpages;
 	shp->shm_perm.key = key;
 	shp->shm_perm.mode = (shmflg & S_IRWXUGO);
+	if (shmflg & SHM_LARGEPAGE)
+		shp->shm_perm.mode |= SHM_LARGE | SHM_LOCKED;
 	shp->shm_perm.cuid = shp->shm_perm.uid = current->euid;
 	shp->shm_perm.cgid = shp->shm_perm.gid = current->egid;
 	shp->shm_perm.seq = shm_seq;
@@ -128,7 +172,7 @@ int sys_shmget (key_t key, int size, int shmflg)
 	struct shmid_ds *shp;
 	int id = 0;
 	
-	if (size < 0 || size > SHMMAX)
+	if (size < 0 || size > (shmflg & SHM_LARGEPAGE ? SHMMAX_LARGE : SHMMAX))
 		return -EINVAL;
 	if (key == IPC_PRIVATE) 
 		return newseg(key, shmflg, size);
@@ -175,7 +219,11 @@ static void killseg (int id)
 		printk ("shm nono: killseg shp->pages=NULL. id=%d\n", id);
 		return;
 	}
-	for (i=0; i< numpages ; i++) {
+	if (shp->shm_perm.mode & SHM_LARGE) {
+		for (i=0; i< numpages ; i += PTRS_PER_PAGE)
+			free_pages (shp->shm_pages[i] & PAGE_MASK, LARGE_PAGE_ORDER);
+		shm_rss -= numpages;
+	} else for (i=0; i< numpages ; i++) {
 		if (!(page = shp->shm_pages[i]))
 			continue;
 		if (page & 1) {
@@ -272,7 +320,7 @@ int sys_shmctl (int shmid, int cmd, struct shmid_ds *buf)
 	case SHM_UNLOCK:
 		if (!suser())
 			return -EPERM;
-		if (!(ipcp->mode & SHM_LOCKED))
+		if (!(ipcp->mode & SHM_LOCKED) || (ipcp->mode & SHM_LARGE))
 			return -EINVAL;
 		ipcp->mode &= ~SHM_LOCKED;
 		break;
@@ -338,6 +386,7 @@ static int shm_map (struct shm_desc *shmd, int remap)
 	for (tmp = shmd->start; tmp < shmd->end; tmp += PAGE_SIZE) { 
 		page_table = PAGE_DIR_OFFSET(page_dir,tmp);
 		if (*page_table & PAGE_PRESENT) {
+			unshare_page_table(shmd->task, page_table);
 			page_table = (ulong *) (PAGE_MASK & *page_table);
 			page_table += ((tmp >> PAGE_SHIFT) & (PTRS_PER_PAGE-1));
 			if (*page_table) {
@@ -345,10 +394,13 @@ static int shm_map (struct shm_desc *shmd, int remap)
 					return -EINVAL;
 				if (*page_table & PAGE_PRESENT) {
 					--current->rss;
+					page_remove_rmap(*page_table, page_table);
 					free_page (*page_table & PAGE_MASK);
 				}
-				else
+				else {
+					swap_remove_rmap(*page_table, page_table);
 					swap_free (*page_table);
+				}
 				invalid++;
 			}
 			continue;
@@ -357,6 +409,7 @@ static int shm_map (struct shm_desc *shmd, int remap)
 		unsigned long new_pt;
 		if(!(new_pt = get_free_page(GFP_KERNEL)))	/* clearing needed?  SRB. */
 			return -ENOMEM;
+		set_page_table_owner(new_pt, shmd->task);
 		*page_table = new_pt | PAGE_TABLE;
 		tmp |= ((PAGE_SIZE << 10) - PAGE_SIZE);
 	}}
@@ -375,6 +428,26 @@ static int shm_map (struct shm_desc *shmd, int remap)
 	return 0;
 }
 
+/*
+ * Map a large-page segment with one directory entry per 4MB. There are
+ * no page tables to take over, so the range must have none.
+ */
+static int shm_map_large (struct shm_desc *shmd, struct shmid_ds *shp)
+{
+	unsigned long page_dir = shmd->task->tss.cr3;
+	unsigned long tmp, prot;
+	int idx;
+
+	for (tmp = shmd->start; tmp < shmd->end; tmp += LARGE_PAGE_SIZE)
+		if (*PAGE_DIR_OFFSET(page_dir,tmp))
+			return -EINVAL;
+	prot = PAGE_4M | (shmd->shm_sgn & SHM_READ_ONLY ? PAGE_READONLY : PAGE_SHARED);
+	for (tmp = shmd->start, idx = 0; tmp < shmd->end;
+	     tmp += LARGE_PAGE_SIZE, idx += PTRS_PER_PAGE)
+		*PAGE_DIR_OFFSET(page_dir,tmp) = (shp->shm_pages[idx] & PAGE_MASK) | prot;
+	return 0;
+}
+
 /* 
  * Fix shmaddr, allocate descriptor, map shm, add attach descriptor to lists.
  * raddr is needed to return addresses above 2Gig.
@@ -413,12 +486,20 @@ int sys_shmat (int shmid, char *shmaddr, int shmflg, ulong *raddr)
 				addr = shmd->start;
 		}
 		addr = (addr - shp->shm_segsz) & PAGE_MASK;
+		if (shp->shm_perm.mode & SHM_LARGE)
+			addr &= LARGE_PAGE_MASK;
 	} else if (addr & (SHMLBA-1)) {
 		if (shmflg & SHM_RND) 
 			addr &= ~(SHMLBA-1);       /* round down */
 		else
 			return -EINVAL;
 	}
+	if ((shp->shm_perm.mode & SHM_LARGE) && (addr & ~LARGE_PAGE_MASK)) {
+		if (shmflg & SHM_RND)
+			addr &= LARGE_PAGE_MASK;
+		else
+			return -EINVAL;
+	}
 	if ((addr > current->start_stack - 16384 - PAGE_SIZE*shp->shm_npages))
 		return -EINVAL;
 	if (shmflg & SHM_REMAP)
@@ -455,7 +536,11 @@ int sys_shmat (int shmid, char *shmaddr, int shmflg, ulong *raddr)
 /*		current->end_data = current->end_code = 0; */
 	}
 
-	if ((err = shm_map (shmd, shmflg & SHM_REMAP))) {
+	if (shp->shm_perm.mode & SHM_LARGE)
+		err = shm_map_large (shmd, shp);
+	else
+		err = shm_map (shmd, shmflg & SHM_REMAP);
+	if (err) {
 		if (--shp->shm_nattch <= 0 && shp->shm_perm.mode & SHM_DEST)
 			killseg(id);
 		kfree_s (shmd, sizeof (*shmd));
@@ -54,7 +54,7 @@ int send_sig(unsigned long sig,struct task_struct * p,int priv)
 		return 0;
 	if ((sig == SIGKILL) || (sig == SIGCONT)) {
 		if (p->state == TASK_STOPPED)
-			p->state = TASK_RUNNING;
+			wake_up_process(p);
 		p->exit_code = 0;
 		p->signal &= ~( (1<<(SIGSTOP-1)) | (1<<(SIGTSTP-1)) |
 				(1<<(SIGTTIN-1)) | (1<<(SIGTTOU-1)) );
@@ -64,6 +64,8 @@ int send_sig(unsigned long sig,struct task_struct * p,int priv)
 		p->signal &= ~(1<<(SIGCONT-1));
 	/* Actually generate the signal */
 	generate(sig,p);
+	if (p->state == TASK_INTERRUPTIBLE && (p->signal & ~p->blocked))
+		wake_up_process(p);
 	return 0;
 }
 
@@ -354,11 +356,14 @@ NORET_TYPE void do_exit(long code)
 	int i;
 
 fake_volatile:
+	current->it_real_value = current->it_real_incr = 0;
+	del_timer(&current->real_timer);
 	if (current->semun)
 		sem_exit();
 	if (current->shm)
 		shm_exit();
 	free_page_tables(current);
+	release_vfork_parent(current);
 	for (i=0 ; i<NR_OPEN ; i++)
 		if (current->filp[i])
 			sys_close(i);
@@ -375,11 +380,13 @@ fake_volatile:
 		struct vm_area_struct * mpnt, *mpnt1;
 		mpnt = current->mmap;
 		current->mmap = NULL;
+		current->mmap_avl = NULL;
+		current->mmap_cache = NULL;
 		while (mpnt) {
 			mpnt1 = mpnt->vm_next;
 			if (mpnt->vm_ops && mpnt->vm_ops->close)
 				mpnt->vm_ops->close(mpnt);
-			kfree(mpnt);
+			kmem_cache_free(vm_area_cachep, mpnt);
 			mpnt = mpnt1;
 		}
 	}
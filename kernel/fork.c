@@ -72,10 +72,15 @@ repeat:
 static struct file * copy_fd(struct file * old_file)
 {
 	struct file * new_file = get_empty_filp();
+	struct file * next, * prev;
 	int error;
 
 	if (new_file) {
+		next = new_file->f_next;	/* keep its place in the file table */
+		prev = new_file->f_prev;
 		memcpy(new_file,old_file,sizeof(struct file));
+		new_file->f_next = next;
+		new_file->f_prev = prev;
 		new_file->f_count = 1;
 		if (new_file->f_inode)
 			new_file->f_inode->i_count++;
@@ -83,7 +88,7 @@ static struct file * copy_fd(struct file * old_file)
 			error = new_file->f_op->open(new_file->f_inode,new_file);
 			if (error) {
 				iput(new_file->f_inode);
-				new_file->f_count = 0;
+				put_filp(new_file);
 				new_file = NULL;
 			}
 		}
@@ -99,9 +104,11 @@ int dup_mmap(struct task_struct * tsk)
 	tsk->stk_vma = NULL;
 	p = &tsk->mmap;
 	for (mpnt = current->mmap ; mpnt ; mpnt = mpnt->vm_next) {
-		tmp = (struct vm_area_struct *) kmalloc(sizeof(struct vm_area_struct), GFP_KERNEL);
-		if (!tmp)
+		tmp = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
+		if (!tmp) {
+			build_mmap_avl(tsk);
 			return -ENOMEM;
+		}
 		*tmp = *mpnt;
 		tmp->vm_task = tsk;
 		tmp->vm_next = NULL;
@@ -112,10 +119,24 @@ int dup_mmap(struct task_struct * tsk)
 		if (current->stk_vma == mpnt)
 			tsk->stk_vma = tmp;
 	}
+	build_mmap_avl(tsk);
 	return 0;
 }
 
+/*
+ * Let the parent of a vfork() child go on, once the child has an
+ * address space of its own or is gone.
+ */
+void release_vfork_parent(struct task_struct * p)
+{
+	if (p->flags & PF_VFORK) {
+		p->flags &= ~PF_VFORK;
+		wake_up(&p->p_opptr->wait_chldexit);
+	}
+}
+
 #define IS_CLONE (regs.orig_eax == __NR_clone)
+#define IS_VFORK (regs.orig_eax == __NR_vfork)
 #define copy_vm(p) ((clone_flags & COPYVM)?copy_page_tables(p):clone_page_tables(p))
 
 /*
@@ -141,7 +162,8 @@ asmlinkage int sys_fork(struct pt_regs regs)
 	p->did_exec = 0;
 	p->kernel_stack_page = 0;
 	p->state = TASK_UNINTERRUPTIBLE;
-	p->flags &= ~(PF_PTRACED|PF_TRACESYS);
+	p->next_run = p->prev_run = NULL;
+	p->flags &= ~(PF_PTRACED|PF_TRACESYS|PF_VFORK);
 	p->pid = last_pid;
 	p->swappable = 1;
 	p->p_pptr = p->p_opptr = current;
@@ -150,11 +172,15 @@ asmlinkage int sys_fork(struct pt_regs regs)
 	p->signal = 0;
 	p->it_real_value = p->it_virt_value = p->it_prof_value = 0;
 	p->it_real_incr = p->it_virt_incr = p->it_prof_incr = 0;
+	init_timer(&p->real_timer);
+	p->real_timer.data = (unsigned long) p;
+	p->real_timer.function = it_real_fn;
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;
 	p->min_flt = p->maj_flt = 0;
 	p->cmin_flt = p->cmaj_flt = 0;
+	p->reclaim_time = 0;
 	p->start_time = jiffies;
 /*
  * set up new TSS and kernel stack
@@ -184,6 +210,11 @@ asmlinkage int sys_fork(struct pt_regs regs)
 		if (childregs->esp == regs.esp)
 			clone_flags |= COPYVM;
 	}
+	if (IS_VFORK) {
+		/* share the page directory until the child execs or exits */
+		clone_flags = SIGCHLD;
+		p->flags |= PF_VFORK;
+	}
 	p->exit_signal = clone_flags & CSIGNAL;
 	p->tss.ldt = _LDT(nr);
 	if (p->ldt) {
@@ -222,8 +253,12 @@ asmlinkage int sys_fork(struct pt_regs regs)
 		set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&default_ldt, 1);
 
 	p->counter = current->counter >> 1;
-	p->state = TASK_RUNNING;	/* do this last, just in case */
-	return p->pid;
+	p->sched_epoch = sched_epoch;
+	wake_up_process(p);	/* do this last, just in case */
+	i = p->pid;
+	while (task[nr] == p && (p->flags & PF_VFORK))
+		sleep_on(&current->wait_chldexit);
+	return i;
 bad_fork_cleanup:
 	task[nr] = NULL;
 	REMOVE_LINKS(p);
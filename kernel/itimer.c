@@ -28,13 +28,34 @@ static void jiffiestotv(unsigned long jiffies, struct timeval *value)
 	return;
 }
 
+/*
+ * ITIMER_REAL is a timer_list of its own, so nothing has to look at it
+ * until it actually goes off. it_real_value holds the jiffy it expires
+ * at (0 when it's not running) rather than the ticks left.
+ */
+void it_real_fn(unsigned long __data)
+{
+	struct task_struct * p = (struct task_struct *) __data;
+
+	send_sig(SIGALRM, p, 1);
+	if (p->it_real_incr) {
+		p->it_real_value = jiffies + p->it_real_incr;
+		p->real_timer.expires = p->it_real_incr;
+		add_timer(&p->real_timer);
+	} else
+		p->it_real_value = 0;
+}
+
 int _getitimer(int which, struct itimerval *value)
 {
 	register unsigned long val, interval;
 
 	switch (which) {
 	case ITIMER_REAL:
-		val = current->it_real_value;
+		val = 0;
+		if (current->it_real_value &&
+		    (long) (current->it_real_value - jiffies) > 0)
+			val = current->it_real_value - jiffies;
 		interval = current->it_real_incr;
 		break;
 	case ITIMER_VIRTUAL:
@@ -81,13 +102,15 @@ int _setitimer(int which, struct itimerval *value, struct itimerval *ovalue)
 		return k;
 	switch (which) {
 		case ITIMER_REAL:
+			del_timer(&current->real_timer);
+			current->it_real_value = 0;
+			current->it_real_incr = i;
 			if (j) {
-				j += 1+itimer_ticks;
-				if (j < itimer_next)
-					itimer_next = j;
+				j++;
+				current->it_real_value = jiffies + j;
+				current->real_timer.expires = j;
+				add_timer(&current->real_timer);
 			}
-			current->it_real_value = j;
-			current->it_real_incr = i;
 			break;
 		case ITIMER_VIRTUAL:
 			if (j)
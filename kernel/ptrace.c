@@ -93,9 +93,13 @@ static unsigned long get_long(struct task_struct * tsk,
 repeat:
 	page = *PAGE_DIR_OFFSET(tsk->tss.cr3,addr);
 	if (page & PAGE_PRESENT) {
-		page &= PAGE_MASK;
-		page += PAGE_PTR(addr);
-		page = *((unsigned long *) page);
+		if (page & PAGE_4M)
+			page = LARGE_PTE(page, addr);
+		else {
+			page &= PAGE_MASK;
+			page += PAGE_PTR(addr);
+			page = *((unsigned long *) page);
+		}
 	}
 	if (!(page & PAGE_PRESENT)) {
 		do_no_page(0,addr,tsk,0);
@@ -121,11 +125,19 @@ repeat:
 static void put_long(struct task_struct * tsk, unsigned long addr,
 	unsigned long data)
 {
-	unsigned long page, pte = 0;
+	unsigned long pgdir, page, pte = 0;
 	int readonly = 0;
 
 repeat:
-	page = *PAGE_DIR_OFFSET(tsk->tss.cr3,addr);
+	page = pgdir = *PAGE_DIR_OFFSET(tsk->tss.cr3,addr);
+	if ((pgdir & (PAGE_PRESENT | PAGE_4M)) == (PAGE_PRESENT | PAGE_4M)) {
+		/* no copy-on-write for large pages: read-only stays so */
+		if (pgdir & PAGE_RW) {
+			page = LARGE_PTE(pgdir, addr) & PAGE_MASK;
+			*(unsigned long *) (page + (addr & ~PAGE_MASK)) = data;
+		}
+		return;
+	}
 	if (page & PAGE_PRESENT) {
 		page &= PAGE_MASK;
 		page += PAGE_PTR(addr);
@@ -136,8 +148,9 @@ repeat:
 		do_no_page(0 /* PAGE_RW */ ,addr,tsk,0);
 		goto repeat;
 	}
-	if (!(page & PAGE_RW)) {
-		if(!(page & PAGE_COW))
+	/* a page table still shared after fork is read-only too */
+	if (!(page & PAGE_RW) || !(pgdir & PAGE_RW)) {
+		if(!(page & (PAGE_RW | PAGE_COW)))
 			readonly = 1;
 		do_wp_page(PAGE_RW | PAGE_PRESENT,addr,tsk,0);
 		goto repeat;
@@ -401,7 +414,7 @@ asmlinkage int sys_ptrace(long request, long pid, long addr, long data)
 			else
 				child->flags &= ~PF_TRACESYS;
 			child->exit_code = data;
-			child->state = TASK_RUNNING;
+			wake_up_process(child);
 	/* make sure the single step bit is not set. */
 			tmp = get_stack_long(child, sizeof(long)*EFL-MAGICNUMBER) & ~TRAP_FLAG;
 			put_stack_long(child, sizeof(long)*EFL-MAGICNUMBER,tmp);
@@ -416,7 +429,7 @@ asmlinkage int sys_ptrace(long request, long pid, long addr, long data)
 		case PTRACE_KILL: {
 			long tmp;
 
-			child->state = TASK_RUNNING;
+			wake_up_process(child);
 			child->exit_code = SIGKILL;
 	/* make sure the single step bit is not set. */
 			tmp = get_stack_long(child, sizeof(long)*EFL-MAGICNUMBER) & ~TRAP_FLAG;
@@ -432,7 +445,7 @@ asmlinkage int sys_ptrace(long request, long pid, long addr, long data)
 			child->flags &= ~PF_TRACESYS;
 			tmp = get_stack_long(child, sizeof(long)*EFL-MAGICNUMBER) | TRAP_FLAG;
 			put_stack_long(child, sizeof(long)*EFL-MAGICNUMBER,tmp);
-			child->state = TASK_RUNNING;
+			wake_up_process(child);
 			child->exit_code = data;
 	/* give it a chance to run. */
 			return 0;
@@ -444,7 +457,7 @@ asmlinkage int sys_ptrace(long request, long pid, long addr, long data)
 			if ((unsigned long) data > NSIG)
 				return -EIO;
 			child->flags &= ~(PF_PTRACED|PF_TRACESYS);
-			child->state = TASK_RUNNING;
+			wake_up_process(child);
 			child->exit_code = data;
 			REMOVE_LINKS(child);
 			child->p_pptr = child->p_opptr;
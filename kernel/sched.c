@@ -29,6 +29,7 @@
 #include <asm/system.h>
 #include <asm/io.h>
 #include <asm/segment.h>
+#include <asm/bitops.h>
 
 #define TIMER_IRQ 0
 
@@ -66,8 +67,10 @@ int need_resched = 0;
  */
 int hard_math = 0;		/* set by boot/head.S */
 int x86 = 0;			/* set by boot/head.S to 3 or 4 */
+int x86_capability = 0;		/* CPUID feature flags, set by boot/head.S */
 int ignore_irq13 = 0;		/* set if exception 16 works */
 int wp_works_ok = 0;		/* set if paging hardware honours WP */ 
+int pse_works_ok = 0;		/* set if 4MB pages are enabled */
 
 /*
  * Bus types ..
@@ -143,7 +146,7 @@ sys_wait4, sys_swapoff, sys_sysinfo, sys_ipc, sys_fsync, sys_sigreturn,
 sys_clone, sys_setdomainname, sys_newuname, sys_modify_ldt,
 sys_adjtimex, sys_mprotect, sys_sigprocmask, sys_create_module,
 sys_init_module, sys_delete_module, sys_get_kernel_syms, sys_quotactl,
-sys_getpgid, sys_fchdir, sys_bdflush };
+sys_getpgid, sys_fchdir, sys_bdflush, sys_vfork };
 
 /* So we don't have to do any more manual updating.... */
 int NR_syscalls = sizeof(sys_call_table)/sizeof(fn_ptr);
@@ -192,9 +195,155 @@ asmlinkage void math_emulate(long arg)
 
 #endif /* CONFIG_MATH_EMULATION */
 
-unsigned long itimer_ticks = 0;
-unsigned long itimer_next = ~0;
-static unsigned long lost_ticks = 0;
+/*
+ * The run-queues. Every runnable task (except the idle task) is on the
+ * queue for its current counter value, and run_bitmap has a bit set
+ * for every non-empty queue, so finding the best task is a bit-scan
+ * instead of a walk over all the tasks in the system.
+ *
+ * Tasks that go to sleep are not removed by whoever changes their
+ * state: schedule() removes them when it runs into them. All of this
+ * must be done with interrupts off, as wake_up() is called from them.
+ */
+#define RUN_BITMAP_SIZE (NR_RUN_QUEUES/32)
+
+static struct task_struct * run_queue[NR_RUN_QUEUES] = { NULL, };
+static unsigned long run_bitmap[RUN_BITMAP_SIZE] = { 0, };
+int nr_running = 0;
+
+/*
+ * The counters used to be recalculated for every task in the system
+ * whenever all runnable tasks had used up their time slice. Now only
+ * the runnable ones are done at that point: a sleeping task notices
+ * the epochs it has missed when it is woken up again.
+ */
+unsigned long sched_epoch = 0;
+
+static inline void add_to_runqueue(struct task_struct * p)
+{
+	int level = p->counter;
+	struct task_struct * head;
+
+	if (level < 0)
+		level = 0;
+	if (level >= NR_RUN_QUEUES)
+		level = NR_RUN_QUEUES-1;
+	p->run_level = level;
+	if ((head = run_queue[level]) != NULL) {
+		p->next_run = head;
+		p->prev_run = head->prev_run;
+		head->prev_run->next_run = p;
+		head->prev_run = p;
+	} else {
+		p->next_run = p->prev_run = p;
+		run_queue[level] = p;
+		set_bit(level, run_bitmap);
+	}
+	nr_running++;
+}
+
+static inline void del_from_runqueue(struct task_struct * p)
+{
+	int level = p->run_level;
+
+	if (p->next_run == p) {
+		run_queue[level] = NULL;
+		clear_bit(level, run_bitmap);
+	} else {
+		p->next_run->prev_run = p->prev_run;
+		p->prev_run->next_run = p->next_run;
+		if (run_queue[level] == p)
+			run_queue[level] = p->next_run;
+	}
+	p->next_run = p->prev_run = NULL;
+	nr_running--;
+}
+
+/*
+ * Highest non-empty run-queue, or -1 if there is nothing to run.
+ */
+static inline int best_run_level(void)
+{
+	int i;
+	unsigned long bit;
+
+	for (i = RUN_BITMAP_SIZE-1 ; i >= 0 ; i--) {
+		if (!run_bitmap[i])
+			continue;
+		__asm__("bsrl %1,%0":"=r" (bit):"r" (run_bitmap[i]));
+		return (i << 5) + bit;
+	}
+	return -1;
+}
+
+/*
+ * Do the recalculations a sleeping task missed. The counter converges
+ * to 2*priority within a handful of rounds, so this is cheap even if
+ * the task has slept through thousands of epochs.
+ */
+static inline void sched_catch_up(struct task_struct * p)
+{
+	unsigned long missed = sched_epoch - p->sched_epoch;
+	long counter;
+
+	p->sched_epoch = sched_epoch;
+	while (missed--) {
+		counter = (p->counter >> 1) + p->priority;
+		if (counter == p->counter)
+			break;
+		p->counter = counter;
+	}
+}
+
+/*
+ * Everybody runnable has used up his time slice: start a new epoch.
+ * All runnable tasks are on run_queue[0] at this point, so that is
+ * the only list we need to look at.
+ */
+static inline void sched_recalc(void)
+{
+	struct task_struct * p, * next;
+
+	sched_epoch++;
+	if (!(p = run_queue[0]))
+		return;
+	p->prev_run->next_run = NULL;
+	run_queue[0] = NULL;
+	clear_bit(0, run_bitmap);
+	do {
+		next = p->next_run;
+		nr_running--;
+		p->next_run = p->prev_run = NULL;
+		if (p->state == TASK_RUNNING) {
+			sched_catch_up(p);
+			add_to_runqueue(p);
+		}
+	} while ((p = next) != NULL);
+}
+
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (!p->next_run && p != &init_task) {
+		sched_catch_up(p);
+		add_to_runqueue(p);
+	}
+	restore_flags(flags);
+	if (p->counter > current->counter)
+		need_resched = 1;
+}
+
+static void process_timeout(unsigned long __data)
+{
+	struct task_struct * p = (struct task_struct *) __data;
+
+	p->timeout = 0;
+	wake_up_process(p);
+}
 
 /*
  *  'schedule()' is the scheduler function. It's a very simple and nice
@@ -204,57 +353,13 @@ static unsigned long lost_ticks = 0;
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
  * information in task[0] is never used.
- *
- * The "confuse_gcc" goto is used only to get better assembly code..
- * Djikstra probably hates me.
  */
 asmlinkage void schedule(void)
 {
-	int c;
-	struct task_struct * p;
+	int level;
 	struct task_struct * next;
-	unsigned long ticks;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
-
-	cli();
-	ticks = itimer_ticks;
-	itimer_ticks = 0;
-	itimer_next = ~0;
-	sti();
-	need_resched = 0;
-	p = &init_task;
-	for (;;) {
-		if ((p = p->next_task) == &init_task)
-			goto confuse_gcc1;
-		if (ticks && p->it_real_value) {
-			if (p->it_real_value <= ticks) {
-				send_sig(SIGALRM, p, 1);
-				if (!p->it_real_incr) {
-					p->it_real_value = 0;
-					goto end_itimer;
-				}
-				do {
-					p->it_real_value += p->it_real_incr;
-				} while (p->it_real_value <= ticks);
-			}
-			p->it_real_value -= ticks;
-			if (p->it_real_value < itimer_next)
-				itimer_next = p->it_real_value;
-		}
-end_itimer:
-		if (p->state != TASK_INTERRUPTIBLE)
-			continue;
-		if (p->signal & ~p->blocked) {
-			p->state = TASK_RUNNING;
-			continue;
-		}
-		if (p->timeout && p->timeout <= jiffies) {
-			p->timeout = 0;
-			p->state = TASK_RUNNING;
-		}
-	}
-confuse_gcc1:
+	unsigned long timeout = 0;
+	struct timer_list timer;
 
 /* this is the scheduler proper: */
 #if 0
@@ -267,22 +372,60 @@ confuse_gcc1:
 		++current->counter;
 	}
 #endif
-	c = -1;
-	next = p = &init_task;
+	cli();
+	need_resched = 0;
+	/*
+	 * Interruptible sleeps end on a signal or at current->timeout.
+	 * Signals to other tasks wake them up in send_sig(), and the
+	 * timeout gets a timer of its own for as long as we sleep.
+	 */
+	if (current->state == TASK_INTERRUPTIBLE) {
+		if (current->signal & ~current->blocked)
+			current->state = TASK_RUNNING;
+		else if ((timeout = current->timeout) != 0) {
+			if (timeout <= jiffies) {
+				current->timeout = 0;
+				current->state = TASK_RUNNING;
+			}
+			timeout -= jiffies;
+			/* a timeout too far away to matter means "forever" */
+			if ((long) timeout <= 0)
+				timeout = 0;
+		}
+	}
+	/* requeue ourselves: our counter has changed since we were queued */
+	if (current->next_run) {
+		del_from_runqueue(current);
+		if (current->state == TASK_RUNNING)
+			add_to_runqueue(current);
+	}
 	for (;;) {
-		if ((p = p->next_task) == &init_task)
-			goto confuse_gcc2;
-		if (p->state == TASK_RUNNING && p->counter > c)
-			c = p->counter, next = p;
+		if ((level = best_run_level()) < 0) {
+			next = &init_task;
+			break;
+		}
+		next = run_queue[level];
+		if (next->state != TASK_RUNNING) {
+			del_from_runqueue(next);
+			continue;
+		}
+		if (level)
+			break;
+		sched_recalc();
 	}
-confuse_gcc2:
-	if (!c) {
-		for_each_task(p)
-			p->counter = (p->counter >> 1) + p->priority;
+	sti();
+	if (timeout) {
+		init_timer(&timer);
+		timer.expires = timeout;
+		timer.data = (unsigned long) current;
+		timer.function = process_timeout;
+		add_timer(&timer);
 	}
 	if(current != next)
 		kstat.context_swtch++;
 	switch_to(next);
+	if (timeout)
+		del_timer(&timer);
 	/* Now maybe reload the debug registers */
 	if(current->debugreg[7]){
 		loaddebug(0);
@@ -318,11 +461,8 @@ void wake_up(struct wait_queue **q)
 	do {
 		if ((p = tmp->task) != NULL) {
 			if ((p->state == TASK_UNINTERRUPTIBLE) ||
-			    (p->state == TASK_INTERRUPTIBLE)) {
-				p->state = TASK_RUNNING;
-				if (p->counter > current->counter)
-					need_resched = 1;
-			}
+			    (p->state == TASK_INTERRUPTIBLE))
+				wake_up_process(p);
 		}
 		if (!tmp->next) {
 			printk("wait_queue is bad (eip = %08lx)\n",((unsigned long *) q)[-1]);
@@ -344,11 +484,8 @@ void wake_up_interruptible(struct wait_queue **q)
 		return;
 	do {
 		if ((p = tmp->task) != NULL) {
-			if (p->state == TASK_INTERRUPTIBLE) {
-				p->state = TASK_RUNNING;
-				if (p->counter > current->counter)
-					need_resched = 1;
-			}
+			if (p->state == TASK_INTERRUPTIBLE)
+				wake_up_process(p);
 		}
 		if (!tmp->next) {
 			printk("wait_queue is bad (eip = %08lx)\n",((unsigned long *) q)[-1]);
@@ -402,56 +539,200 @@ void sleep_on(struct wait_queue **p)
 	__sleep_on(p,TASK_UNINTERRUPTIBLE);
 }
 
-static struct timer_list * next_timer = NULL;
+/*
+ * The timer-list is a timer wheel: five levels of buckets, the first
+ * one with a bucket per tick and each of the others covering 64 times
+ * the span of the level below it. A timer goes straight into the
+ * bucket for its expiry time, so adding and deleting it is O(1).
+ * Every time a level wraps around, timer_bh() "cascades" the next
+ * bucket of the level above down into the finer-grained ones.
+ *
+ * While a timer is pending, timer->expires holds the absolute jiffy
+ * it goes off at. add_timer() takes, and del_timer() gives back, the
+ * number of ticks left, just like the old delta-list did.
+ */
+#define TVN_BITS 6
+#define TVR_BITS 8
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVR_MASK (TVR_SIZE - 1)
+
+struct timer_vec {
+	int index;
+	struct timer_list *vec[TVN_SIZE];
+};
+
+struct timer_vec_root {
+	int index;
+	struct timer_list *vec[TVR_SIZE];
+};
+
+static struct timer_vec tv5 = { 0 };
+static struct timer_vec tv4 = { 0 };
+static struct timer_vec tv3 = { 0 };
+static struct timer_vec tv2 = { 0 };
+static struct timer_vec_root tv1 = { 0 };
+
+static struct timer_vec * const tvecs[] = {
+	(struct timer_vec *) &tv1, &tv2, &tv3, &tv4, &tv5
+};
+
+#define NOOF_TVECS (sizeof(tvecs) / sizeof(tvecs[0]))
+
+static unsigned long timer_jiffies = 0;
+
+/* statistics for /proc/timers */
+unsigned long nr_timers = 0;		/* pending timers */
+unsigned long timer_cascades = 0;	/* timers moved down a level */
+unsigned long timer_max_cascade = 0;	/* most moved in a single tick */
+
+/*
+ * The bucket is a NULL-terminated list, and the first timer on it has
+ * its prev pointing at the bucket itself: this works because "next" is
+ * the first member of struct timer_list. A NULL prev means the timer
+ * isn't pending.
+ */
+static inline void insert_timer(struct timer_list * timer, struct timer_list ** vec)
+{
+	if ((timer->next = *vec) != NULL)
+		(*vec)->prev = timer;
+	*vec = timer;
+	timer->prev = (struct timer_list *) vec;
+}
+
+static inline void detach_timer(struct timer_list * timer)
+{
+	struct timer_list * next = timer->next;
+	struct timer_list * prev = timer->prev;
+
+	if (next)
+		next->prev = prev;
+	prev->next = next;
+	timer->next = timer->prev = NULL;
+}
+
+static inline void internal_add_timer(struct timer_list * timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list ** vec;
+
+	if (idx < TVR_SIZE)
+		vec = tv1.vec + (expires & TVR_MASK);
+	else if (idx < 1 << (TVR_BITS + TVN_BITS))
+		vec = tv2.vec + ((expires >> TVR_BITS) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS))
+		vec = tv3.vec + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS))
+		vec = tv4.vec + ((expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK);
+	else if ((signed long) idx < 0)
+		/* already due: timer_bh() is looking at this bucket next */
+		vec = tv1.vec + tv1.index;
+	else
+		vec = tv5.vec + ((expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK);
+	insert_timer(timer, vec);
+}
 
 void add_timer(struct timer_list * timer)
 {
 	unsigned long flags;
-	struct timer_list ** p;
 
 	if (!timer)
 		return;
-	timer->next = NULL;
-	p = &next_timer;
 	save_flags(flags);
 	cli();
-	while (*p) {
-		if ((*p)->expires > timer->expires) {
-			(*p)->expires -= timer->expires;
-			timer->next = *p;
-			break;
-		}
-		timer->expires -= (*p)->expires;
-		p = &(*p)->next;
-	}
-	*p = timer;
+	if (timer->prev)
+		detach_timer(timer);
+	else
+		nr_timers++;
+	timer->expires += jiffies;
+	internal_add_timer(timer);
 	restore_flags(flags);
 }
 
 int del_timer(struct timer_list * timer)
 {
 	unsigned long flags;
-	unsigned long expires = 0;
-	struct timer_list **p;
 
-	p = &next_timer;
 	save_flags(flags);
 	cli();
-	while (*p) {
-		if (*p == timer) {
-			if ((*p = timer->next) != NULL)
-				(*p)->expires += timer->expires;
-			timer->expires += expires;
-			restore_flags(flags);
-			return 1;
-		}
-		expires += (*p)->expires;
-		p = &(*p)->next;
+	if (timer->prev) {
+		detach_timer(timer);
+		nr_timers--;
+		if ((long) (timer->expires -= jiffies) < 0)
+			timer->expires = 0;
+		restore_flags(flags);
+		return 1;
 	}
 	restore_flags(flags);
 	return 0;
 }
 
+/*
+ * Move all the timers of the current bucket of tv down to the finer
+ * levels. Called with interrupts off.
+ */
+static inline unsigned long cascade_timers(struct timer_vec * tv)
+{
+	struct timer_list * timer, * next;
+	unsigned long nr = 0;
+
+	timer = tv->vec[tv->index];
+	tv->vec[tv->index] = NULL;
+	while (timer) {
+		next = timer->next;
+		internal_add_timer(timer);
+		timer = next;
+		nr++;
+	}
+	tv->index = (tv->index + 1) & TVN_MASK;
+	return nr;
+}
+
+static inline void run_timer_list(void)
+{
+	struct timer_list * timer;
+	unsigned long cascaded;
+	int n;
+
+	cli();
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		if (!tv1.index) {
+			cascaded = 0;
+			n = 1;
+			do {
+				cascaded += cascade_timers(tvecs[n]);
+			} while (tvecs[n]->index == 1 && ++n < NOOF_TVECS);
+			timer_cascades += cascaded;
+			if (cascaded > timer_max_cascade)
+				timer_max_cascade = cascaded;
+		}
+		while ((timer = tv1.vec[tv1.index]) != NULL) {
+			void (*fn)(unsigned long) = timer->function;
+			unsigned long data = timer->data;
+			detach_timer(timer);
+			nr_timers--;
+			timer->expires = 0;
+			sti();
+			fn(data);
+			cli();
+		}
+		timer_jiffies++;
+		tv1.index = (tv1.index + 1) & TVR_MASK;
+	}
+	sti();
+}
+
+int get_timer_stats(char * buffer)
+{
+	return sprintf(buffer,	"pending  %lu\n"
+				"ticks    %lu\n"
+				"cascaded %lu\n"
+				"maxcasc  %lu\n",
+		nr_timers, timer_jiffies, timer_cascades, timer_max_cascade);
+}
+
 unsigned long timer_active = 0;
 struct timer_struct timer_table[32];
 
@@ -568,17 +849,8 @@ static void timer_bh(void * unused)
 	unsigned long mask;
 	struct timer_struct *tp;
 
-	cli();
-	while (next_timer && next_timer->expires == 0) {
-		void (*fn)(unsigned long) = next_timer->function;
-		unsigned long data = next_timer->data;
-		next_timer = next_timer->next;
-		sti();
-		fn(data);
-		cli();
-	}
-	sti();
-	
+	run_timer_list();
+
 	for (mask = 1, tp = timer_table+0 ; mask ; tp++,mask += mask) {
 		if (mask > timer_active)
 			break;
@@ -600,9 +872,6 @@ static void timer_bh(void * unused)
  */
 static void do_timer(struct pt_regs * regs)
 {
-	unsigned long mask;
-	struct timer_struct *tp;
-
 	long ltemp;
 
 	/* Advance the phase, once it gets to one microsecond, then
@@ -688,30 +957,11 @@ static void do_timer(struct pt_regs * regs)
 		current->it_prof_value = current->it_prof_incr;
 		send_sig(SIGPROF,current,1);
 	}
-	for (mask = 1, tp = timer_table+0 ; mask ; tp++,mask += mask) {
-		if (mask > timer_active)
-			break;
-		if (!(mask & timer_active))
-			continue;
-		if (tp->expires > jiffies)
-			continue;
-		mark_bh(TIMER_BH);
-	}
-	cli();
-	itimer_ticks++;
-	if (itimer_ticks > itimer_next)
-		need_resched = 1;
-	if (next_timer) {
-		if (next_timer->expires) {
-			next_timer->expires--;
-			if (!next_timer->expires)
-				mark_bh(TIMER_BH);
-		} else {
-			lost_ticks++;
-			mark_bh(TIMER_BH);
-		}
-	}
-	sti();
+	/*
+	 * timer_bh() has to keep the wheel in step even when it's empty,
+	 * and it checks the timer_table for us as well.
+	 */
+	mark_bh(TIMER_BH);
 }
 
 asmlinkage int sys_alarm(long seconds)
@@ -816,6 +1066,8 @@ void sched_init(void)
 	struct desc_struct * p;
 
 	bh_base[TIMER_BH].routine = timer_bh;
+	init_task.real_timer.data = (unsigned long) &init_task;
+	init_task.real_timer.function = it_real_fn;
 	if (sizeof(struct sigaction) != 16)
 		panic("Struct sigaction MUST be 16 bytes");
 	set_tss_desc(gdt+FIRST_TSS_ENTRY,&init_task.tss);
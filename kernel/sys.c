@@ -17,6 +17,7 @@
 #include <linux/ptrace.h>
 #include <linux/stat.h>
 #include <linux/mman.h>
+#include <linux/mm.h>
 
 #include <asm/segment.h>
 #include <asm/io.h>
@@ -148,7 +149,7 @@ static void mark_screen_rdonly(struct task_struct * tsk)
 	unsigned long *pg_table;
 
 	if ((tmp = tsk->tss.cr3) != 0) {
-		tmp = *(unsigned long *) tmp;
+		tmp = unshare_page_table(tsk, (unsigned long *) tmp);
 		if (tmp & PAGE_PRESENT) {
 			tmp &= PAGE_MASK;
 			pg_table = (0xA0000 >> PAGE_SHIFT) + (unsigned long *) tmp;
@@ -0,0 +1,222 @@
+/*
+ *  linux/mm/filemap.c
+ *
+ * The page cache: pages of file data, indexed by (inode, offset) through
+ * a hash table, so that a fault on a mapped file finds a page another
+ * task has already read in without looking at any other task. Each
+ * cached page holds one reference in mem_map[]; mappings take more, so
+ * a page whose count is down to one is used by nobody but the cache and
+ * can be dropped when memory is short.
+ *
+ * The cache entries of an inode are also on a list off inode->i_pages,
+ * and go away when the inode is cleared, truncated or written to. The
+ * write() of a filesystem that uses the cache calls file_pages_written()
+ * when it is done, which also bumps inode->i_write_gen: a page that was
+ * being read in while the file was written isn't entered.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/malloc.h>
+#include <asm/system.h>
+
+struct page_cache {
+	struct inode * inode;
+	unsigned long offset;
+	unsigned long page;
+	struct page_cache * next_hash;
+	struct page_cache * prev_hash;
+	struct page_cache * next_inode;
+	struct page_cache * prev_inode;
+	struct page_cache * next_lru;	/* circular list for shrink_page_cache */
+	struct page_cache * prev_lru;
+};
+
+#define PAGE_HASH_SIZE 1024
+#define page_hashfn(inode,offset) \
+	((((unsigned long) (inode) >> 6) ^ ((offset) >> PAGE_SHIFT)) & (PAGE_HASH_SIZE - 1))
+
+static struct page_cache * page_hash_table[PAGE_HASH_SIZE];
+static struct page_cache * page_lru = NULL;
+static struct kmem_cache * page_cachep = NULL;
+
+int page_cache_size = 0;
+unsigned long page_cache_hits = 0;
+unsigned long page_cache_misses = 0;
+
+static void remove_page_cache(struct page_cache * pc)
+{
+	struct page_cache ** hash = page_hash_table + page_hashfn(pc->inode, pc->offset);
+
+	if (pc->next_hash)
+		pc->next_hash->prev_hash = pc->prev_hash;
+	if (pc->prev_hash)
+		pc->prev_hash->next_hash = pc->next_hash;
+	if (*hash == pc)
+		*hash = pc->next_hash;
+	if (pc->next_inode)
+		pc->next_inode->prev_inode = pc->prev_inode;
+	if (pc->prev_inode)
+		pc->prev_inode->next_inode = pc->next_inode;
+	if (pc->inode->i_pages == pc)
+		pc->inode->i_pages = pc->next_inode;
+	if (pc->next_lru == pc)
+		page_lru = NULL;
+	else {
+		pc->next_lru->prev_lru = pc->prev_lru;
+		pc->prev_lru->next_lru = pc->next_lru;
+		if (page_lru == pc)
+			page_lru = pc->next_lru;
+	}
+	page_cache_size--;
+	free_page(pc->page);
+	kmem_cache_free(page_cachep, pc);
+}
+
+/*
+ * Look up a page and take a reference to it for the caller.
+ */
+unsigned long find_page(struct inode * inode, unsigned long offset)
+{
+	struct page_cache * pc;
+
+	for (pc = page_hash_table[page_hashfn(inode, offset)]; pc; pc = pc->next_hash) {
+		if (pc->inode == inode && pc->offset == offset) {
+			mem_map[MAP_NR(pc->page)]++;
+			page_cache_hits++;
+			return pc->page;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Enter a page the caller has read, using an entry allocated before the
+ * read so that nothing sleeps between the final lookup and the insert.
+ * The cache takes its own reference; the caller keeps the one it has.
+ */
+static void add_to_page_cache(struct page_cache * pc,
+	struct inode * inode, unsigned long offset, unsigned long page)
+{
+	struct page_cache ** hash;
+
+	pc->inode = inode;
+	pc->offset = offset;
+	pc->page = page;
+	mem_map[MAP_NR(page)]++;
+	hash = page_hash_table + page_hashfn(inode, offset);
+	pc->prev_hash = NULL;
+	if ((pc->next_hash = *hash) != NULL)
+		pc->next_hash->prev_hash = pc;
+	*hash = pc;
+	pc->prev_inode = NULL;
+	if ((pc->next_inode = inode->i_pages) != NULL)
+		pc->next_inode->prev_inode = pc;
+	inode->i_pages = pc;
+	if (!page_lru) {
+		pc->next_lru = pc->prev_lru = pc;
+		page_lru = pc;
+	} else {
+		pc->next_lru = page_lru;
+		pc->prev_lru = page_lru->prev_lru;
+		page_lru->prev_lru->next_lru = pc;
+		page_lru->prev_lru = pc;
+	}
+	page_cache_size++;
+}
+
+/*
+ * Find the page at "offset" of a disk file, reading it into the cache
+ * if it isn't there. The offset must be block aligned. Returns the page
+ * with a reference for the caller, or 0 if there was no memory. If no
+ * cache entry can be had the page is still returned, just not shared.
+ */
+unsigned long read_cached_page(struct inode * inode, unsigned long offset)
+{
+	struct page_cache * pc;
+	unsigned long page, cached, gen;
+	unsigned int block;
+	int nr[8];
+	int i, j;
+
+	if ((page = find_page(inode, offset)) != 0)
+		return page;
+	page_cache_misses++;
+	pc = (struct page_cache *) kmem_cache_alloc(page_cachep, GFP_KERNEL);
+	page = get_free_page(GFP_KERNEL);
+	if (!page) {
+		if (pc)
+			kmem_cache_free(page_cachep, pc);
+		return 0;
+	}
+repeat:
+	gen = inode->i_write_gen;
+	block = offset >> inode->i_sb->s_blocksize_bits;
+	for (i=0, j=0; i< PAGE_SIZE ; j++, block++, i += inode->i_sb->s_blocksize)
+		nr[j] = bmap(inode,block);
+	read_page_blocks(page, inode->i_dev, nr, inode->i_sb->s_blocksize);
+	/* the file was written while we slept: what we read may be old */
+	if (gen != inode->i_write_gen)
+		goto repeat;
+	/* somebody else may have read it in while we slept */
+	if ((cached = find_page(inode, offset)) != 0) {
+		page_cache_hits--;
+		free_page(page);
+		page = cached;
+	} else if (pc) {
+		add_to_page_cache(pc, inode, offset, page);
+		return page;
+	}
+	if (pc)
+		kmem_cache_free(page_cachep, pc);
+	return page;
+}
+
+/*
+ * Drop all the cached pages of an inode. Tasks that have them mapped
+ * keep their references.
+ */
+void invalidate_inode_pages(struct inode * inode)
+{
+	while (inode->i_pages)
+		remove_page_cache(inode->i_pages);
+}
+
+/*
+ * A write() or a truncate has changed the file. Truncate calls this
+ * only once the blocks are gone: a read that mapped them before then
+ * sees the new generation, or has its page dropped here.
+ */
+void file_pages_written(struct inode * inode)
+{
+	inode->i_write_gen++;
+	if (inode->i_pages)
+		invalidate_inode_pages(inode);
+}
+
+/*
+ * Go round the cache dropping pages that no task has mapped. A higher
+ * priority number means a shorter look, as in shrink_buffers().
+ */
+int shrink_page_cache(int priority)
+{
+	struct page_cache * pc;
+	int count = (page_cache_size >> priority) + 1;
+
+	while (count-- > 0 && (pc = page_lru) != NULL) {
+		page_lru = pc->next_lru;
+		if (mem_map[MAP_NR(pc->page)] == 1) {
+			remove_page_cache(pc);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void page_cache_init(void)
+{
+	page_cachep = kmem_cache_create("page_cache", sizeof(struct page_cache), 0, NULL);
+	if (!page_cachep)
+		panic("page_cache_init: cannot create page cache descriptors");
+}
@@ -8,6 +8,7 @@
  */
 
 #include <linux/mm.h>
+#include <linux/malloc.h>
 #include <asm/system.h>
 #include <linux/delay.h>
 
@@ -17,7 +18,13 @@
    I want this number to be increased in the near future:
         loadable device drivers should use this function to get memory */
 
-#define MAX_KMALLOC_K 4
+/*
+ * The largest size class in sizes[] below lives in an order-5 block.
+ * That is a choice of kmalloc's, not a limit of the page allocator,
+ * which hands out blocks up to order NR_MEM_LISTS-1: kmalloc_init()
+ * checks that every class fits.
+ */
+#define MAX_KMALLOC_K 128
 
 
 /* This defines how many times we should try to allocate a free page before
@@ -86,24 +93,31 @@ struct size_descriptor {
 	int nfrees;
 	int nbytesmalloced;
 	int npages;
+	unsigned long gfporder;	/* each "page" is 2^gfporder real pages */
 };
 
 
 struct size_descriptor sizes[] = { 
-	{ NULL,  32,127, 0,0,0,0 },
-	{ NULL,  64, 63, 0,0,0,0 },
-	{ NULL, 128, 31, 0,0,0,0 },
-	{ NULL, 252, 16, 0,0,0,0 },
-	{ NULL, 508,  8, 0,0,0,0 },
-	{ NULL,1020,  4, 0,0,0,0 },
-	{ NULL,2040,  2, 0,0,0,0 },
-	{ NULL,4080,  1, 0,0,0,0 },
-	{ NULL,   0,  0, 0,0,0,0 }
+	{ NULL,  32,127, 0,0,0,0, 0 },
+	{ NULL,  64, 63, 0,0,0,0, 0 },
+	{ NULL, 128, 31, 0,0,0,0, 0 },
+	{ NULL, 252, 16, 0,0,0,0, 0 },
+	{ NULL, 508,  8, 0,0,0,0, 0 },
+	{ NULL,1020,  4, 0,0,0,0, 0 },
+	{ NULL,2040,  2, 0,0,0,0, 0 },
+	{ NULL,4080,  1, 0,0,0,0, 0 },
+	{ NULL,8176,  1, 0,0,0,0, 1 },
+	{ NULL,16368, 1, 0,0,0,0, 2 },
+	{ NULL,32752, 1, 0,0,0,0, 3 },
+	{ NULL,65520, 1, 0,0,0,0, 4 },
+	{ NULL,131056,1, 0,0,0,0, 5 },
+	{ NULL,   0,  0, 0,0,0,0, 0 }
 };
 
 
 #define NBLOCKS(order)          (sizes[order].nblocks)
 #define BLOCKSIZE(order)        (sizes[order].size)
+#define AREASIZE(order)		(PAGE_SIZE<<(sizes[order].gfporder))
 
 
 
@@ -117,13 +131,16 @@ long kmalloc_init (long start_mem,long end_mem)
  */
 for (order = 0;BLOCKSIZE(order);order++)
     {
+    if (sizes[order].gfporder >= NR_MEM_LISTS)
+        panic ("kmalloc: order %d needs a block of order %lu",
+                order, sizes[order].gfporder);
     if ((NBLOCKS (order)*BLOCKSIZE(order) + sizeof (struct page_descriptor)) >
-        PAGE_SIZE) 
+        AREASIZE(order)) 
         {
         printk ("Cannot use %d bytes out of %d in order = %d block mallocs\n",
                 NBLOCKS (order) * BLOCKSIZE(order) + 
                         sizeof (struct page_descriptor),
-                (int) PAGE_SIZE,
+                (int) AREASIZE(order),
                 BLOCKSIZE (order));
         panic ("This only happens if someone messes with kmalloc");
         }
@@ -213,7 +230,7 @@ while (tries --)
     sz = BLOCKSIZE(order); /* sz is the size of the blocks we're dealing with */
 
     /* This can be done with ints on: This is private to this invocation */
-    page = (struct page_descriptor *) __get_free_page (priority & GFP_LEVEL_MASK);
+    page = (struct page_descriptor *) __get_free_pages (priority & GFP_LEVEL_MASK, sizes[order].gfporder);
     if (!page) 
         {
         printk ("Couldn't get a free page.....\n");
@@ -335,10 +352,25 @@ if (page->nfree == NBLOCKS (page->order))
         else
             printk ("Ooops. page %p doesn't show on freelist.\n", page);
         }
-    free_page ((long)page);
+    free_pages ((long)page, sizes[order].gfporder);
     }
 restore_flags(flags);
 
 sizes[order].nfrees++;      /* Noncritical (monitoring) admin stuff */
 sizes[order].nbytesmalloced -= size;
 }
+
+/*
+ * The size class counters, for /proc/slabinfo.
+ */
+int get_kmalloc_stats(char * buffer)
+{
+	int order, len;
+
+	len = sprintf(buffer, "kmalloc  size    mallocs      frees    bytes  pages\n");
+	for (order = 0; BLOCKSIZE(order); order++)
+		len += sprintf(buffer+len, "         %4d %10d %10d %8d %6d\n",
+			BLOCKSIZE(order), sizes[order].nmallocs, sizes[order].nfrees,
+			sizes[order].nbytesmalloced, sizes[order].npages);
+	return len;
+}
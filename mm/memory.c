@@ -40,6 +40,7 @@
 #include <linux/types.h>
 #include <linux/ptrace.h>
 #include <linux/mman.h>
+#include <linux/shm.h>
 
 unsigned long high_memory = 0;
 
@@ -50,15 +51,6 @@ extern void die_if_kernel(char *,struct pt_regs *,long);
 
 int nr_swap_pages = 0;
 int nr_free_pages = 0;
-unsigned long free_page_list = 0;
-/*
- * The secondary free_page_list is used for malloc() etc things that
- * may need pages during interrupts etc. Normal get_free_page() operations
- * don't touch it, so it stays as a kind of "panic-list", that can be
- * accessed when all other mm tricks have failed.
- */
-int nr_secondary_pages = 0;
-unsigned long secondary_page_list = 0;
 
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl": :"S" (from),"D" (to),"c" (1024))
@@ -79,7 +71,7 @@ void oom(struct task_struct * task)
 	send_sig(SIGKILL,task,1);
 }
 
-static void free_one_table(unsigned long * page_dir)
+static void free_one_table(unsigned long * page_dir, struct task_struct * tsk)
 {
 	int j;
 	unsigned long pg_table = *page_dir;
@@ -92,8 +84,15 @@ static void free_one_table(unsigned long * page_dir)
 		printk("Bad page table: [%p]=%08lx\n",page_dir,pg_table);
 		return;
 	}
-	if (mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED)
+	/* a large page belongs to the kernel or to a shm segment */
+	if ((pg_table & PAGE_4M) || (mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED))
 		return;
+	/* still shared after fork: the pages belong to the other users */
+	if (mem_map[MAP_NR(pg_table)] > 1) {
+		disown_page_table(pg_table, tsk);
+		free_page(PAGE_MASK & pg_table);
+		return;
+	}
 	page_table = (unsigned long *) (pg_table & PAGE_MASK);
 	for (j = 0 ; j < PTRS_PER_PAGE ; j++,page_table++) {
 		unsigned long pg = *page_table;
@@ -101,11 +100,15 @@ static void free_one_table(unsigned long * page_dir)
 		if (!pg)
 			continue;
 		*page_table = 0;
-		if (pg & PAGE_PRESENT)
+		if (pg & PAGE_PRESENT) {
+			page_remove_rmap(pg, page_table);
 			free_page(PAGE_MASK & pg);
-		else
+		} else {
+			swap_remove_rmap(pg, page_table);
 			swap_free(pg);
+		}
 	}
+	set_page_table_owner(pg_table, NULL);
 	free_page(PAGE_MASK & pg_table);
 }
 
@@ -146,7 +149,7 @@ void clear_page_tables(struct task_struct * tsk)
 		return;
 	}
 	for (i = 0 ; i < 768 ; i++,page_dir++)
-		free_one_table(page_dir);
+		free_one_table(page_dir, tsk);
 	invalidate();
 	return;
 }
@@ -174,13 +177,17 @@ void free_page_tables(struct task_struct * tsk)
 	tsk->tss.cr3 = (unsigned long) swapper_pg_dir;
 	if (tsk == current)
 		__asm__ __volatile__("movl %0,%%cr3": :"a" (tsk->tss.cr3));
+	page_dir = (unsigned long *) pg_dir;
 	if (mem_map[MAP_NR(pg_dir)] > 1) {
+		/* the tables live on with the tasks sharing the directory */
+		for (i = 0 ; i < 768 ; i++)
+			if (page_dir[i] & PAGE_PRESENT)
+				disown_page_table(page_dir[i], tsk);
 		free_page(pg_dir);
 		return;
 	}
-	page_dir = (unsigned long *) pg_dir;
 	for (i = 0 ; i < PTRS_PER_PAGE ; i++,page_dir++)
-		free_one_table(page_dir);
+		free_one_table(page_dir, tsk);
 	free_page(pg_dir);
 	invalidate();
 }
@@ -202,9 +209,62 @@ int clone_page_tables(struct task_struct * tsk)
 }
 
 /*
- * copy_page_tables() just copies the whole process memory range:
- * note the special handling of RESERVED (ie kernel) pages, which
- * means that they are always shared by all processes.
+ * Copy the entries of one page table to a new one, sharing the pages:
+ * writable private pages are made read-only in both tables so that the
+ * first write copies them, and swapped-out pages get another reference.
+ * A copy is only reverse mapped if the original is: shm and
+ * remap_page_range() pages never are.
+ */
+static void copy_one_table(unsigned long * old_page_table, unsigned long * new_page_table)
+{
+	int j;
+
+	for (j = 0 ; j < PTRS_PER_PAGE ; j++,old_page_table++,new_page_table++) {
+		unsigned long pg;
+		pg = *old_page_table;
+		if (!pg)
+			continue;
+		if (!(pg & PAGE_PRESENT)) {
+			*new_page_table = swap_duplicate(pg);
+			swap_add_rmap(pg, new_page_table);
+			continue;
+		}
+		if ((pg & (PAGE_RW | PAGE_COW)) == (PAGE_RW | PAGE_COW))
+			pg &= ~PAGE_RW;
+		*new_page_table = pg;
+		if (pg >= high_memory || (mem_map[MAP_NR(pg)] & MAP_PAGE_RESERVED))
+			continue;
+		*old_page_table = pg;
+		mem_map[MAP_NR(pg)]++;
+		if (page_rmap_mapped(pg, old_page_table))
+			page_add_rmap(pg, new_page_table);
+	}
+}
+
+/*
+ * Does the 4MB range of page table "i" hold a shared memory attach?
+ * Shm keeps one page reference per attach, so those tables can't be
+ * shared between tasks and are always copied.
+ */
+static int shm_in_table(struct task_struct * tsk, int i)
+{
+	struct shm_desc * shmd;
+	unsigned long start = (unsigned long) i << 22;
+
+	for (shmd = tsk->shm; shmd; shmd = shmd->task_next)
+		if (shmd->start < start + (PAGE_SIZE << 10) && shmd->end > start)
+			return 1;
+	return 0;
+}
+
+/*
+ * copy_page_tables() sets up the child's page directory at fork. The
+ * page tables themselves are not copied: parent and child share them,
+ * with the directory entries made read-only, and each table is copied
+ * by unshare_page_table() on the first write into its 4MB range. A
+ * child that just execs never copies anything. Note the special
+ * handling of RESERVED (ie kernel) tables, which are always shared by
+ * all processes.
  */
 int copy_page_tables(struct task_struct * tsk)
 {
@@ -219,9 +279,7 @@ int copy_page_tables(struct task_struct * tsk)
 	old_page_dir = (unsigned long *) old_pg_dir;
 	new_page_dir = (unsigned long *) new_pg_dir;
 	for (i = 0 ; i < PTRS_PER_PAGE ; i++,old_page_dir++,new_page_dir++) {
-		int j;
-		unsigned long old_pg_table, *old_page_table;
-		unsigned long new_pg_table, *new_page_table;
+		unsigned long old_pg_table, new_pg_table;
 
 		old_pg_table = *old_page_dir;
 		if (!old_pg_table)
@@ -232,39 +290,79 @@ int copy_page_tables(struct task_struct * tsk)
 			*old_page_dir = 0;
 			continue;
 		}
-		if (mem_map[MAP_NR(old_pg_table)] & MAP_PAGE_RESERVED) {
+		if ((old_pg_table & PAGE_4M) ||
+		    (mem_map[MAP_NR(old_pg_table)] & MAP_PAGE_RESERVED)) {
 			*new_page_dir = old_pg_table;
 			continue;
 		}
+		if (!current->shm || !shm_in_table(current, i)) {
+			old_pg_table &= ~PAGE_RW;
+			*old_page_dir = old_pg_table;
+			*new_page_dir = old_pg_table;
+			mem_map[MAP_NR(old_pg_table)]++;
+			continue;
+		}
 		if (!(new_pg_table = get_free_page(GFP_KERNEL))) {
 			free_page_tables(tsk);
 			return -ENOMEM;
 		}
-		old_page_table = (unsigned long *) (PAGE_MASK & old_pg_table);
-		new_page_table = (unsigned long *) (PAGE_MASK & new_pg_table);
-		for (j = 0 ; j < PTRS_PER_PAGE ; j++,old_page_table++,new_page_table++) {
-			unsigned long pg;
-			pg = *old_page_table;
-			if (!pg)
-				continue;
-			if (!(pg & PAGE_PRESENT)) {
-				*new_page_table = swap_duplicate(pg);
-				continue;
-			}
-			if ((pg & (PAGE_RW | PAGE_COW)) == (PAGE_RW | PAGE_COW))
-				pg &= ~PAGE_RW;
-			*new_page_table = pg;
-			if (mem_map[MAP_NR(pg)] & MAP_PAGE_RESERVED)
-				continue;
-			*old_page_table = pg;
-			mem_map[MAP_NR(pg)]++;
-		}
+		copy_one_table((unsigned long *) (PAGE_MASK & old_pg_table),
+			(unsigned long *) new_pg_table);
+		set_page_table_owner(new_pg_table, tsk);
 		*new_page_dir = new_pg_table | PAGE_TABLE;
 	}
 	invalidate();
 	return 0;
 }
 
+/*
+ * Give a task its own copy of the page table behind the directory
+ * entry "pde" if it is still sharing it after a fork. Anything that is
+ * going to change a task's page tables other than by filling in a
+ * missing page has to call this first. Returns the (writable) directory
+ * entry; if there is no memory the task is killed and gets the bad
+ * page table.
+ */
+unsigned long unshare_page_table(struct task_struct * tsk, unsigned long * pde)
+{
+	unsigned long old_pg_table, new_pg_table;
+
+repeat:
+	old_pg_table = *pde;
+	if ((old_pg_table & (PAGE_PRESENT | PAGE_RW | PAGE_4M)) != PAGE_PRESENT)
+		return old_pg_table;
+	if (old_pg_table >= high_memory ||
+	    (mem_map[MAP_NR(old_pg_table)] & MAP_PAGE_RESERVED))
+		return old_pg_table;
+	if (mem_map[MAP_NR(old_pg_table)] == 1) {
+		/* the other users have copied it or gone away */
+		set_page_table_owner(old_pg_table, tsk);
+		*pde = old_pg_table | PAGE_RW;
+		invalidate();
+		return *pde;
+	}
+	new_pg_table = get_free_page(GFP_KERNEL);
+	if (*pde != old_pg_table || mem_map[MAP_NR(old_pg_table)] == 1) {
+		/* changed while we slept */
+		if (new_pg_table)
+			free_page(new_pg_table);
+		goto repeat;
+	}
+	if (!new_pg_table) {
+		oom(tsk);
+		new_pg_table = BAD_PAGETABLE;
+	} else {
+		copy_one_table((unsigned long *) (PAGE_MASK & old_pg_table),
+			(unsigned long *) new_pg_table);
+		set_page_table_owner(new_pg_table, tsk);
+	}
+	*pde = new_pg_table | PAGE_TABLE;
+	disown_page_table(old_pg_table, tsk);
+	free_page(PAGE_MASK & old_pg_table);
+	invalidate();
+	return *pde;
+}
+
 /*
  * a more complete version of free_page_tables which performs with page
  * granularity.
@@ -295,6 +393,20 @@ int unmap_page_range(unsigned long from, unsigned long size)
 			printk("unmap_page_range: bad page directory.");
 			continue;
 		}
+		if (page_dir & PAGE_4M) {
+			/* a large shm page can only go as a whole */
+			*dir = 0;
+			poff = 0;
+			continue;
+		}
+		if (pcnt == PTRS_PER_PAGE && mem_map[MAP_NR(page_dir)] > 1) {
+			/* a whole shared table: just drop our reference */
+			*dir = 0;
+			disown_page_table(page_dir, current);
+			free_page(PAGE_MASK & page_dir);
+			continue;
+		}
+		page_dir = unshare_page_table(current, dir);
 		page_table = (unsigned long *)(PAGE_MASK & page_dir);
 		if (poff) {
 			page_table += poff;
@@ -307,13 +419,17 @@ int unmap_page_range(unsigned long from, unsigned long size)
 					if (!(mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED))
 						if (current->rss > 0)
 							--current->rss;
+					page_remove_rmap(page, page_table);
 					free_page(PAGE_MASK & page);
-				} else
+				} else {
+					swap_remove_rmap(page, page_table);
 					swap_free(page);
+				}
 			}
 		}
 		if (pcnt == PTRS_PER_PAGE) {
 			*dir = 0;
+			set_page_table_owner(page_dir, NULL);
 			free_page(PAGE_MASK & page_dir);
 		}
 	}
@@ -345,6 +461,7 @@ int zeromap_page_range(unsigned long from, unsigned long size, int mask)
 		pcnt = size;
 
 	while (size > 0) {
+		unshare_page_table(current, dir);
 		if (!(PAGE_PRESENT & *dir)) {
 				/* clear page needed here?  SRB. */
 			if (!(page_table = (unsigned long*) get_free_page(GFP_KERNEL))) {
@@ -354,8 +471,10 @@ int zeromap_page_range(unsigned long from, unsigned long size, int mask)
 			if (PAGE_PRESENT & *dir) {
 				free_page((unsigned long) page_table);
 				page_table = (unsigned long *)(PAGE_MASK & *dir++);
-			} else
+			} else {
+				set_page_table_owner((unsigned long) page_table, current);
 				*dir++ = ((unsigned long) page_table) | PAGE_TABLE;
+			}
 		} else
 			page_table = (unsigned long *)(PAGE_MASK & *dir++);
 		page_table += poff;
@@ -367,9 +486,12 @@ int zeromap_page_range(unsigned long from, unsigned long size, int mask)
 					if (!(mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED))
 						if (current->rss > 0)
 							--current->rss;
+					page_remove_rmap(page, page_table);
 					free_page(PAGE_MASK & page);
-				} else
+				} else {
+					swap_remove_rmap(page, page_table);
 					swap_free(page);
+				}
 			}
 			*page_table++ = mask;
 		}
@@ -407,12 +529,14 @@ int remap_page_range(unsigned long from, unsigned long to, unsigned long size, i
 		pcnt = size;
 
 	while (size > 0) {
+		unshare_page_table(current, dir);
 		if (!(PAGE_PRESENT & *dir)) {
 			/* clearing page here, needed?  SRB. */
 			if (!(page_table = (unsigned long*) get_free_page(GFP_KERNEL))) {
 				invalidate();
 				return -1;
 			}
+			set_page_table_owner((unsigned long) page_table, current);
 			*dir++ = ((unsigned long) page_table) | PAGE_TABLE;
 		}
 		else
@@ -429,9 +553,12 @@ int remap_page_range(unsigned long from, unsigned long to, unsigned long size, i
 					if (!(mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED))
 						if (current->rss > 0)
 							--current->rss;
+					page_remove_rmap(page, page_table);
 					free_page(PAGE_MASK & page);
-				} else
+				} else {
+					swap_remove_rmap(page, page_table);
 					swap_free(page);
+				}
 			}
 
 			/*
@@ -490,10 +617,13 @@ unsigned long put_page(struct task_struct * tsk,unsigned long page,
 	page_table += (address >> PAGE_SHIFT) & (PTRS_PER_PAGE-1);
 	if (*page_table) {
 		printk("put_page: page already exists\n");
+		if (*page_table & PAGE_PRESENT)
+			page_remove_rmap(*page_table, page_table);
 		*page_table = 0;
 		invalidate();
 	}
 	*page_table = page | prot;
+	page_add_rmap(page, page_table);
 /* no need for invalidate */
 	return page;
 }
@@ -522,6 +652,7 @@ unsigned long put_dirty_page(struct task_struct * tsk, unsigned long page, unsig
 			free_page(tmp);
 			page_table = (unsigned long *) (PAGE_MASK & *page_table);
 		} else {
+			set_page_table_owner(tmp, tsk);
 			*page_table = tmp | PAGE_TABLE;
 			page_table = (unsigned long *) tmp;
 		}
@@ -529,10 +660,13 @@ unsigned long put_dirty_page(struct task_struct * tsk, unsigned long page, unsig
 	page_table += (address >> PAGE_SHIFT) & (PTRS_PER_PAGE-1);
 	if (*page_table) {
 		printk("put_dirty_page: page already exists\n");
+		if (*page_table & PAGE_PRESENT)
+			page_remove_rmap(*page_table, page_table);
 		*page_table = 0;
 		invalidate();
 	}
 	*page_table = page | (PAGE_DIRTY | PAGE_PRIVATE);
+	page_add_rmap(page, page_table);
 /* no need for invalidate */
 	return page;
 }
@@ -573,16 +707,22 @@ static void __do_wp_page(unsigned long error_code, unsigned long address,
 	tsk->min_flt++;
 	prot = (old_page & ~PAGE_MASK) | PAGE_RW;
 	old_page &= PAGE_MASK;
+	/* the swap cache copy goes stale once we write, unless we copy */
+	if (in_swap_cache(old_page) && mem_map[MAP_NR(old_page)] == 2)
+		delete_from_swap_cache(old_page);
 	if (mem_map[MAP_NR(old_page)] != 1) {
 		if (new_page) {
 			if (mem_map[MAP_NR(old_page)] & MAP_PAGE_RESERVED)
 				++tsk->rss;
 			copy_page(old_page,new_page);
 			*(unsigned long *) pte = new_page | prot;
+			page_remove_rmap(old_page, (unsigned long *) pte);
+			page_add_rmap(new_page, (unsigned long *) pte);
 			free_page(old_page);
 			invalidate();
 			return;
 		}
+		page_remove_rmap(old_page, (unsigned long *) pte);
 		free_page(old_page);
 		oom(tsk);
 		*(unsigned long *) pte = BAD_PAGE | prot;
@@ -624,6 +764,14 @@ void do_wp_page(unsigned long error_code, unsigned long address,
 	if (!page)
 		return;
 	if ((page & PAGE_PRESENT) && page < high_memory) {
+		/* large pages are never copy-on-write */
+		if (page & PAGE_4M) {
+			if (!(page & PAGE_RW))
+				goto bad_area;
+			return;
+		}
+		if (!(page & PAGE_RW))
+			page = unshare_page_table(tsk, pg_table);
 		pg_table = (unsigned long *) ((page & PAGE_MASK) + PAGE_PTR(address));
 		page = *pg_table;
 		if (!(page & PAGE_PRESENT))
@@ -631,13 +779,8 @@ void do_wp_page(unsigned long error_code, unsigned long address,
 		if (page & PAGE_RW)
 			return;
 		if (!(page & PAGE_COW)) {
-			if (user_esp && tsk == current) {
-				current->tss.cr2 = address;
-				current->tss.error_code = error_code;
-				current->tss.trap_no = 14;
-				send_sig(SIGSEGV, tsk, 1);
-				return;
-			}
+			if (user_esp && tsk == current)
+				goto bad_area;
 		}
 		if (mem_map[MAP_NR(page)] == 1) {
 			*pg_table |= PAGE_RW | PAGE_DIRTY;
@@ -649,6 +792,14 @@ void do_wp_page(unsigned long error_code, unsigned long address,
 	}
 	printk("bad page directory entry %08lx\n",page);
 	*pg_table = 0;
+	return;
+bad_area:
+	if (user_esp && tsk == current) {
+		current->tss.cr2 = address;
+		current->tss.error_code = error_code;
+		current->tss.trap_no = 14;
+		send_sig(SIGSEGV, tsk, 1);
+	}
 }
 
 int __verify_write(unsigned long start, unsigned long size)
@@ -676,6 +827,57 @@ static inline void get_empty_page(struct task_struct * tsk, unsigned long addres
 		free_page(tmp);
 }
 
+/*
+ * First touch of anonymous memory. A read maps the zero page read-only
+ * (it isn't counted in rss), and do_wp_page() copies it on the first
+ * write. If the page before this one is already mapped the task is most
+ * likely walking forward through the area, so the next few empty entries
+ * of the same page table are filled as well, saving a fault each. That
+ * is only done in a table of our own, never one still shared after fork.
+ */
+#define FAULT_AROUND	8
+
+static void do_anonymous_page(struct task_struct * tsk, unsigned long address,
+	unsigned long end, int write_access)
+{
+	unsigned long * pte, pde, page, zero;
+	int i, n;
+
+	++tsk->min_flt;
+	zero = ZERO_PAGE;
+	if (write_access)
+		get_empty_page(tsk,address);
+	else {
+		--tsk->rss;
+		put_page(tsk,zero,address,PAGE_COPY);
+	}
+	pde = *PAGE_DIR_OFFSET(tsk->tss.cr3,address);
+	if ((pde & (PAGE_PRESENT | PAGE_RW | PAGE_4M)) != (PAGE_PRESENT | PAGE_RW))
+		return;
+	if (pde >= high_memory || (mem_map[MAP_NR(pde)] & MAP_PAGE_RESERVED))
+		return;
+	i = (address >> PAGE_SHIFT) & (PTRS_PER_PAGE-1);
+	pte = (unsigned long *) (pde & PAGE_MASK) + i;
+	if (!i || !(pte[-1] & PAGE_PRESENT))
+		return;
+	for (n = 1; n < FAULT_AROUND && ++i < PTRS_PER_PAGE; n++) {
+		address += PAGE_SIZE;
+		pte++;
+		if (address >= end || *pte)
+			break;
+		if (!write_access) {
+			*pte = zero | PAGE_COPY;
+			continue;
+		}
+		if (!(page = __get_free_page(GFP_BUFFER)))
+			break;
+		memset((void *) page, 0, PAGE_SIZE);
+		*pte = page | PAGE_PRIVATE;
+		page_add_rmap(page, pte);
+		++tsk->rss;
+	}
+}
+
 /*
  * try_to_share() checks the page at address "address" in the task "p",
  * to see if it exists, and if it is clean. If so, share it with the current
@@ -702,7 +904,7 @@ static int try_to_share(unsigned long address, struct task_struct * tsk,
 	to_page = (unsigned long)PAGE_DIR_OFFSET(tsk->tss.cr3,address);
 /* is there a page-directory at from? */
 	from = *(unsigned long *) from_page;
-	if (!(from & PAGE_PRESENT))
+	if ((from & (PAGE_PRESENT | PAGE_4M)) != PAGE_PRESENT)
 		return 0;
 	from &= PAGE_MASK;
 	from_page = from + PAGE_PTR(address);
@@ -714,9 +916,12 @@ static int try_to_share(unsigned long address, struct task_struct * tsk,
 		return 0;
 	if (mem_map[MAP_NR(from)] & MAP_PAGE_RESERVED)
 		return 0;
+/* a clean swapped-in page isn't file data */
+	if (in_swap_cache(from))
+		return 0;
 /* is the destination ok? */
 	to = *(unsigned long *) to_page;
-	if (!(to & PAGE_PRESENT))
+	if ((to & (PAGE_PRESENT | PAGE_4M)) != PAGE_PRESENT)
 		return 0;
 	to &= PAGE_MASK;
 	to_page = to + PAGE_PTR(address);
@@ -737,6 +942,7 @@ static int try_to_share(unsigned long address, struct task_struct * tsk,
 	}
 	*(unsigned long *) from_page = from;
 	*(unsigned long *) to_page = to;
+	page_add_rmap(to, (unsigned long *) to_page);
 	invalidate();
 	return 1;
 }
@@ -811,6 +1017,7 @@ static inline unsigned long get_empty_pgtable(struct task_struct * tsk,unsigned
 		*p = 0;
 	}
 	if (page) {
+		set_page_table_owner(page, tsk);
 		*p = page | PAGE_TABLE;
 		return *p;
 	}
@@ -824,11 +1031,18 @@ void do_no_page(unsigned long error_code, unsigned long address,
 {
 	unsigned long tmp;
 	unsigned long page;
-	struct vm_area_struct * mpnt;
+	struct vm_area_struct * mpnt, * prev;
 
 	page = get_empty_pgtable(tsk,address);
 	if (!page)
 		return;
+	/*
+	 * A page read in on a read fault can go into a table still shared
+	 * after fork: it is the same for everybody. A write will copy the
+	 * table anyway, so do it now.
+	 */
+	if (error_code & PAGE_RW)
+		page = unshare_page_table(tsk, PAGE_DIR_OFFSET(tsk->tss.cr3,address));
 	page &= PAGE_MASK;
 	page += PAGE_PTR(address);
 	tmp = *(unsigned long *) page;
@@ -837,21 +1051,14 @@ void do_no_page(unsigned long error_code, unsigned long address,
 	++tsk->rss;
 	if (tmp) {
 		++tsk->maj_flt;
-		swap_in((unsigned long *) page);
+		swap_in((unsigned long *) page, error_code & PAGE_RW);
 		return;
 	}
 	address &= 0xfffff000;
-	tmp = 0;
-	for (mpnt = tsk->mmap; mpnt != NULL; mpnt = mpnt->vm_next) {
-		if (address < mpnt->vm_start)
-			break;
-		if (address >= mpnt->vm_end) {
-			tmp = mpnt->vm_end;
-			continue;
-		}
+	mpnt = find_vma(tsk, address);
+	if (mpnt && address >= mpnt->vm_start) {
 		if (!mpnt->vm_ops || !mpnt->vm_ops->nopage) {
-			++tsk->min_flt;
-			get_empty_page(tsk,address);
+			do_anonymous_page(tsk, address, mpnt->vm_end, error_code & PAGE_RW);
 			return;
 		}
 		mpnt->vm_ops->nopage(error_code, mpnt, address);
@@ -861,11 +1068,14 @@ void do_no_page(unsigned long error_code, unsigned long address,
 		goto ok_no_page;
 	if (address >= tsk->end_data && address < tsk->brk)
 		goto ok_no_page;
-	if (mpnt && mpnt == tsk->stk_vma &&
-	    address - tmp > mpnt->vm_start - address &&
-	    tsk->rlim[RLIMIT_STACK].rlim_cur > mpnt->vm_end - address) {
-		mpnt->vm_start = address;
-		goto ok_no_page;
+	if (mpnt && mpnt == tsk->stk_vma) {
+		find_vma_prev(tsk, address, &prev);
+		tmp = prev ? prev->vm_end : 0;
+		if (address - tmp > mpnt->vm_start - address &&
+		    tsk->rlim[RLIMIT_STACK].rlim_cur > mpnt->vm_end - address) {
+			mpnt->vm_start = address;
+			goto ok_no_page;
+		}
 	}
 	tsk->tss.cr2 = address;
 	current->tss.error_code = error_code;
@@ -874,8 +1084,10 @@ void do_no_page(unsigned long error_code, unsigned long address,
 	if (error_code & 4)	/* user level access? */
 		return;
 ok_no_page:
-	++tsk->min_flt;
-	get_empty_page(tsk,address);
+	tmp = address + PAGE_SIZE;
+	if (tsk == current && address >= tsk->end_data && address < tsk->brk)
+		tmp = tsk->brk;
+	do_anonymous_page(tsk, address, tmp, error_code & PAGE_RW);
 }
 
 /*
@@ -906,6 +1118,17 @@ asmlinkage void do_page_fault(struct pt_regs *regs, unsigned long error_code)
 			do_no_page(error_code, address, current, user_esp);
 		return;
 	}
+	/* vmalloc() sets its page tables up in swapper_pg_dir only */
+	if (!(error_code & PAGE_PRESENT)) {
+		unsigned long * pg_dir, dindex = address >> 22;
+
+		__asm__("movl %%cr3,%0":"=r" (pg_dir));
+		if (!(pg_dir[dindex] & PAGE_PRESENT) &&
+		    (swapper_pg_dir[dindex] & PAGE_PRESENT)) {
+			pg_dir[dindex] = swapper_pg_dir[dindex];
+			return;
+		}
+	}
 	address -= TASK_SIZE;
 	if (wp_works_ok < 0 && address == 0 && (error_code & PAGE_PRESENT)) {
 		wp_works_ok = 1;
@@ -934,7 +1157,8 @@ asmlinkage void do_page_fault(struct pt_regs *regs, unsigned long error_code)
  * to point to BAD_PAGE entries.
  *
  * ZERO_PAGE is a special page that is used for zero-initialized
- * data and COW.
+ * data and COW. It is cleared once, in paging_init(), and never
+ * written after that: it is only ever mapped read-only.
  */
 unsigned long __bad_pagetable(void)
 {
@@ -960,26 +1184,19 @@ unsigned long __bad_page(void)
 	return (unsigned long) empty_bad_page;
 }
 
-unsigned long __zero_page(void)
-{
-	extern char empty_zero_page[PAGE_SIZE];
-
-	__asm__ __volatile__("cld ; rep ; stosl":
-		:"a" (0),
-		 "D" ((long) empty_zero_page),
-		 "c" (PTRS_PER_PAGE)
-		);
-	return (unsigned long) empty_zero_page;
-}
-
 void show_mem(void)
 {
 	int i,free = 0,total = 0,reserved = 0;
 	int shared = 0;
+	unsigned long counts[NR_MEM_LISTS];
 
 	printk("Mem-info:\n");
 	printk("Free pages:      %6dkB\n",nr_free_pages<<(PAGE_SHIFT-10));
-	printk("Secondary pages: %6dkB\n",nr_secondary_pages<<(PAGE_SHIFT-10));
+	free_area_counts(counts);
+	printk("Free areas:     ");
+	for (i = 0 ; i < NR_MEM_LISTS ; i++)
+		printk(" %lu*%lukB", counts[i], PAGE_SIZE >> (10 - i));
+	printk("\n");
 	printk("Free swap:       %6dkB\n",nr_swap_pages<<(PAGE_SHIFT-10));
 	i = high_memory >> PAGE_SHIFT;
 	while (i-- > 0) {
@@ -1000,7 +1217,9 @@ void show_mem(void)
 
 /*
  * paging_init() sets up the page tables - note that the first 4MB are
- * already mapped by head.S.
+ * already mapped by head.S. On a CPU with PSE the rest of memory is
+ * mapped with 4MB pages where a whole one fits, which saves the page
+ * tables and, more to the point, most of the kernel's TLB misses.
  *
  * This routines also unmaps the page at virtual kernel address 0, so
  * that we can trap those pesky NULL-reference errors in the kernel.
@@ -1021,10 +1240,27 @@ unsigned long paging_init(unsigned long start_mem, unsigned long end_mem)
 #if 0
 	memset((void *) 0, 0, PAGE_SIZE);
 #endif
+	/* start_kernel() has copied the boot parameters out by now */
+	memset(empty_zero_page, 0, PAGE_SIZE);
 	start_mem = PAGE_ALIGN(start_mem);
+	if (x86_capability & X86_FEATURE_PSE) {
+		/* set CR4.PSE: "movl %cr4,%eax" and back, which gas doesn't know */
+		__asm__ __volatile__(".byte 0x0f,0x20,0xe0\n\t"
+			"orl $0x10,%%eax\n\t"
+			".byte 0x0f,0x22,0xe0"
+			: : :"ax");
+		pse_works_ok = 1;
+	}
 	address = 0;
 	pg_dir = swapper_pg_dir;
 	while (address < end_mem) {
+		if (pse_works_ok && !*(pg_dir + 768) && address + LARGE_PAGE_SIZE <= end_mem) {
+			tmp = address | PAGE_SHARED | PAGE_4M;
+			*(pg_dir + 768) = tmp;
+			*pg_dir++ = tmp;
+			address += LARGE_PAGE_SIZE;
+			continue;
+		}
 		tmp = *(pg_dir + 768);		/* at virtual addr 0xC0000000 */
 		if (!tmp) {
 			tmp = start_mem | PAGE_TABLE;
@@ -1067,6 +1303,8 @@ void mem_init(unsigned long start_low_mem,
 	start_mem = (unsigned long) p;
 	while (p > mem_map)
 		*--p = MAP_PAGE_RESERVED;
+	start_mem = rmap_area_init(start_mem, end_mem);
+	start_mem = free_area_init(start_mem, end_mem);
 	start_low_mem = PAGE_ALIGN(start_low_mem);
 	start_mem = PAGE_ALIGN(start_mem);
 	while (start_low_mem < 0xA0000) {
@@ -1080,7 +1318,6 @@ void mem_init(unsigned long start_low_mem,
 #ifdef CONFIG_SOUND
 	sound_mem_init();
 #endif
-	free_page_list = 0;
 	nr_free_pages = 0;
 	for (tmp = 0 ; tmp < end_mem ; tmp += PAGE_SIZE) {
 		if (mem_map[MAP_NR(tmp)]) {
@@ -1092,9 +1329,8 @@ void mem_init(unsigned long start_low_mem,
 				datapages++;
 			continue;
 		}
-		*(unsigned long *) tmp = free_page_list;
-		free_page_list = tmp;
-		nr_free_pages++;
+		mem_map[MAP_NR(tmp)] = 1;
+		free_page(tmp);
 	}
 	tmp = nr_free_pages << PAGE_SHIFT;
 	printk("Memory: %luk/%luk available (%dk kernel code, %dk reserved, %dk data)\n",
@@ -1141,42 +1377,40 @@ void si_meminfo(struct sysinfo *val)
 }
 
 
-/* This handles a generic mmap of a disk file */
+/*
+ * This handles a generic mmap of a disk file. The page comes from the
+ * page cache and is mapped read-only, so writes fault again and get a
+ * private copy; a write fault on an absent page copies right away.
+ */
 void file_mmap_nopage(int error_code, struct vm_area_struct * area, unsigned long address)
 {
 	struct inode * inode = area->vm_inode;
-	unsigned int block;
-	unsigned long page;
-	int nr[8];
-	int i, j;
+	unsigned long offset;
+	unsigned long page, newpage;
 	int prot = area->vm_page_prot;
 
 	address &= PAGE_MASK;
-	block = address - area->vm_start + area->vm_offset;
-	block >>= inode->i_sb->s_blocksize_bits;
+	offset = address - area->vm_start + area->vm_offset;
 
-	page = get_free_page(GFP_KERNEL);
-	if (share_page(area, area->vm_task, inode, address, error_code, page)) {
+	if ((page = find_page(inode, offset)) != 0)
 		++area->vm_task->min_flt;
-		return;
+	else {
+		++area->vm_task->maj_flt;
+		page = read_cached_page(inode, offset);
+	}
+	if (page && (error_code & PAGE_RW)) {
+		newpage = __get_free_page(GFP_KERNEL);
+		if (newpage)
+			copy_page(page,newpage);
+		free_page(page);
+		page = newpage;
+		prot |= PAGE_RW | PAGE_DIRTY;
 	}
-
-	++area->vm_task->maj_flt;
 	if (!page) {
 		oom(current);
 		put_page(area->vm_task, BAD_PAGE, address, PAGE_PRIVATE);
 		return;
 	}
-	for (i=0, j=0; i< PAGE_SIZE ; j++, block++, i += inode->i_sb->s_blocksize)
-		nr[j] = bmap(inode,block);
-	if (error_code & PAGE_RW)
-		prot |= PAGE_RW | PAGE_DIRTY;
-	page = bread_page(page, inode->i_dev, nr, inode->i_sb->s_blocksize, prot);
-
-	if (!(prot & PAGE_RW)) {
-		if (share_page(area, area->vm_task, inode, address, error_code, page))
-			return;
-	}
 	if (put_page(area->vm_task,page,address,prot))
 		return;
 	free_page(page);
@@ -19,6 +19,8 @@
 static int anon_map(struct inode *, struct file *,
 		    unsigned long, size_t, int,
 		    unsigned long);
+static void avl_insert(struct vm_area_struct *, struct vm_area_struct **);
+static void avl_remove(struct vm_area_struct *, struct vm_area_struct **);
 /*
  * description of effects of mapping type and prot in current implementation.
  * this is due to the current handling of page faults in memory.c. the expected
@@ -85,17 +87,12 @@ int do_mmap(struct file * file, unsigned long addr, unsigned long len,
 
 		/* Maybe this works.. Ugly it is. */
 		addr = SHM_RANGE_START;
-		while (addr+len < SHM_RANGE_END) {
-			for (vmm = current->mmap ; vmm ; vmm = vmm->vm_next) {
-				if (addr >= vmm->vm_end)
-					continue;
-				if (addr + len <= vmm->vm_start)
-					continue;
-				addr = PAGE_ALIGN(vmm->vm_end);
+		for (vmm = find_vma(current, addr); vmm; vmm = vmm->vm_next) {
+			if (addr+len >= SHM_RANGE_END)
 				break;
-			}
-			if (!vmm)
+			if (addr + len <= vmm->vm_start)
 				break;
+			addr = PAGE_ALIGN(vmm->vm_end);
 		}
 		if (addr+len >= SHM_RANGE_END)
 			return -ENOMEM;
@@ -209,7 +206,7 @@ void unmap_fixup(struct vm_area_struct *area,
 	if (addr > area->vm_start && end < area->vm_end)
 	{
 		/* Add end mapping -- leave beginning for below */
-		mpnt = (struct vm_area_struct *)kmalloc(sizeof(*mpnt), GFP_KERNEL);
+		mpnt = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 
 		*mpnt = *area;
 		mpnt->vm_offset += (end - area->vm_start);
@@ -221,7 +218,7 @@ void unmap_fixup(struct vm_area_struct *area,
 	}
 
 	/* construct whatever mapping is needed */
-	mpnt = (struct vm_area_struct *)kmalloc(sizeof(*mpnt), GFP_KERNEL);
+	mpnt = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 	*mpnt = *area;
 	insert_vm_struct(current, mpnt);
 }
@@ -245,7 +242,7 @@ asmlinkage int sys_munmap(unsigned long addr, size_t len)
  */
 int do_munmap(unsigned long addr, size_t len)
 {
-	struct vm_area_struct *mpnt, **npp, *free;
+	struct vm_area_struct *mpnt, *prev, **npp, *free;
 
 	if ((addr & ~PAGE_MASK) || addr > TASK_SIZE || len > TASK_SIZE-addr)
 		return -EINVAL;
@@ -259,25 +256,19 @@ int do_munmap(unsigned long addr, size_t len)
 	 * every area affected in some way (by any overlap) is put
 	 * on the list.  If nothing is put on, nothing is affected.
 	 */
-	npp = &current->mmap;
+	mpnt = find_vma_prev(current, addr, &prev);
+	npp = prev ? &prev->vm_next : &current->mmap;
 	free = NULL;
-	for (mpnt = *npp; mpnt != NULL; mpnt = *npp) {
-		unsigned long end = addr+len;
-
-		if ((addr < mpnt->vm_start && end <= mpnt->vm_start) ||
-		    (addr >= mpnt->vm_end && end > mpnt->vm_end))
-		{
-			npp = &mpnt->vm_next;
-			continue;
-		}
-
+	for ( ; mpnt != NULL && mpnt->vm_start < addr+len; mpnt = *npp) {
 		*npp = mpnt->vm_next;
 		mpnt->vm_next = free;
 		free = mpnt;
+		avl_remove(mpnt, &current->mmap_avl);
 	}
 
 	if (free == NULL)
 		return 0;
+	current->mmap_cache = NULL;
 
 	/*
 	 * Ok - we have the memory areas we should free on the 'free' list,
@@ -300,7 +291,7 @@ int do_munmap(unsigned long addr, size_t len)
 		else
 			unmap_fixup(mpnt, st, end-st);
 
-		kfree(mpnt);
+		kmem_cache_free(vm_area_cachep, mpnt);
 	}
 
 	unmap_page_range(addr, len);
@@ -331,7 +322,7 @@ int generic_mmap(struct inode * inode, struct file * file,
 	}
 	brelse(bh);
 
-	mpnt = (struct vm_area_struct * ) kmalloc(sizeof(struct vm_area_struct), GFP_KERNEL);
+	mpnt = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 	if (!mpnt)
 		return -ENOMEM;
 
@@ -346,58 +337,269 @@ int generic_mmap(struct inode * inode, struct file * file,
 	mpnt->vm_offset = off;
 	mpnt->vm_ops = &file_mmap;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, NULL, NULL);
+	merge_segments(current, addr, addr + len, NULL, NULL);
 	
 	return 0;
 }
 
 /*
- * Insert vm structure into process list
+ * The areas of a task are kept both on the sorted mmap list, which is
+ * what everything walking the whole address space uses, and in an AVL
+ * tree keyed by vm_end, so that finding the area of an address doesn't
+ * have to walk the list. Areas never overlap, so vm_end orders them the
+ * same way vm_start does, and the stack can grow down without the tree
+ * noticing.
+ */
+#define avl_maxheight	41	/* enough for any number of areas */
+#define heightof(tree)	((tree) == NULL ? 0 : (tree)->vm_avl_height)
+
+/*
+ * Find the first area that ends above addr. It may not contain addr:
+ * the caller has to check vm_start.
+ */
+struct vm_area_struct * find_vma(struct task_struct * task, unsigned long addr)
+{
+	struct vm_area_struct * result = NULL, * tree;
+
+	tree = task->mmap_cache;
+	if (tree && tree->vm_end > addr && tree->vm_start <= addr)
+		return tree;
+	for (tree = task->mmap_avl; tree; ) {
+		if (tree->vm_end > addr) {
+			result = tree;
+			if (tree->vm_start <= addr)
+				break;
+			tree = tree->vm_avl_left;
+		} else
+			tree = tree->vm_avl_right;
+	}
+	if (result)
+		task->mmap_cache = result;
+	return result;
+}
+
+/*
+ * As find_vma(), but also return the area before it, which the list
+ * being singly linked can't give us.
+ */
+struct vm_area_struct * find_vma_prev(struct task_struct * task, unsigned long addr,
+				      struct vm_area_struct ** pprev)
+{
+	struct vm_area_struct * result = NULL, * prev = NULL, * tree;
+
+	for (tree = task->mmap_avl; tree; ) {
+		if (tree->vm_end > addr) {
+			result = tree;
+			tree = tree->vm_avl_left;
+		} else {
+			prev = tree;
+			tree = tree->vm_avl_right;
+		}
+	}
+	*pprev = prev;
+	return result;
+}
+
+/*
+ * Walk back up a path, nodeplaces_ptr pointing just past its last
+ * entry, fixing heights and rotating where the two sides differ by two.
+ */
+static void avl_rebalance(struct vm_area_struct *** nodeplaces_ptr, int count)
+{
+	for ( ; count > 0 ; count--) {
+		struct vm_area_struct ** nodeplace = *--nodeplaces_ptr;
+		struct vm_area_struct * node = *nodeplace;
+		struct vm_area_struct * nodeleft = node->vm_avl_left;
+		struct vm_area_struct * noderight = node->vm_avl_right;
+		int heightleft = heightof(nodeleft);
+		int heightright = heightof(noderight);
+
+		if (heightright + 1 < heightleft) {
+			struct vm_area_struct * nodeleftleft = nodeleft->vm_avl_left;
+			struct vm_area_struct * nodeleftright = nodeleft->vm_avl_right;
+			int heightleftright = heightof(nodeleftright);
+
+			if (heightof(nodeleftleft) >= heightleftright) {
+				node->vm_avl_left = nodeleftright;
+				nodeleft->vm_avl_right = node;
+				node->vm_avl_height = 1 + heightleftright;
+				nodeleft->vm_avl_height = 2 + heightleftright;
+				*nodeplace = nodeleft;
+			} else {
+				nodeleft->vm_avl_right = nodeleftright->vm_avl_left;
+				node->vm_avl_left = nodeleftright->vm_avl_right;
+				nodeleftright->vm_avl_left = nodeleft;
+				nodeleftright->vm_avl_right = node;
+				nodeleft->vm_avl_height = node->vm_avl_height = heightleftright;
+				nodeleftright->vm_avl_height = heightleft;
+				*nodeplace = nodeleftright;
+			}
+		} else if (heightleft + 1 < heightright) {
+			struct vm_area_struct * noderightright = noderight->vm_avl_right;
+			struct vm_area_struct * noderightleft = noderight->vm_avl_left;
+			int heightrightleft = heightof(noderightleft);
+
+			if (heightof(noderightright) >= heightrightleft) {
+				node->vm_avl_right = noderightleft;
+				noderight->vm_avl_left = node;
+				node->vm_avl_height = 1 + heightrightleft;
+				noderight->vm_avl_height = 2 + heightrightleft;
+				*nodeplace = noderight;
+			} else {
+				noderight->vm_avl_left = noderightleft->vm_avl_right;
+				node->vm_avl_right = noderightleft->vm_avl_left;
+				noderightleft->vm_avl_right = noderight;
+				noderightleft->vm_avl_left = node;
+				noderight->vm_avl_height = node->vm_avl_height = heightrightleft;
+				noderightleft->vm_avl_height = heightright;
+				*nodeplace = noderightleft;
+			}
+		} else {
+			int height = (heightleft < heightright ? heightright : heightleft) + 1;
+
+			if (height == node->vm_avl_height)
+				break;
+			node->vm_avl_height = height;
+		}
+	}
+}
+
+static void avl_insert(struct vm_area_struct * new, struct vm_area_struct ** ptree)
+{
+	struct vm_area_struct ** nodeplace = ptree;
+	struct vm_area_struct ** stack[avl_maxheight];
+	struct vm_area_struct *** stack_ptr = stack;
+	int stack_count = 0;
+
+	while (*nodeplace) {
+		struct vm_area_struct * node = *nodeplace;
+
+		*stack_ptr++ = nodeplace;
+		stack_count++;
+		if (new->vm_end < node->vm_end)
+			nodeplace = &node->vm_avl_left;
+		else
+			nodeplace = &node->vm_avl_right;
+	}
+	new->vm_avl_left = NULL;
+	new->vm_avl_right = NULL;
+	new->vm_avl_height = 1;
+	*nodeplace = new;
+	avl_rebalance(stack_ptr, stack_count);
+}
+
+static void avl_remove(struct vm_area_struct * node_to_delete, struct vm_area_struct ** ptree)
+{
+	struct vm_area_struct ** nodeplace = ptree;
+	struct vm_area_struct ** nodeplace_to_delete;
+	struct vm_area_struct ** stack[avl_maxheight];
+	struct vm_area_struct *** stack_ptr = stack;
+	int stack_count = 0;
+
+	for (;;) {
+		struct vm_area_struct * node = *nodeplace;
+
+		if (!node) {
+			printk("avl_remove: area %lx-%lx not in tree\n",
+			       node_to_delete->vm_start, node_to_delete->vm_end);
+			return;
+		}
+		*stack_ptr++ = nodeplace;
+		stack_count++;
+		if (node == node_to_delete)
+			break;
+		if (node_to_delete->vm_end < node->vm_end)
+			nodeplace = &node->vm_avl_left;
+		else
+			nodeplace = &node->vm_avl_right;
+	}
+	nodeplace_to_delete = nodeplace;
+	if (!node_to_delete->vm_avl_left) {
+		*nodeplace_to_delete = node_to_delete->vm_avl_right;
+		stack_ptr--;
+		stack_count--;
+	} else {
+		/* replace it with the rightmost node of its left subtree */
+		struct vm_area_struct *** stack_ptr_to_delete = stack_ptr;
+		struct vm_area_struct * node;
+
+		nodeplace = &node_to_delete->vm_avl_left;
+		while ((node = *nodeplace)->vm_avl_right) {
+			*stack_ptr++ = nodeplace;
+			stack_count++;
+			nodeplace = &node->vm_avl_right;
+		}
+		*nodeplace = node->vm_avl_left;
+		node->vm_avl_left = node_to_delete->vm_avl_left;
+		node->vm_avl_right = node_to_delete->vm_avl_right;
+		node->vm_avl_height = node_to_delete->vm_avl_height;
+		*nodeplace_to_delete = node;
+		*stack_ptr_to_delete = &node->vm_avl_left;
+	}
+	avl_rebalance(stack_ptr, stack_count);
+}
+
+/*
+ * Build the tree from the list, for a task whose list was set up
+ * directly (fork).
+ */
+void build_mmap_avl(struct task_struct * task)
+{
+	struct vm_area_struct * vma;
+
+	task->mmap_avl = NULL;
+	task->mmap_cache = NULL;
+	for (vma = task->mmap; vma; vma = vma->vm_next)
+		avl_insert(vma, &task->mmap_avl);
+}
+
+/*
+ * Insert vm structure into process list and tree
  * This makes sure the list is sorted by start address, and
  * some some simple overlap checking.
  * JSGF
  */
 void insert_vm_struct(struct task_struct *t, struct vm_area_struct *vmp)
 {
-	struct vm_area_struct **nxtpp, *mpnt;
+	struct vm_area_struct *prev, *next;
 
-	nxtpp = &t->mmap;
-	
-	for(mpnt = t->mmap; mpnt != NULL; mpnt = mpnt->vm_next)
-	{
-		if (mpnt->vm_start > vmp->vm_start)
-			break;
-		nxtpp = &mpnt->vm_next;
-
-		if ((vmp->vm_start >= mpnt->vm_start &&
-		     vmp->vm_start < mpnt->vm_end) ||
-		    (vmp->vm_end >= mpnt->vm_start &&
-		     vmp->vm_end < mpnt->vm_end))
-			printk("insert_vm_struct: ins area %lx-%lx in area %lx-%lx\n",
-			       vmp->vm_start, vmp->vm_end,
-			       mpnt->vm_start, vmp->vm_end);
+	next = find_vma_prev(t, vmp->vm_end - 1, &prev);
+	if ((prev && prev->vm_end > vmp->vm_start) ||
+	    (next && next->vm_start < vmp->vm_end))
+		printk("insert_vm_struct: ins area %lx-%lx overlaps area %lx-%lx\n",
+		       vmp->vm_start, vmp->vm_end,
+		       next ? next->vm_start : prev->vm_start,
+		       next ? next->vm_end : prev->vm_end);
+	if (prev) {
+		vmp->vm_next = prev->vm_next;
+		prev->vm_next = vmp;
+	} else {
+		vmp->vm_next = t->mmap;
+		t->mmap = vmp;
 	}
-	
-	vmp->vm_next = mpnt;
-
-	*nxtpp = vmp;
+	avl_insert(vmp, &t->mmap_avl);
 }
 
 /*
- * Merge a list of memory segments if possible.
+ * Merge the areas of a task around start_addr..end_addr if possible.
  * Redundant vm_area_structs are freed.
  * This assumes that the list is ordered by address.
  */
-void merge_segments(struct vm_area_struct *mpnt,
+void merge_segments(struct task_struct *task,
+		    unsigned long start_addr, unsigned long end_addr,
 		    map_mergep_fnp mergep, void *mpd)
 {
-	struct vm_area_struct *prev, *next;
+	struct vm_area_struct *prev, *mpnt, *next;
+
+	mpnt = find_vma_prev(task, start_addr, &prev);
+	if (prev == NULL) {
+		if (mpnt == NULL)
+			return;
+		prev = mpnt;
+		mpnt = mpnt->vm_next;
+	}
 
-	if (mpnt == NULL)
-		return;
-	
-	for(prev = mpnt, mpnt = mpnt->vm_next;
-	    mpnt != NULL;
+	for( ; mpnt != NULL && prev->vm_end <= end_addr;
 	    prev = mpnt, mpnt = next)
 	{
 		int mp;
@@ -429,11 +631,15 @@ void merge_segments(struct vm_area_struct *mpnt,
 		/*
 		 * merge prev with mpnt and set up pointers so the new
 		 * big segment can possibly merge with the next one.
-		 * The old unused mpnt is freed.
+		 * The old unused mpnt is freed. Taking it out of the
+		 * tree first lets prev's key grow in place.
 		 */
+		avl_remove(mpnt, &task->mmap_avl);
 		prev->vm_end = mpnt->vm_end;
 		prev->vm_next = mpnt->vm_next;
-		kfree_s(mpnt, sizeof(*mpnt));
+		if (task->mmap_cache == mpnt)
+			task->mmap_cache = prev;
+		kmem_cache_free(vm_area_cachep, mpnt);
 		mpnt = prev;
 	}
 }
@@ -451,7 +657,7 @@ static int anon_map(struct inode *ino, struct file * file,
 	if (zeromap_page_range(addr, len, mask))
 		return -ENOMEM;
 
-	mpnt = (struct vm_area_struct * ) kmalloc(sizeof(struct vm_area_struct), GFP_KERNEL);
+	mpnt = (struct vm_area_struct *) kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 	if (!mpnt)
 		return -ENOMEM;
 
@@ -464,7 +670,7 @@ static int anon_map(struct inode *ino, struct file * file,
 	mpnt->vm_offset = 0;
 	mpnt->vm_ops = NULL;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, ignoff_mergep, NULL);
+	merge_segments(current, addr, addr + len, ignoff_mergep, NULL);
 
 	return 0;
 }
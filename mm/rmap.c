@@ -0,0 +1,154 @@
+/*
+ *  linux/mm/rmap.c
+ *
+ * Reverse mapping of user pages. mem_rmap[] sits next to mem_map[] and
+ * keeps, for every page of memory, a chain of the page table entries
+ * that map it, so that reclaim can find and unmap a page from its
+ * physical address instead of walking the page tables of every task.
+ * An entry is the address of the page table entry itself, so it stays
+ * right while a page table is shared between tasks after fork.
+ *
+ * For a page that holds a page table, mem_rmap[] records the task whose
+ * rss the pages mapped through it count against.
+ *
+ * Adding an entry never sleeps: if there is no memory for it the page
+ * simply isn't fully reverse mapped, and reclaim leaves it alone (see
+ * try_to_reclaim() in swap.c). Swap slots are chained the same way, so
+ * that swapoff finds the entries holding a slot without a page table
+ * walk.
+ *
+ * Pages mapped by remap_page_range() and shared memory segments aren't
+ * ours to reclaim. Neither remap_page_range() nor shm adds them, and
+ * copy_one_table() only chains the copy at fork of an entry that is
+ * itself chained, so they stay out of the map.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/malloc.h>
+#include <linux/string.h>
+
+struct mem_rmap * mem_rmap = NULL;
+static struct kmem_cache * pte_chain_cachep = NULL;
+
+/*
+ * Chains are also kept for swap slots, see swap_add_rmap() in swap.c.
+ * Returns 0 if there was no memory for the entry.
+ */
+int pte_chain_add(struct pte_chain ** chain, unsigned long * ptep)
+{
+	struct pte_chain * pc;
+
+	pc = (struct pte_chain *) kmem_cache_alloc(pte_chain_cachep, GFP_ATOMIC);
+	if (!pc)
+		return 0;
+	pc->ptep = ptep;
+	pc->next = *chain;
+	*chain = pc;
+	return 1;
+}
+
+void pte_chain_remove(struct pte_chain ** chain, unsigned long * ptep)
+{
+	struct pte_chain ** pp, * pc;
+
+	for (pp = chain; (pc = *pp) != NULL; pp = &pc->next) {
+		if (pc->ptep == ptep) {
+			*pp = pc->next;
+			kmem_cache_free(pte_chain_cachep, pc);
+			return;
+		}
+	}
+}
+
+void page_add_rmap(unsigned long page, unsigned long * ptep)
+{
+	struct mem_rmap * rmap;
+
+	if (page >= high_memory || !pte_chain_cachep)
+		return;
+	if (mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED)
+		return;
+	rmap = mem_rmap + MAP_NR(page);
+	if (!rmap->chain)
+		rmap->age = PAGE_AGE_START;
+	pte_chain_add(&rmap->chain, ptep);
+}
+
+void page_remove_rmap(unsigned long page, unsigned long * ptep)
+{
+	if (page >= high_memory)
+		return;
+	pte_chain_remove(&mem_rmap[MAP_NR(page)].chain, ptep);
+}
+
+/*
+ * Is "ptep" on the chain of the page it maps?
+ */
+int page_rmap_mapped(unsigned long page, unsigned long * ptep)
+{
+	struct pte_chain * pc;
+
+	if (page >= high_memory || !mem_rmap)
+		return 0;
+	for (pc = mem_rmap[MAP_NR(page)].chain; pc; pc = pc->next)
+		if (pc->ptep == ptep)
+			return 1;
+	return 0;
+}
+
+/*
+ * Count the entries that map a page, dropping any that no longer do.
+ */
+int page_rmap_count(unsigned long page)
+{
+	struct pte_chain ** pp, * pc;
+	int n = 0;
+
+	page &= PAGE_MASK;
+	for (pp = &mem_rmap[MAP_NR(page)].chain; (pc = *pp) != NULL; ) {
+		if ((*pc->ptep & (PAGE_MASK | PAGE_PRESENT)) != (page | PAGE_PRESENT)) {
+			printk("page_rmap_count: stale entry %p for page %08lx\n",
+				pc->ptep, page);
+			*pp = pc->next;
+			kmem_cache_free(pte_chain_cachep, pc);
+			continue;
+		}
+		n++;
+		pp = &pc->next;
+	}
+	return n;
+}
+
+/*
+ * A task is letting go of a page table that others still use (it exits
+ * or execs with the page directory or the table shared): stop counting
+ * the pages against it.
+ */
+void disown_page_table(unsigned long pg_table, struct task_struct * tsk)
+{
+	if (pg_table >= high_memory || !mem_rmap)
+		return;
+	if (mem_rmap[MAP_NR(pg_table)].owner == tsk)
+		mem_rmap[MAP_NR(pg_table)].owner = NULL;
+}
+
+void rmap_init(void)
+{
+	pte_chain_cachep = kmem_cache_create("pte_chain", sizeof(struct pte_chain), 0, NULL);
+	if (!pte_chain_cachep)
+		panic("rmap_init: cannot create pte_chain cache");
+}
+
+/*
+ * mem_rmap[] is carved out of start_mem right after mem_map[].
+ */
+unsigned long rmap_area_init(unsigned long start_mem, unsigned long end_mem)
+{
+	unsigned long size = MAP_NR(end_mem) * sizeof(struct mem_rmap);
+
+	mem_rmap = (struct mem_rmap *) start_mem;
+	memset(mem_rmap, 0, size);
+	return start_mem + size;
+}
@@ -0,0 +1,306 @@
+/*
+ *  linux/mm/slab.c
+ *
+ * Object caches on top of the page allocator. A cache hands out objects
+ * of one fixed size from whole pages ("slabs"). Each slab keeps its free
+ * objects on a small index list in the slab header at the start of the
+ * page, so allocating and freeing are O(1) and don't need the per-object
+ * headers kmalloc uses. An optional constructor is run once when a slab
+ * is set up, not on every allocation, so objects should be freed back in
+ * their constructed state.
+ *
+ * The space a slab can't use for objects is spread over the slabs as a
+ * varying start offset ("colour"), so the same field of objects in
+ * different slabs doesn't always hit the same cache lines.
+ */
+
+#include <linux/mm.h>
+#include <linux/malloc.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <asm/system.h>
+
+#define SLAB_END	0xffff
+#define L1_CACHE_BYTES	16
+
+struct kmem_slab {
+	struct kmem_slab * next, * prev;	/* slabs with free objects */
+	struct kmem_cache * cache;
+	char * s_mem;			/* first object */
+	unsigned short inuse;
+	unsigned short free;		/* first free object or SLAB_END */
+	unsigned short bufctl[0];	/* next free object after each free one */
+};
+
+struct kmem_cache {
+	const char * name;
+	int size;			/* object size, rounded to the alignment */
+	int num;			/* objects per slab */
+	int offset;			/* first object, without colour */
+	int colour_off;
+	int colour;			/* number of colours */
+	int colour_next;
+	void (*ctor)(void *);
+	struct kmem_slab * slabs;	/* partial slabs first, empty ones last */
+	int nr_slabs;
+	int nr_empty;
+	int nr_active;
+	unsigned long nallocs;
+	unsigned long nfrees;
+	struct kmem_cache * next;
+};
+
+#define SLAB_HDR(num,align) \
+(((sizeof(struct kmem_slab) + (num) * sizeof(unsigned short)) + (align) - 1) & ~((align) - 1))
+
+static struct kmem_cache * cache_chain = NULL;
+
+struct kmem_cache * vm_area_cachep = NULL;
+
+/*
+ * The slab list is circular, with cachep->slabs pointing to the first
+ * entry. Slabs that still have objects in use go at the head so they fill
+ * up before empty slabs are touched; empty slabs go at the tail.
+ */
+static inline void slab_unlink(struct kmem_cache * cachep, struct kmem_slab * slabp)
+{
+	if (slabp->next == slabp)
+		cachep->slabs = NULL;
+	else {
+		slabp->next->prev = slabp->prev;
+		slabp->prev->next = slabp->next;
+		if (cachep->slabs == slabp)
+			cachep->slabs = slabp->next;
+	}
+	slabp->next = slabp->prev = NULL;
+}
+
+static inline void slab_link(struct kmem_cache * cachep, struct kmem_slab * slabp, int head)
+{
+	struct kmem_slab * first = cachep->slabs;
+
+	if (!first) {
+		slabp->next = slabp->prev = slabp;
+		cachep->slabs = slabp;
+		return;
+	}
+	slabp->next = first;
+	slabp->prev = first->prev;
+	first->prev->next = slabp;
+	first->prev = slabp;
+	if (head)
+		cachep->slabs = slabp;
+}
+
+struct kmem_cache * kmem_cache_create(const char * name, int size, int align,
+	void (*ctor)(void *))
+{
+	struct kmem_cache * cachep;
+	unsigned long flags;
+	int num, left;
+
+	if (align <= 0)
+		align = sizeof(long);
+	if ((align & (align - 1)) || align > L1_CACHE_BYTES || size <= 0) {
+		printk("kmem_cache_create: bad size %d or alignment %d for %s\n",
+			size, align, name);
+		return NULL;
+	}
+	size = (size + align - 1) & ~(align - 1);
+	num = (PAGE_SIZE - sizeof(struct kmem_slab)) / (size + sizeof(unsigned short));
+	while (num > 0 && SLAB_HDR(num, align) + num * size > PAGE_SIZE)
+		num--;
+	if (num <= 0) {
+		printk("kmem_cache_create: %s objects (%d bytes) don't fit a page\n",
+			name, size);
+		return NULL;
+	}
+	cachep = (struct kmem_cache *) kmalloc(sizeof(*cachep), GFP_KERNEL);
+	if (!cachep)
+		return NULL;
+	left = PAGE_SIZE - SLAB_HDR(num, align) - num * size;
+	cachep->name = name;
+	cachep->size = size;
+	cachep->num = num;
+	cachep->offset = SLAB_HDR(num, align);
+	cachep->colour_off = L1_CACHE_BYTES;
+	cachep->colour = left / L1_CACHE_BYTES + 1;
+	cachep->colour_next = 0;
+	cachep->ctor = ctor;
+	cachep->slabs = NULL;
+	cachep->nr_slabs = 0;
+	cachep->nr_empty = 0;
+	cachep->nr_active = 0;
+	cachep->nallocs = 0;
+	cachep->nfrees = 0;
+	save_flags(flags);
+	cli();
+	cachep->next = cache_chain;
+	cache_chain = cachep;
+	restore_flags(flags);
+	return cachep;
+}
+
+/*
+ * Add an empty slab to the cache. The page is set up with interrupts on;
+ * only the list manipulation is protected.
+ */
+static int kmem_cache_grow(struct kmem_cache * cachep, int priority)
+{
+	struct kmem_slab * slabp;
+	unsigned long flags;
+	char * objp;
+	int i;
+
+	slabp = (struct kmem_slab *) __get_free_page(priority);
+	if (!slabp)
+		return 0;
+	save_flags(flags);
+	cli();
+	i = cachep->colour_next;
+	if (++cachep->colour_next >= cachep->colour)
+		cachep->colour_next = 0;
+	restore_flags(flags);
+	slabp->cache = cachep;
+	slabp->s_mem = (char *) slabp + cachep->offset + i * cachep->colour_off;
+	slabp->inuse = 0;
+	slabp->free = 0;
+	for (i = 0, objp = slabp->s_mem; i < cachep->num; i++, objp += cachep->size) {
+		slabp->bufctl[i] = i + 1;
+		if (cachep->ctor)
+			cachep->ctor(objp);
+	}
+	slabp->bufctl[cachep->num - 1] = SLAB_END;
+	cli();
+	slab_link(cachep, slabp, 0);
+	cachep->nr_slabs++;
+	cachep->nr_empty++;
+	restore_flags(flags);
+	return 1;
+}
+
+void * kmem_cache_alloc(struct kmem_cache * cachep, int priority)
+{
+	struct kmem_slab * slabp;
+	unsigned long flags;
+	void * objp;
+	extern unsigned long intr_count;
+
+	if (intr_count && priority != GFP_ATOMIC) {
+		printk("kmem_cache_alloc(%s) called nonatomically from interrupt\n",
+			cachep->name);
+		priority = GFP_ATOMIC;
+	}
+	save_flags(flags);
+	cli();
+	while (!(slabp = cachep->slabs)) {
+		restore_flags(flags);
+		if (!kmem_cache_grow(cachep, priority))
+			return NULL;
+		cli();
+	}
+	objp = slabp->s_mem + slabp->free * cachep->size;
+	slabp->free = slabp->bufctl[slabp->free];
+	if (!slabp->inuse++)
+		cachep->nr_empty--;
+	if (slabp->free == SLAB_END)
+		slab_unlink(cachep, slabp);
+	cachep->nr_active++;
+	cachep->nallocs++;
+	restore_flags(flags);
+	return objp;
+}
+
+void kmem_cache_free(struct kmem_cache * cachep, void * objp)
+{
+	struct kmem_slab * slabp;
+	unsigned long flags;
+	unsigned int offset, objnr;
+
+	slabp = (struct kmem_slab *) ((unsigned long) objp & PAGE_MASK);
+	offset = (char *) objp - slabp->s_mem;
+	objnr = offset / cachep->size;
+	if (slabp->cache != cachep || objnr >= cachep->num ||
+	    objnr * cachep->size != offset) {
+		printk("kmem_cache_free: %p is not a %s object\n", objp, cachep->name);
+		return;
+	}
+	save_flags(flags);
+	cli();
+	if (slabp->free == SLAB_END)
+		slab_link(cachep, slabp, 1);
+	slabp->bufctl[objnr] = slabp->free;
+	slabp->free = objnr;
+	cachep->nr_active--;
+	cachep->nfrees++;
+	if (!--slabp->inuse) {
+		slab_unlink(cachep, slabp);
+		if (cachep->nr_empty) {
+			cachep->nr_slabs--;
+			restore_flags(flags);
+			free_page((unsigned long) slabp);
+			return;
+		}
+		/* keep one empty slab around to avoid thrashing at a boundary */
+		slab_link(cachep, slabp, 0);
+		cachep->nr_empty++;
+	}
+	restore_flags(flags);
+}
+
+/*
+ * Free all the slabs of a cache and the cache itself. Fails if any
+ * objects are still allocated.
+ */
+int kmem_cache_destroy(struct kmem_cache * cachep)
+{
+	struct kmem_cache ** p;
+	struct kmem_slab * slabp;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (cachep->nr_active) {
+		restore_flags(flags);
+		return -EBUSY;
+	}
+	for (p = &cache_chain; *p; p = &(*p)->next) {
+		if (*p == cachep) {
+			*p = cachep->next;
+			break;
+		}
+	}
+	restore_flags(flags);
+	while ((slabp = cachep->slabs) != NULL) {
+		slab_unlink(cachep, slabp);
+		free_page((unsigned long) slabp);
+	}
+	kfree_s(cachep, sizeof(*cachep));
+	return 0;
+}
+
+void kmem_cache_init(void)
+{
+	vm_area_cachep = kmem_cache_create("vm_area_struct",
+		sizeof(struct vm_area_struct), 0, NULL);
+	if (!vm_area_cachep)
+		panic("kmem_cache_init: cannot create vm_area_struct cache");
+}
+
+int get_slabinfo(char * buffer)
+{
+	struct kmem_cache * cachep;
+	int len;
+
+	len = get_kmalloc_stats(buffer);
+	len += sprintf(buffer+len, "\ncache              size  active  total  slabs     allocs      frees\n");
+	for (cachep = cache_chain; cachep; cachep = cachep->next) {
+		len += sprintf(buffer+len, "%-16s %6d %7d %6d %6d %10lu %10lu\n",
+			cachep->name, cachep->size, cachep->nr_active,
+			cachep->nr_slabs * cachep->num, cachep->nr_slabs,
+			cachep->nallocs, cachep->nfrees);
+		if (len > PAGE_SIZE - 80)
+			break;
+	}
+	return len;
+}
@@ -17,9 +17,11 @@
 #include <linux/errno.h>
 #include <linux/string.h>
 #include <linux/stat.h>
+#include <linux/locks.h>
 
 #include <asm/system.h> /* for cli()/sti() */
 #include <asm/bitops.h>
+#include <asm/dma.h>
 
 #define MAX_SWAPFILES 8
 
@@ -33,27 +35,54 @@
 static int nr_swapfiles = 0;
 static struct wait_queue * lock_queue = NULL;
 
+struct vm_stat vmstat;
+
 static struct swap_info_struct {
 	unsigned long flags;
 	struct inode * swap_file;
 	unsigned int swap_device;
 	unsigned char * swap_map;
 	unsigned char * swap_lockmap;
+	unsigned long * swap_cache;	/* cached page of each slot, or 0 */
+	struct pte_chain ** swap_rmap;	/* entries holding each slot */
+	int rmap_lost;			/* some entry couldn't be chained */
 	int pages;
 	int lowest_bit;
 	int highest_bit;
+	int cluster_next;		/* next slot of the current cluster */
+	int cluster_nr;			/* slots left in the current cluster */
 	unsigned long max;
 } swap_info[MAX_SWAPFILES];
 
-extern unsigned long free_page_list;
 extern int shm_swap (int);
+extern int *blksize_size[];
 
 /*
- * The following are used to make sure we don't thrash too much...
- * NOTE!! NR_LAST_FREE_PAGES must be a power of 2...
+ * Swap slots are handed out SWAP_CLUSTER at a time from a free run, so
+ * pages that are evicted together also sit together on disk. Dirty pages
+ * found by one swap_out() pass are collected in a swap_batch of up to
+ * SWAP_BATCH pages and written with one ll_rw_block() call, which lets
+ * the block layer merge consecutive slots into a few large requests.
  */
-#define NR_LAST_FREE_PAGES 32
-static unsigned long last_free_pages[NR_LAST_FREE_PAGES] = {0,};
+#define SWAP_CLUSTER	32
+#define SWAP_BATCH	16
+#define NR_SWAP_BH	(SWAP_BATCH * PAGE_SIZE / BLOCK_SIZE)
+
+struct swap_batch {
+	int nr;
+	unsigned long entry[SWAP_BATCH];
+	unsigned long page[SWAP_BATCH];
+	char ok[SWAP_BATCH];
+};
+
+/* buffer heads used to describe a batch to ll_rw_block(), one user at a time */
+static struct buffer_head swap_bh[NR_SWAP_BH];
+static struct buffer_head * swap_bh_list[NR_SWAP_BH];
+static unsigned char swap_bh_page[NR_SWAP_BH];	/* batch index of each */
+static int swap_bh_busy = 0;
+static struct wait_queue * swap_bh_wait = NULL;
+
+static void swap_batch_io(int rw, struct swap_batch * batch);
 
 void rw_swap_page(int rw, unsigned long entry, char * buf)
 {
@@ -103,6 +132,57 @@ void rw_swap_page(int rw, unsigned long entry, char * buf)
 	wake_up(&lock_queue);
 }
 
+/*
+ * Take the next slot of the current cluster if there is one. Otherwise
+ * look for a run of SWAP_CLUSTER free slots from lowest_bit and start a
+ * new cluster there, and only when no such run is left fall back to the
+ * first free slot. The scan is paid once per cluster, not once per page.
+ */
+static inline unsigned int scan_swap_map(struct swap_info_struct * p)
+{
+	unsigned int offset, run;
+
+	if (p->cluster_nr) {
+		while (p->cluster_next <= p->highest_bit) {
+			offset = p->cluster_next++;
+			if (p->swap_map[offset])
+				continue;
+			p->cluster_nr--;
+			goto got_page;
+		}
+	}
+	p->cluster_nr = SWAP_CLUSTER - 1;
+	run = 0;
+	for (offset = p->lowest_bit; offset <= p->highest_bit ; offset++) {
+		if (p->swap_map[offset]) {
+			run = 0;
+			continue;
+		}
+		if (++run < SWAP_CLUSTER)
+			continue;
+		offset -= SWAP_CLUSTER - 1;
+		p->cluster_next = offset + 1;
+		goto got_page;
+	}
+	for (offset = p->lowest_bit; offset <= p->highest_bit ; offset++) {
+		if (p->swap_map[offset])
+			continue;
+		p->cluster_next = offset + 1;
+		goto got_page;
+	}
+	p->cluster_nr = 0;
+	return 0;
+
+got_page:
+	p->swap_map[offset] = 1;
+	nr_swap_pages--;
+	if (offset == p->highest_bit)
+		p->highest_bit--;
+	if (offset == p->lowest_bit)
+		p->lowest_bit++;
+	return offset;
+}
+
 unsigned int get_swap_page(void)
 {
 	struct swap_info_struct * p;
@@ -112,16 +192,8 @@ unsigned int get_swap_page(void)
 	for (type = 0 ; type < nr_swapfiles ; type++,p++) {
 		if ((p->flags & SWP_WRITEOK) != SWP_WRITEOK)
 			continue;
-		for (offset = p->lowest_bit; offset <= p->highest_bit ; offset++) {
-			if (p->swap_map[offset])
-				continue;
-			p->swap_map[offset] = 1;
-			nr_swap_pages--;
-			if (offset == p->highest_bit)
-				p->highest_bit--;
-			p->lowest_bit = offset;
+		if ((offset = scan_swap_map(p)) != 0)
 			return SWP_ENTRY(type,offset);
-		}
 	}
 	return 0;
 }
@@ -194,7 +266,182 @@ void swap_free(unsigned long entry)
 	wake_up(&lock_queue);
 }
 
-void swap_in(unsigned long *table_ptr)
+/*
+ * Chain the page table entries that hold a slot, as rmap.c does for the
+ * entries that map a page. If an entry can't be chained the device is
+ * marked, and swapoff falls back to looking through all page tables.
+ * Shm entries aren't chained: shm finds its own.
+ */
+void swap_add_rmap(unsigned long entry, unsigned long * ptep)
+{
+	struct swap_info_struct * p;
+
+	if (!entry || SWP_TYPE(entry) >= nr_swapfiles)
+		return;
+	p = swap_info + SWP_TYPE(entry);
+	if (!p->swap_rmap || SWP_OFFSET(entry) >= p->max)
+		return;
+	if (!pte_chain_add(p->swap_rmap + SWP_OFFSET(entry), ptep))
+		p->rmap_lost = 1;
+}
+
+void swap_remove_rmap(unsigned long entry, unsigned long * ptep)
+{
+	struct swap_info_struct * p;
+
+	if (!entry || SWP_TYPE(entry) >= nr_swapfiles)
+		return;
+	p = swap_info + SWP_TYPE(entry);
+	if (!p->swap_rmap || SWP_OFFSET(entry) >= p->max)
+		return;
+	pte_chain_remove(p->swap_rmap + SWP_OFFSET(entry), ptep);
+}
+
+/*
+ * The swap cache keeps a page that was read in from swap together with
+ * its slot, for as long as the two hold the same data. The cache holds
+ * one reference to the page and one to the slot. Pages from the cache are
+ * mapped read-only, so the first write goes through do_wp_page(), which
+ * drops the cache entry (or copies the page if others still use it).
+ * Evicting a page that is still clean then costs nothing: its mappings
+ * just get the slot back, with no write.
+ *
+ * It is indexed both ways: p->swap_cache[offset] is the page for a slot,
+ * and mem_rmap[].swap_entry is the slot for a page.
+ */
+#define SWAP_READAHEAD	8	/* slots read per swap-in, must be a power of 2 */
+
+/*
+ * Drop a reference to a slot that nobody can be doing I/O to: one still
+ * referenced by the swap cache is never allocated for writing, and reads
+ * of it come from the cache. Unlike swap_free() this never sleeps.
+ */
+static void swap_release(struct swap_info_struct * p, unsigned long offset)
+{
+	if (!p->swap_map[offset]) {
+		printk("swap_release: swap-space map bad (offset %lu)\n", offset);
+		return;
+	}
+	if (--p->swap_map[offset])
+		return;
+	nr_swap_pages++;
+	if (offset < p->lowest_bit)
+		p->lowest_bit = offset;
+	if (offset > p->highest_bit)
+		p->highest_bit = offset;
+}
+
+static void add_to_swap_cache(unsigned long page, unsigned long entry)
+{
+	struct swap_info_struct * p = swap_info + SWP_TYPE(entry);
+	struct mem_rmap * rmap = mem_rmap + MAP_NR(page);
+
+	p->swap_map[SWP_OFFSET(entry)]++;
+	p->swap_cache[SWP_OFFSET(entry)] = page;
+	mem_map[MAP_NR(page)]++;
+	rmap->swap_entry = entry;
+	rmap->age = PAGE_AGE_START;
+}
+
+/*
+ * Look up the page of a slot and take a reference to it for the caller.
+ */
+static unsigned long lookup_swap_cache(unsigned long entry)
+{
+	unsigned long page;
+
+	page = swap_info[SWP_TYPE(entry)].swap_cache[SWP_OFFSET(entry)];
+	if (page)
+		mem_map[MAP_NR(page)]++;
+	return page;
+}
+
+/*
+ * The page is about to differ from its slot. Any mapping of it that was
+ * clean now has data only the page holds, so it is marked dirty. Never
+ * sleeps.
+ */
+void delete_from_swap_cache(unsigned long page)
+{
+	struct mem_rmap * rmap = mem_rmap + MAP_NR(page);
+	struct swap_info_struct * p;
+	struct pte_chain * pc;
+	unsigned long entry;
+
+	if (!(entry = rmap->swap_entry))
+		return;
+	rmap->swap_entry = 0;
+	for (pc = rmap->chain; pc; pc = pc->next)
+		*pc->ptep |= PAGE_DIRTY;
+	p = swap_info + SWP_TYPE(entry);
+	p->swap_cache[SWP_OFFSET(entry)] = 0;
+	swap_release(p, SWP_OFFSET(entry));
+	free_page(page);
+}
+
+/*
+ * Read a slot and up to SWAP_READAHEAD - 1 of its in-use neighbours in
+ * one request: pages that were swapped out together were given slots
+ * together (see scan_swap_map()), and will likely be wanted together.
+ * The neighbours only go into the swap cache; their pages come from
+ * GFP_BUFFER so readahead never makes us reclaim. Returns the page for
+ * "entry" with a reference for the caller, or 0 if there was no memory.
+ */
+static unsigned long read_swap_cluster(unsigned long entry)
+{
+	struct swap_info_struct * p = swap_info + SWP_TYPE(entry);
+	unsigned long offset = SWP_OFFSET(entry);
+	unsigned long page, i, start;
+	struct swap_batch batch;
+
+	if (!(page = get_free_page(GFP_KERNEL)))
+		return 0;
+	while (set_bit(offset,p->swap_lockmap))
+		sleep_on(&lock_queue);
+	/* somebody else may have read it in, or freed it, while we slept */
+	if (p->swap_cache[offset] || !p->swap_map[offset]) {
+		clear_bit(offset,p->swap_lockmap);
+		wake_up(&lock_queue);
+		free_page(page);
+		return lookup_swap_cache(entry);
+	}
+	batch.nr = 1;
+	batch.entry[0] = entry;
+	batch.page[0] = page;
+	start = offset & ~(SWAP_READAHEAD - 1);
+	if ((p->flags & SWP_WRITEOK) != SWP_WRITEOK)
+		start = p->max;		/* being swapped off */
+	for (i = start ; i < start + SWAP_READAHEAD && i < p->max ; i++) {
+		if (i == offset || !p->swap_map[i] || p->swap_map[i] >= 0x80)
+			continue;
+		if (p->swap_cache[i] || test_bit(i,p->swap_lockmap))
+			continue;
+		if (!(page = __get_free_page(GFP_BUFFER)))
+			break;
+		set_bit(i,p->swap_lockmap);
+		batch.entry[batch.nr] = SWP_ENTRY(SWP_TYPE(entry),i);
+		batch.page[batch.nr++] = page;
+	}
+	swap_batch_io(READ, &batch);
+	for (i = 0 ; i < batch.nr ; i++) {
+		offset = SWP_OFFSET(batch.entry[i]);
+		if (!clear_bit(offset,p->swap_lockmap))
+			printk("read_swap_cluster: lock already cleared\n");
+		if (batch.ok[i] && (p->flags & SWP_WRITEOK) == SWP_WRITEOK)
+			add_to_swap_cache(batch.page[i], batch.entry[i]);
+		if (i)
+			free_page(batch.page[i]);
+	}
+	wake_up(&lock_queue);
+	return batch.page[0];
+}
+
+/*
+ * A page in the swap cache is mapped write-protected, unless this is a
+ * write fault and nobody else uses the page, in which case it is taken
+ * out of the cache and mapped writable right away.
+ */
+void swap_in(unsigned long *table_ptr, int write_access)
 {
 	unsigned long entry;
 	unsigned long page;
@@ -212,56 +459,176 @@ void swap_in(unsigned long *table_ptr)
 		shm_no_page ((unsigned long *) table_ptr);
 		return;
 	}
-	if (!(page = get_free_page(GFP_KERNEL))) {
+	if (SWP_TYPE(entry) >= nr_swapfiles) {
+		printk("swap_in: bad swap-device\n");
+		return;
+	}
+	if (!(page = lookup_swap_cache(entry)) && !(page = read_swap_cluster(entry))) {
+		/* the slot may have been given back while we slept */
+		if (*table_ptr != entry)
+			return;
 		oom(current);
 		page = BAD_PAGE;
-	} else	
-		read_swap_page(entry, (char *) page);
+	}
 	if (*table_ptr != entry) {
 		free_page(page);
 		return;
 	}
-	*table_ptr = page | (PAGE_DIRTY | PAGE_PRIVATE);
+	if (in_swap_cache(page) && write_access && mem_map[MAP_NR(page)] == 2)
+		delete_from_swap_cache(page);
+	if (in_swap_cache(page))
+		*table_ptr = page | PAGE_COPY;
+	else
+		*table_ptr = page | (PAGE_DIRTY | PAGE_PRIVATE);
+	page_add_rmap(page, table_ptr);
+	swap_remove_rmap(entry, table_ptr);
 	swap_free(entry);
 }
 
-static inline int try_to_swap_out(unsigned long * table_ptr)
+/*
+ * Do the I/O for a batch of swap pages with one ll_rw_block() call per
+ * swap device or file, so the block layer can merge consecutive slots.
+ * The caller holds the slot locks; batch->ok[] says which pages made it.
+ */
+static void swap_bh_io(int rw, int nr, struct swap_batch * batch)
 {
 	int i;
-	unsigned long page;
-	unsigned long entry;
 
-	page = *table_ptr;
-	if (!(PAGE_PRESENT & page))
-		return 0;
-	if (page >= high_memory)
-		return 0;
-	if (mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED)
-		return 0;
-	if (PAGE_ACCESSED & page) {
-		*table_ptr &= ~PAGE_ACCESSED;
-		return 0;
+	ll_rw_block(rw, nr, swap_bh_list);
+	for (i = 0 ; i < nr ; i++) {
+		wait_on_buffer(swap_bh_list[i]);
+		if (!swap_bh_list[i]->b_uptodate)
+			batch->ok[swap_bh_page[i]] = 0;
 	}
-	for (i = 0; i < NR_LAST_FREE_PAGES; i++)
-		if (last_free_pages[i] == (page & PAGE_MASK))
-			return 0;
-	if (PAGE_DIRTY & page) {
-		page &= PAGE_MASK;
-		if (mem_map[MAP_NR(page)] != 1)
-			return 0;
-		if (!(entry = get_swap_page()))
-			return 0;
-		*table_ptr = entry;
-		invalidate();
-		write_swap_page(entry, (char *) page);
-		free_page(page);
-		return 1;
+}
+
+static void swap_batch_io(int rw, struct swap_batch * batch)
+{
+	struct swap_info_struct * p;
+	struct buffer_head * bh;
+	unsigned long offset, block;
+	int i, j, n, type, dev, size, per;
+
+	while (swap_bh_busy)
+		sleep_on(&swap_bh_wait);
+	swap_bh_busy = 1;
+	for (i = 0 ; i < batch->nr ; i++)
+		batch->ok[i] = 1;
+	for (type = 0, p = swap_info ; type < nr_swapfiles ; type++, p++) {
+		if (p->swap_device) {
+			dev = p->swap_device;
+			size = BLOCK_SIZE;
+			if (blksize_size[MAJOR(dev)] && blksize_size[MAJOR(dev)][MINOR(dev)])
+				size = blksize_size[MAJOR(dev)][MINOR(dev)];
+		} else if (p->swap_file) {
+			dev = p->swap_file->i_dev;
+			size = p->swap_file->i_sb->s_blocksize;
+		} else
+			continue;
+		per = PAGE_SIZE / size;
+		n = 0;
+		for (i = 0 ; i < batch->nr ; i++) {
+			if (SWP_TYPE(batch->entry[i]) != type)
+				continue;
+			if (n + per > NR_SWAP_BH) {
+				swap_bh_io(rw, n, batch);
+				n = 0;
+			}
+			offset = SWP_OFFSET(batch->entry[i]);
+			for (j = 0 ; j < per ; j++) {
+				block = offset * per + j;
+				if (!p->swap_device && !(block = bmap(p->swap_file,block))) {
+					printk("swap_batch_io: bad swap file\n");
+					batch->ok[i] = 0;
+					break;
+				}
+				bh = swap_bh + n;
+				memset(bh, 0, sizeof(*bh));
+				bh->b_data = (char *) batch->page[i] + j * size;
+				bh->b_size = size;
+				bh->b_dev = dev;
+				bh->b_blocknr = block;
+				bh->b_count = 1;
+				if (rw == WRITE) {
+					bh->b_dirt = 1;
+					bh->b_uptodate = 1;
+				}
+				swap_bh_page[n] = i;
+				swap_bh_list[n++] = bh;
+			}
+		}
+		if (n)
+			swap_bh_io(rw, n, batch);
 	}
-	page &= PAGE_MASK;
-	*table_ptr = 0;
+	for (i = 0 ; i < batch->nr ; i++) {
+		if (!batch->ok[i])
+			continue;
+		if (rw == READ)
+			kstat.pswpin++;
+		else
+			kstat.pswpout++;
+	}
+	swap_bh_busy = 0;
+	wake_up(&swap_bh_wait);
+}
+
+/*
+ * The write of a page to its slot failed: put the page back in every
+ * entry that holds the slot, as try_to_unuse() does, so that its data
+ * isn't lost. Only chained entries can be found. Never sleeps.
+ */
+static void unswap_page(unsigned long entry, unsigned long page)
+{
+	struct swap_info_struct * p = swap_info + SWP_TYPE(entry);
+	unsigned long nr = SWP_OFFSET(entry);
+	struct pte_chain * pc;
+	struct task_struct * owner;
+	unsigned long * ptep;
+
+	while (p->swap_rmap && (pc = p->swap_rmap[nr]) != NULL) {
+		ptep = pc->ptep;
+		pte_chain_remove(p->swap_rmap + nr, ptep);
+		if (*ptep != entry) {
+			printk("unswap_page: stale entry %p for %08lx\n", ptep, entry);
+			continue;
+		}
+		mem_map[MAP_NR(page)]++;
+		*ptep = page | (PAGE_DIRTY | PAGE_COPY);
+		page_add_rmap(page, ptep);
+		owner = mem_rmap[MAP_NR((unsigned long) ptep)].owner;
+		if (owner)
+			++owner->rss;
+		swap_release(p, nr);
+	}
+	if (p->swap_map[nr])
+		printk("unswap_page: lost a page for %08lx\n", entry);
+}
+
+/*
+ * Write out a batch of pages that try_to_reclaim() has already unmapped,
+ * given swap entries to and locked the slots of, then free them. The
+ * slots stay locked until the write is done, so a swap_in() of one of
+ * them waits for it. A page that couldn't be written is mapped back.
+ */
+static void write_swap_batch(struct swap_batch * batch)
+{
+	struct swap_info_struct * p;
+	int i;
+
+	if (!batch->nr)
+		return;
 	invalidate();
-	free_page(page);
-	return 1 + mem_map[MAP_NR(page)];
+	swap_batch_io(WRITE, batch);
+	for (i = 0 ; i < batch->nr ; i++) {
+		p = swap_info + SWP_TYPE(batch->entry[i]);
+		if (!batch->ok[i])
+			unswap_page(batch->entry[i], batch->page[i]);
+		if (!clear_bit(SWP_OFFSET(batch->entry[i]),p->swap_lockmap))
+			printk("write_swap_batch: lock already cleared\n");
+		free_page(batch->page[i]);
+	}
+	wake_up(&lock_queue);
+	batch->nr = 0;
 }
 
 /*
@@ -276,230 +643,287 @@ asmlinkage int sys_idle(void)
 }
 
 /*
- * A new implementation of swap_out().  We do not swap complete processes,
- * but only a small number of blocks, before we continue with the next
- * process.  The number of blocks actually swapped is determined on the
- * number of page faults, that this process actually had in the last time,
- * so we won't swap heavily used processes all the time ...
- *
- * Note: the priority argument is a hint on much CPU to waste with the
- *       swap block search, not a hint, of how much blocks to swap with
- *       each process.
+ * Reclaim is a two-handed clock over physical memory, driven by the
+ * reverse map in rmap.c rather than by walking each task's page tables.
+ * The front hand clears the accessed bits of every mapping of a page and
+ * ages it: a page that was referenced since the last pass gets
+ * PAGE_AGE_ADVANCE added to its age, one that wasn't loses one. The back
+ * hand follows CLOCK_SPREAD pages behind and takes the pages whose age
+ * has run down to zero and that haven't been touched again in between.
  *
- * (C) 1993 Kai Petzke, wpp@marie.physik.tu-berlin.de
+ * Clean pages are simply unmapped everywhere and freed. Dirty ones cost
+ * a write, so they are only taken when we are getting short (priority
+ * below CLOCK_DIRTY_PRIORITY), and only if every reference to the page is
+ * a mapping we know about: all of them then get the same swap entry, and
+ * the page goes onto a swap_batch to be written and freed.
  */
-#ifdef NEW_SWAP
+#define CLOCK_SPREAD(nr)	((nr) >> 3)
+#define CLOCK_DIRTY_PRIORITY	4
+
+static unsigned long clock_front = 0;
+static unsigned long clock_back = 0;
+
 /*
- * These are the miminum and maximum number of pages to swap from one process,
- * before proceeding to the next:
+ * Test and clear the accessed bits of all the mappings of a page.
  */
-#define SWAP_MIN	4
-#define SWAP_MAX	32
+static int page_referenced(unsigned long nr)
+{
+	struct pte_chain * pc;
+	int referenced = 0;
+
+	for (pc = mem_rmap[nr].chain; pc; pc = pc->next) {
+		if (*pc->ptep & PAGE_ACCESSED) {
+			*pc->ptep &= ~PAGE_ACCESSED;
+			referenced = 1;
+		}
+	}
+	return referenced;
+}
+
+static inline void age_page(unsigned long nr)
+{
+	struct mem_rmap * rmap = mem_rmap + nr;
+
+	if (!rmap->chain) {
+		/* readahead or evicted, only the swap cache has it */
+		if (rmap->swap_entry && rmap->age)
+			rmap->age--;
+		return;
+	}
+	if (page_referenced(nr)) {
+		rmap->age += PAGE_AGE_ADVANCE;
+		if (rmap->age > PAGE_AGE_MAX)
+			rmap->age = PAGE_AGE_MAX;
+	} else if (rmap->age)
+		rmap->age--;
+}
 
 /*
- * The actual number of pages to swap is determined as:
- * SWAP_RATIO / (number of recent major page faults)
+ * Drop a mapping from the chain of its page and from the rss of the
+ * task its page table is counted against.
  */
-#define SWAP_RATIO	128
+static inline void unmap_pte(unsigned long page, unsigned long pte)
+{
+	unsigned long * ptep = mem_rmap[MAP_NR(page)].chain->ptep;
+	struct task_struct * owner;
 
-static int swap_out(unsigned int priority)
+	owner = mem_rmap[MAP_NR((unsigned long) ptep)].owner;
+	if (owner && owner->rss)
+		owner->rss--;
+	*ptep = pte;
+	page_remove_rmap(page, ptep);
+	swap_add_rmap(pte, ptep);
+}
+
+/*
+ * Returns 1 if the page was freed or queued on the batch, 0 otherwise.
+ */
+static int try_to_reclaim(unsigned long nr, unsigned int priority, struct swap_batch * batch)
 {
-    static int swap_task;
-    int table;
-    int page;
-    long pg_table;
-    int loop;
-    int counter = NR_TASKS * 2 >> priority;
-    struct task_struct *p;
-
-    counter = NR_TASKS * 2 >> priority;
-    for(; counter >= 0; counter--, swap_task++) {
-	/*
-	 * Check that swap_task is suitable for swapping.  If not, look for
-	 * the next suitable process.
-	 */
-	loop = 0;
-	while(1) {
-	    if(swap_task >= NR_TASKS) {
-		swap_task = 1;
-		if(loop)
-		    /* all processes are unswappable or already swapped out */
-		    return 0;
-		loop = 1;
-	    }
-
-	    p = task[swap_task];
-	    if(p && p->swappable && p->rss)
-		break;
-
-	    swap_task++;
-	}
-
-	/*
-	 * Determine the number of pages to swap from this process.
-	 */
-	if(! p -> swap_cnt) {
-	    p->dec_flt = (p->dec_flt * 3) / 4 + p->maj_flt - p->old_maj_flt;
-	    p->old_maj_flt = p->maj_flt;
-
-	    if(p->dec_flt >= SWAP_RATIO / SWAP_MIN) {
-		p->dec_flt = SWAP_RATIO / SWAP_MIN;
-		p->swap_cnt = SWAP_MIN;
-	    } else if(p->dec_flt <= SWAP_RATIO / SWAP_MAX)
-		p->swap_cnt = SWAP_MAX;
-	    else
-		p->swap_cnt = SWAP_RATIO / p->dec_flt;
-	}
-
-	/*
-	 * Go through process' page directory.
-	 */
-	for(table = p->swap_table; table < 1024; table++) {
-	    pg_table = ((unsigned long *) p->tss.cr3)[table];
-	    if(pg_table >= high_memory)
-		    continue;
-	    if(mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED)
-		    continue;
-	    if(!(PAGE_PRESENT & pg_table)) {
-		    printk("swap_out: bad page-table at pg_dir[%d]: %08lx\n",
-			    table, pg_table);
-		    ((unsigned long *) p->tss.cr3)[table] = 0;
-		    continue;
-	    }
-	    pg_table &= 0xfffff000;
-
-	    /*
-	     * Go through this page table.
-	     */
-	    for(page = p->swap_page; page < 1024; page++) {
-		switch(try_to_swap_out(page + (unsigned long *) pg_table)) {
-		    case 0:
-			break;
+	struct mem_rmap * rmap = mem_rmap + nr;
+	struct pte_chain * pc;
+	struct task_struct * owner;
+	unsigned long page, entry;
+	int n, dirty, freed;
 
-		    case 1:
-			p->rss--;
-			/* continue with the following page the next time */
-			p->swap_table = table;
-			p->swap_page  = page + 1;
-			if((--p->swap_cnt) == 0)
-			    swap_task++;
+	if (rmap->age || (mem_map[nr] & MAP_PAGE_RESERVED))
+		return 0;
+	page = nr << PAGE_SHIFT;
+	if (!rmap->chain) {
+		if (rmap->swap_entry && mem_map[nr] == 1) {
+			delete_from_swap_cache(page);
 			return 1;
-
-		    default:
-			p->rss--;
-			break;
 		}
-	    }
-
-	    p->swap_page = 0;
+		return 0;
 	}
-
-	/*
-	 * Finish work with this process, if we reached the end of the page
-	 * directory.  Mark restart from the beginning the next time.
-	 */
-	p->swap_table = 0;
-    }
-    return 0;
+	if (page_referenced(nr)) {
+		rmap->age = PAGE_AGE_ADVANCE;
+		return 0;
+	}
+	if (!(n = page_rmap_count(page)))
+		return 0;
+	dirty = 0;
+	for (pc = rmap->chain; pc; pc = pc->next) {
+		owner = mem_rmap[MAP_NR((unsigned long) pc->ptep)].owner;
+		if (owner && !owner->swappable)
+			return 0;
+		dirty |= *pc->ptep & PAGE_DIRTY;
+	}
+	if (!dirty) {
+		/* a page still matching its swap slot goes back to the slot */
+		entry = rmap->swap_entry;
+		freed = mem_map[nr] == n + (entry != 0);
+		while (rmap->chain)
+			unmap_pte(page, entry ? swap_duplicate(entry) : 0);
+		invalidate();
+		while (n--)
+			free_page(page);
+		if (freed && entry)
+			delete_from_swap_cache(page);
+		return freed;
+	}
+	if (rmap->swap_entry)
+		delete_from_swap_cache(page);
+	if (priority >= CLOCK_DIRTY_PRIORITY || batch->nr >= SWAP_BATCH)
+		return 0;
+	if (mem_map[nr] != n)
+		return 0;
+	if (!(entry = get_swap_page()))
+		return 0;
+	/* nobody may read the slot before write_swap_batch() has written it */
+	set_bit(SWP_OFFSET(entry), swap_info[SWP_TYPE(entry)].swap_lockmap);
+	unmap_pte(page, entry);
+	while (rmap->chain)
+		unmap_pte(page, swap_duplicate(entry));
+	mem_map[nr] = 1;
+	batch->entry[batch->nr] = entry;
+	batch->page[batch->nr++] = page;
+	return 1;
 }
 
-#else /* old swapping procedure */
-
 /*
- * Go through the page tables, searching for a user page that
- * we can swap out.
- * 
- * We now check that the process is swappable (normally only 'init'
- * is un-swappable), allowing high-priority processes which cannot be
- * swapped out (things like user-level device drivers (Not implemented)).
+ * Move both hands round memory, further for a lower priority. Stops at
+ * the first clean page freed or when the batch of dirty ones is full.
  */
 static int swap_out(unsigned int priority)
 {
-	static int swap_task = 1;
-	static int swap_table = 0;
-	static int swap_page = 0;
-	int counter = NR_TASKS*8;
-	int pg_table;
-	struct task_struct * p;
+	unsigned long nr_pages = MAP_NR(high_memory);
+	unsigned long count = (nr_pages >> priority) + 1;
+	unsigned long nr;
+	struct swap_batch batch;
 
-	counter >>= priority;
-check_task:
-	if (counter-- < 0)
+	if (!mem_rmap)
+		return 0;
+	if (clock_front >= nr_pages || clock_back >= nr_pages) {
+		clock_front = CLOCK_SPREAD(nr_pages);
+		clock_back = 0;
+	}
+	batch.nr = 0;
+	while (count--) {
+		vmstat.pages_scanned++;
+		age_page(clock_front);
+		if (++clock_front >= nr_pages)
+			clock_front = 0;
+		nr = clock_back;
+		if (++clock_back >= nr_pages)
+			clock_back = 0;
+		if (try_to_reclaim(nr, priority, &batch) && !batch.nr)
+			return 1;
+		if (batch.nr >= SWAP_BATCH)
+			break;
+	}
+	if (!batch.nr)
 		return 0;
-	if (swap_task >= NR_TASKS) {
-		swap_task = 1;
-		goto check_task;
-	}
-	p = task[swap_task];
-	if (!p || !p->swappable) {
-		swap_task++;
-		goto check_task;
-	}
-check_dir:
-	if (swap_table >= PTRS_PER_PAGE) {
-		swap_table = 0;
-		swap_task++;
-		goto check_task;
-	}
-	pg_table = ((unsigned long *) p->tss.cr3)[swap_table];
-	if (pg_table >= high_memory || (mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED)) {
-		swap_table++;
-		goto check_dir;
-	}
-	if (!(PAGE_PRESENT & pg_table)) {
-		printk("bad page-table at pg_dir[%d]: %08x\n",
-			swap_table,pg_table);
-		((unsigned long *) p->tss.cr3)[swap_table] = 0;
-		swap_table++;
-		goto check_dir;
-	}
-	pg_table &= PAGE_MASK;
-check_table:
-	if (swap_page >= PTRS_PER_PAGE) {
-		swap_page = 0;
-		swap_table++;
-		goto check_dir;
-	}
-	switch (try_to_swap_out(swap_page + (unsigned long *) pg_table)) {
-		case 0: break;
-		case 1: p->rss--; return 1;
-		default: p->rss--;
-	}
-	swap_page++;
-	goto check_table;
-}
-
-#endif
+	write_swap_batch(&batch);
+	return 1;
+}
+
+static inline int reclaimed(int source, int freed)
+{
+	vmstat.reclaim_tries[source]++;
+	if (freed)
+		vmstat.reclaim_freed[source]++;
+	return freed;
+}
 
 static int try_to_free_page(void)
 {
 	int i=6;
 
+	vmstat.reclaim_rounds++;
 	while (i--) {
-		if (shrink_buffers(i))
+		if (reclaimed(VM_BUFFERS, shrink_buffers(i)))
+			return 1;
+		if (reclaimed(VM_PAGE_CACHE, shrink_page_cache(i)))
 			return 1;
-		if (shm_swap(i))
+		if (reclaimed(VM_SHM, shm_swap(i)))
 			return 1;
-		if (swap_out(i))
+		if (reclaimed(VM_SWAP_OUT, swap_out(i)))
 			return 1;
 	}
+	vmstat.reclaim_failed++;
 	return 0;
 }
 
 /*
+ * Reclaim on behalf of the current task, charging it the time taken.
+ * Jiffies are coarse, but summed over many calls they show who waits.
+ */
+static int timed_try_to_free_page(void)
+{
+	unsigned long start = jiffies;
+	int freed;
+
+	freed = try_to_free_page();
+	start = jiffies - start;
+	current->reclaim_time += start;
+	vmstat.reclaim_jiffies += start;
+	return freed;
+}
+
+/*
+ * The free pages form a binary buddy system. free_area_list[order] holds
+ * the free blocks of 2^order pages, and bit n of free_area_map[order]
+ * is set when exactly one block of the n'th buddy pair at that order is
+ * free. Freeing a block whose buddy is free merges the two, so the
+ * callers that need physically contiguous memory can get it.
+ *
  * Note that this must be atomic, or bad things will happen when
  * pages are requested in interrupts (as malloc can do). Thus the
  * cli/sti's.
  */
-static inline void add_mem_queue(unsigned long addr, unsigned long * queue)
+struct mem_list {
+	struct mem_list * next;
+	struct mem_list * prev;
+};
+
+static struct mem_list free_area_list[NR_MEM_LISTS];
+static unsigned char * free_area_map[NR_MEM_LISTS];
+
+/* allocations above order 0 give up after this many reclaim rounds */
+#define MAX_ORDER_TRIES 32
+
+static inline void add_mem_queue(struct mem_list * head, struct mem_list * entry)
+{
+	entry->prev = head;
+	(entry->next = head->next)->prev = entry;
+	head->next = entry;
+}
+
+static inline void remove_mem_queue(struct mem_list * entry)
 {
-	addr &= PAGE_MASK;
-	*(unsigned long *) addr = *queue;
-	*queue = addr;
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+
+static inline int mark_used(unsigned long addr, unsigned long order)
+{
+	return change_bit(MAP_NR(addr) >> (1+order), free_area_map[order]);
 }
 
 /*
- * Free_page() adds the page to the free lists. This is optimized for
+ * Put a block back, merging it with its buddy for as long as the buddy
+ * is free too. Called with interrupts off.
+ */
+static inline void free_pages_ok(unsigned long addr, unsigned long order)
+{
+	unsigned long mask = PAGE_MASK << order;
+
+	addr &= mask;
+	nr_free_pages += 1 << order;
+	while (order < NR_MEM_LISTS-1) {
+		if (!mark_used(addr, order))
+			break;
+		remove_mem_queue((struct mem_list *) (addr ^ (1+~mask)));
+		order++;
+		mask <<= 1;
+		addr &= mask;
+	}
+	add_mem_queue(free_area_list+order, (struct mem_list *) addr);
+}
+
+/*
+ * Free_pages() adds the block to the free lists. This is optimized for
  * fast normal cases (no error jumps taken normally).
  *
  * The way to optimize jumps for gcc-2.2.2 is to:
@@ -508,8 +932,11 @@ static inline void add_mem_queue(unsigned long addr, unsigned long * queue)
  *
  * With the above two rules, you get a straight-line execution path
  * for the normal case, giving better asm-code.
+ *
+ * Only the first page of a block carries a count in mem_map[], so the
+ * block must be freed with the order it was allocated with.
  */
-void free_page(unsigned long addr)
+void free_pages(unsigned long addr, unsigned long order)
 {
 	if (addr < high_memory) {
 		unsigned short * map = mem_map + MAP_NR(addr);
@@ -520,16 +947,8 @@ void free_page(unsigned long addr)
 
 				save_flags(flag);
 				cli();
-				if (!--*map) {
-					if (nr_secondary_pages < MAX_SECONDARY_PAGES) {
-						add_mem_queue(addr,&secondary_page_list);
-						nr_secondary_pages++;
-						restore_flags(flag);
-						return;
-					}
-					add_mem_queue(addr,&free_page_list);
-					nr_free_pages++;
-				}
+				if (!--*map)
+					free_pages_ok(addr, order);
 				restore_flags(flag);
 			}
 			return;
@@ -541,82 +960,239 @@ void free_page(unsigned long addr)
 }
 
 /*
- * This is one ugly macro, but it simplifies checking, and makes
- * this speed-critical place reasonably fast, especially as we have
- * to do things with the interrupt flag etc.
- *
- * Note that this #define is heavily optimized to give fast code
- * for the normal case - the if-statements are ordered so that gcc-2.2.2
- * will make *no* jumps for the normal code. Don't touch unless you
- * know what you are doing.
- */
-#define REMOVE_FROM_MEM_QUEUE(queue,nr) \
-	cli(); \
-	if ((result = queue) != 0) { \
-		if (!(result & ~PAGE_MASK) && result < high_memory) { \
-			queue = *(unsigned long *) result; \
-			if (!mem_map[MAP_NR(result)]) { \
-				mem_map[MAP_NR(result)] = 1; \
-				nr--; \
-last_free_pages[index = (index + 1) & (NR_LAST_FREE_PAGES - 1)] = result; \
-				restore_flags(flag); \
-				return result; \
-			} \
-			printk("Free page %08lx has mem_map = %d\n", \
-				result,mem_map[MAP_NR(result)]); \
-		} else \
-			printk("Result = 0x%08lx - memory map destroyed\n", result); \
-		queue = 0; \
-		nr = 0; \
-	} else if (nr) { \
-		printk(#nr " is %d, but " #queue " is empty\n",nr); \
-		nr = 0; \
-	} \
-	restore_flags(flag)
-
-/*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * Take the first suitable block of at least 2^order pages off the free
+ * lists, splitting it if it is bigger and giving the unused halves
+ * back. With dma positive, only blocks that lie entirely below
+ * MAX_DMA_ADDRESS are suitable, with dma negative only blocks above it.
+ * Called with interrupts off.
+ */
+static unsigned long rmqueue(unsigned long order, int dma)
+{
+	struct mem_list * queue = free_area_list + order;
+	struct mem_list * block;
+	unsigned long new_order = order;
+	unsigned long size;
+
+	do {
+		for (block = queue->next; block != queue; block = block->next) {
+			if (dma > 0 && (unsigned long) block + (PAGE_SIZE << new_order) > MAX_DMA_ADDRESS)
+				continue;
+			if (dma < 0 && (unsigned long) block < MAX_DMA_ADDRESS)
+				continue;
+			goto found;
+		}
+		new_order++;
+		queue++;
+	} while (new_order < NR_MEM_LISTS);
+	return 0;
+found:
+	remove_mem_queue(block);
+	mark_used((unsigned long) block, new_order);
+	nr_free_pages -= 1 << order;
+	size = PAGE_SIZE << new_order;
+	while (new_order > order) {
+		new_order--;
+		size >>= 1;
+		add_mem_queue(free_area_list + new_order, block);
+		mark_used((unsigned long) block, new_order);
+		block = (struct mem_list *) (size + (unsigned long) block);
+	}
+	if (mem_map[MAP_NR((unsigned long) block)])
+		printk("Free page %08lx has mem_map = %d\n",
+			(unsigned long) block, mem_map[MAP_NR((unsigned long) block)]);
+	mem_map[MAP_NR((unsigned long) block)] = 1;
+	return (unsigned long) block;
+}
+
+/*
+ * Pages a task has mapped can be moved out of DMA memory when an ISA
+ * allocation finds none: the entries on the rmap chain are pointed at a
+ * copy above MAX_DMA_ADDRESS. Only pages whose every reference is such
+ * an entry are moved; page tables, buffers, the page and swap caches
+ * and kernel memory stay where they are.
+ */
+static unsigned long dma_clock = 0;
+
+static int page_movable(unsigned long nr)
+{
+	struct mem_rmap * rmap = mem_rmap + nr;
+
+	if ((mem_map[nr] & MAP_PAGE_RESERVED) || !rmap->chain || rmap->swap_entry)
+		return 0;
+	return page_rmap_count(nr << PAGE_SHIFT) == mem_map[nr];
+}
+
+static int migrate_page(unsigned long nr)
+{
+	struct mem_rmap * rmap = mem_rmap + nr;
+	struct pte_chain * pc;
+	unsigned long page, new_page, flag;
+
+	save_flags(flag);
+	cli();
+	new_page = 0;
+	if (nr_free_pages > MAX_SECONDARY_PAGES)
+		new_page = rmqueue(0, -1);
+	restore_flags(flag);
+	if (!new_page)
+		return 0;
+	page = nr << PAGE_SHIFT;
+	memcpy((void *) new_page, (void *) page, PAGE_SIZE);
+	for (pc = rmap->chain; pc; pc = pc->next)
+		*pc->ptep = new_page | (*pc->ptep & ~PAGE_MASK);
+	mem_rmap[MAP_NR(new_page)] = *rmap;
+	rmap->chain = NULL;
+	rmap->age = 0;
+	mem_map[MAP_NR(new_page)] = mem_map[nr];
+	mem_map[nr] = 1;
+	free_page(page);
+	vmstat.dma_migrated++;
+	return 1;
+}
+
+/*
+ * Find an aligned block of 2^order DMA pages whose used pages can all
+ * be moved, and move them. A page with no count may be free or part of
+ * a bigger allocation, so above order 0 the block isn't sure to come
+ * free. Returns 1 if anything was moved.
+ */
+static int migrate_dma_pages(unsigned long order)
+{
+	unsigned long nr_dma = MAP_NR(MAX_DMA_ADDRESS);
+	unsigned long size = 1 << order;
+	unsigned long count, nr, i;
+	int moved = 0;
+
+	if (!mem_rmap || high_memory <= MAX_DMA_ADDRESS)
+		return 0;
+	for (count = nr_dma >> order ; count-- ; ) {
+		nr = dma_clock & ~(size - 1);
+		dma_clock = nr + size;
+		if (dma_clock >= nr_dma)
+			dma_clock = 0;
+		for (i = 0 ; i < size ; i++)
+			if (mem_map[nr + i] && !page_movable(nr + i))
+				break;
+		if (i < size)
+			continue;
+		for (i = 0 ; i < size ; i++)
+			if (mem_map[nr + i])
+				moved += migrate_page(nr + i);
+		if (moved)
+			break;
+	}
+	if (!moved)
+		return 0;
+	invalidate();
+	return 1;
+}
+
+/*
+ * Get physical address of a free block of 2^order pages, and mark it
+ * used. If there is none, return 0.
  *
  * Note that this is one of the most heavily called functions in the kernel,
  * so it's a bit timing-critical (especially as we have to disable interrupts
- * in it). See the above macro which does most of the work, and which is
- * optimized for a fast normal path of execution.
+ * in it). Single pages come straight off the order 0 list whenever it
+ * isn't empty.
  */
-unsigned long __get_free_page(int priority)
+unsigned long __get_free_pages(int priority, unsigned long order)
 {
 	extern unsigned long intr_count;
 	unsigned long result, flag;
-	static unsigned long index = 0;
+	int dma, reserve = 0, tries = MAX_ORDER_TRIES, migrated = 0;
 
 	/* this routine can be called at interrupt time via
 	   malloc.  We want to make sure that the critical
 	   sections of code have interrupts disabled. -RAB
 	   Is this code reentrant? */
 
+	dma = priority & GFP_DMA;
+	priority &= ~GFP_DMA;
 	if (intr_count && priority != GFP_ATOMIC) {
 		printk("gfp called nonatomically from interrupt %08lx\n",
 			((unsigned long *)&priority)[-1]);
 		priority = GFP_ATOMIC;
 	}
+	if (order >= NR_MEM_LISTS)
+		return 0;
 	save_flags(flag);
 repeat:
-	REMOVE_FROM_MEM_QUEUE(free_page_list,nr_free_pages);
-	if (priority == GFP_BUFFER)
+	cli();
+	if (reserve || nr_free_pages >= MAX_SECONDARY_PAGES + (1 << order)) {
+		if ((result = rmqueue(order, dma)) != 0) {
+			restore_flags(flag);
+			return result;
+		}
+	}
+	restore_flags(flag);
+	if (reserve || priority == GFP_BUFFER) {
+		if (priority < VM_NR_GFP)
+			vmstat.alloc_failed[priority]++;
 		return 0;
-	if (priority != GFP_ATOMIC)
-		if (try_to_free_page())
+	}
+	vmstat.alloc_slow++;
+	if (dma && priority != GFP_ATOMIC && !migrated++ && migrate_dma_pages(order))
+		goto repeat;
+	if (priority != GFP_ATOMIC && (!order || --tries > 0))
+		if (timed_try_to_free_page())
 			goto repeat;
-	REMOVE_FROM_MEM_QUEUE(secondary_page_list,nr_secondary_pages);
-	return 0;
+	reserve = 1;
+	goto repeat;
+}
+
+/*
+ * Set up the empty free lists and carve the buddy bitmaps out of
+ * start_mem. mem_init() then frees every usable page into the lists.
+ */
+unsigned long free_area_init(unsigned long start_mem, unsigned long end_mem)
+{
+	unsigned long mask = PAGE_MASK;
+	int i;
+
+	for (i = 0 ; i < NR_MEM_LISTS ; i++) {
+		unsigned long bitmap_size;
+		free_area_list[i].prev = free_area_list[i].next = &free_area_list[i];
+		mask += mask;
+		end_mem = (end_mem + ~mask) & mask;
+		bitmap_size = end_mem >> (PAGE_SHIFT + i);
+		bitmap_size = (bitmap_size + 7) >> 3;
+		bitmap_size = (bitmap_size + sizeof(unsigned long) - 1) & ~(sizeof(unsigned long)-1);
+		free_area_map[i] = (unsigned char *) start_mem;
+		memset((void *) start_mem, 0, bitmap_size);
+		start_mem += bitmap_size;
+	}
+	return start_mem;
+}
+
+/*
+ * Number of free blocks of each order, for show_mem() and /proc/meminfo.
+ */
+void free_area_counts(unsigned long * counts)
+{
+	unsigned long flag;
+	struct mem_list * tmp;
+	int order;
+
+	save_flags(flag);
+	cli();
+	for (order = 0 ; order < NR_MEM_LISTS ; order++) {
+		counts[order] = 0;
+		for (tmp = free_area_list[order].next ; tmp != free_area_list + order ; tmp = tmp->next)
+			counts[order]++;
+	}
+	restore_flags(flag);
 }
 
 /*
  * Trying to stop swapping from a file is fraught with races, so
  * we repeat quite a bit here when we have to pause. swapoff()
  * isn't exactly timing-critical, so who cares?
+ *
+ * This is the slow way, through every page table of every task, for
+ * when the swap rmap of the device is incomplete.
  */
-static int try_to_unuse(unsigned int type)
+static int scan_page_tables(unsigned int type)
 {
 	int nr, pgt, pg;
 	unsigned long page, *ppage;
@@ -640,7 +1216,7 @@ repeat:
 				continue;
 			if (!(page & PAGE_PRESENT) || (page >= high_memory))
 				continue;
-			if (mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED)
+			if ((page & PAGE_4M) || (mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED))
 				continue;
 			ppage = (unsigned long *) (page & PAGE_MASK);	
 			for (pg = 0 ; pg < PTRS_PER_PAGE ; pg++,ppage++) {
@@ -659,7 +1235,9 @@ repeat:
 				read_swap_page(page, (char *) tmp);
 				if (*ppage == page) {
 					*ppage = tmp | (PAGE_DIRTY | PAGE_PRIVATE);
+					page_add_rmap(tmp, ppage);
 					++p->rss;
+					swap_remove_rmap(page, ppage);
 					swap_free(page);
 					tmp = 0;
 				}
@@ -671,6 +1249,56 @@ repeat:
 	return 0;
 }
 
+/*
+ * Read each slot still in use once, and put the page into every entry
+ * on the slot's chain. The entries share the page copy-on-write; it is
+ * marked dirty, as there is no slot to go back to any more.
+ */
+static int try_to_unuse(unsigned int type)
+{
+	struct swap_info_struct * p = swap_info + type;
+	struct pte_chain * pc;
+	struct task_struct * owner;
+	unsigned long nr, page, entry, * ptep;
+	int n;
+
+	/* readahead can't add more: the device is no longer SWP_WRITEOK */
+	for (nr = 1 ; nr < p->max ; nr++)
+		if ((page = p->swap_cache[nr]) != 0)
+			delete_from_swap_cache(page);
+	for (nr = 1 ; nr < p->max ; nr++) {
+		if (!p->swap_rmap[nr])
+			continue;
+		if (!(page = get_free_page(GFP_KERNEL)))
+			return -ENOMEM;
+		entry = SWP_ENTRY(type,nr);
+		read_swap_page(entry, (char *) page);
+		/* the chain may have changed while we slept */
+		n = 0;
+		while ((pc = p->swap_rmap[nr]) != NULL) {
+			ptep = pc->ptep;
+			pte_chain_remove(p->swap_rmap + nr, ptep);
+			if (*ptep != entry) {
+				printk("try_to_unuse: stale entry %p for %08lx\n", ptep, entry);
+				continue;
+			}
+			if (n++)
+				mem_map[MAP_NR(page)]++;
+			*ptep = page | (PAGE_DIRTY | PAGE_COPY);
+			page_add_rmap(page, ptep);
+			owner = mem_rmap[MAP_NR((unsigned long) ptep)].owner;
+			if (owner)
+				++owner->rss;
+			swap_release(p, nr);
+		}
+		if (!n)
+			free_page(page);
+	}
+	if (p->rmap_lost)
+		return scan_page_tables(type);
+	return 0;
+}
+
 asmlinkage int sys_swapoff(const char * specialfile)
 {
 	struct swap_info_struct * p;
@@ -707,11 +1335,18 @@ asmlinkage int sys_swapoff(const char * specialfile)
 		return i;
 	}
 	nr_swap_pages -= p->pages;
+	for (i = 1 ; i < p->max ; i++)
+		while (p->swap_rmap[i])
+			pte_chain_remove(p->swap_rmap + i, p->swap_rmap[i]->ptep);
 	iput(p->swap_file);
 	p->swap_file = NULL;
 	p->swap_device = 0;
 	vfree(p->swap_map);
 	p->swap_map = NULL;
+	vfree(p->swap_cache);
+	p->swap_cache = NULL;
+	vfree(p->swap_rmap);
+	p->swap_rmap = NULL;
 	free_page((long) p->swap_lockmap);
 	p->swap_lockmap = NULL;
 	p->flags = 0;
@@ -746,8 +1381,13 @@ asmlinkage int sys_swapon(const char * specialfile)
 	p->swap_device = 0;
 	p->swap_map = NULL;
 	p->swap_lockmap = NULL;
+	p->swap_cache = NULL;
+	p->swap_rmap = NULL;
+	p->rmap_lost = 0;
 	p->lowest_bit = 0;
 	p->highest_bit = 0;
+	p->cluster_nr = 0;
+	p->cluster_next = 0;
 	p->max = 1;
 	error = namei(specialfile,&swap_inode);
 	if (error)
@@ -815,6 +1455,18 @@ asmlinkage int sys_swapon(const char * specialfile)
 			p->swap_map[i] = 0x80;
 	}
 	p->swap_map[0] = 0x80;
+	p->swap_cache = (unsigned long *) vmalloc(p->max * sizeof(unsigned long));
+	if (!p->swap_cache) {
+		error = -ENOMEM;
+		goto bad_swap;
+	}
+	memset(p->swap_cache,0,p->max * sizeof(unsigned long));
+	p->swap_rmap = (struct pte_chain **) vmalloc(p->max * sizeof(struct pte_chain *));
+	if (!p->swap_rmap) {
+		error = -ENOMEM;
+		goto bad_swap;
+	}
+	memset(p->swap_rmap,0,p->max * sizeof(struct pte_chain *));
 	memset(p->swap_lockmap,0,PAGE_SIZE);
 	p->flags = SWP_WRITEOK;
 	p->pages = j;
@@ -824,11 +1476,15 @@ asmlinkage int sys_swapon(const char * specialfile)
 bad_swap:
 	free_page((long) p->swap_lockmap);
 	vfree(p->swap_map);
+	vfree(p->swap_cache);
+	vfree(p->swap_rmap);
 	iput(p->swap_file);
 	p->swap_device = 0;
 	p->swap_file = NULL;
 	p->swap_map = NULL;
 	p->swap_lockmap = NULL;
+	p->swap_cache = NULL;
+	p->swap_rmap = NULL;
 	p->flags = 0;
 	return error;
 }
@@ -855,3 +1511,44 @@ void si_swapinfo(struct sysinfo *val)
 	val->totalswap <<= PAGE_SHIFT;
 	return;
 }
+
+/*
+ * /proc/vmstat: one "name value" pair per line.
+ */
+int get_vmstat(char * buffer)
+{
+	static char * source[VM_NR_SOURCES] = { "buffers", "page_cache", "shm", "swap_out" };
+	static char * gfp[VM_NR_GFP] = { "buffer", "atomic", "user", "kernel" };
+	int i, len;
+
+	len = sprintf(buffer,
+		"free_pages %d\n"
+		"free_swap_pages %d\n"
+		"pswpin %u\n"
+		"pswpout %u\n"
+		"alloc_slow %u\n",
+		nr_free_pages, nr_swap_pages,
+		kstat.pswpin, kstat.pswpout,
+		vmstat.alloc_slow);
+	for (i = 0 ; i < VM_NR_GFP ; i++)
+		len += sprintf(buffer+len, "alloc_failed_%s %u\n",
+			gfp[i], vmstat.alloc_failed[i]);
+	len += sprintf(buffer+len,
+		"reclaim_rounds %u\n"
+		"reclaim_failed %u\n"
+		"reclaim_jiffies %u\n",
+		vmstat.reclaim_rounds, vmstat.reclaim_failed,
+		vmstat.reclaim_jiffies);
+	for (i = 0 ; i < VM_NR_SOURCES ; i++)
+		len += sprintf(buffer+len, "reclaim_%s_tries %u\nreclaim_%s_freed %u\n",
+			source[i], vmstat.reclaim_tries[i],
+			source[i], vmstat.reclaim_freed[i]);
+	len += sprintf(buffer+len,
+		"scan_buffers %u\n"
+		"scan_pages %u\n"
+		"dma_migrated %u\n",
+		vmstat.buffers_scanned, vmstat.pages_scanned,
+		vmstat.dma_migrated);
+	len += get_dcache_stats(buffer+len);
+	return len;
+}
@@ -16,14 +16,36 @@
 #include <linux/malloc.h>
 #include <asm/segment.h>
 
+/*
+ * Areas in use are kept in one AVL tree and the free address space in
+ * another, both sorted by address. Each node of the free tree also
+ * records the largest range below it, so vmalloc() finds the lowest
+ * range that fits without looking at more than one path.
+ *
+ * vfree() doesn't flush the TLB: the range waits on a lazy list until
+ * VMALLOC_LAZY bytes have piled up (or vmalloc() runs out of space),
+ * and then one invalidate() does for all of them before they go back
+ * into the free tree.
+ *
+ * Page tables of the area are set up in swapper_pg_dir only and never
+ * freed. Other page directories pick them up when they fault on them,
+ * see do_page_fault().
+ */
 struct vm_struct {
 	unsigned long flags;
 	void * addr;
 	unsigned long size;
-	struct vm_struct * next;
+	unsigned long largest;		/* largest size in this subtree */
+	short height;
+	struct vm_struct * left, * right;
+	struct vm_struct * next;	/* lazy list */
 };
 
-static struct vm_struct * vmlist = NULL;
+static struct vm_struct * vmbusy = NULL;
+static struct vm_struct * vmfree = NULL;
+static struct vm_struct * vmlazy = NULL;
+static unsigned long vmlazy_size = 0;
+static int vmfree_ready = 0;
 
 /* Just any arbitrary offset to the start of the vmalloc VM area: the
  * current 8MB value just means that there will be a 8MB "hole" after the
@@ -33,16 +55,231 @@ static struct vm_struct * vmlist = NULL;
  * area for the same reason. ;)
  */
 #define VMALLOC_OFFSET	(8*1024*1024)
+#define VMALLOC_START	((high_memory + VMALLOC_OFFSET) & ~(VMALLOC_OFFSET-1))
+#define VMALLOC_END	(1024*1024*1024)	/* the kernel segment is 1GB */
+#define VMALLOC_LAZY	(8*1024*1024)
+
+#define vm_maxheight	41
+#define heightof(tree)	((tree) == NULL ? 0 : (tree)->height)
 
-static inline void set_pgdir(unsigned long dindex, unsigned long value)
+static void vm_update(struct vm_struct * node)
 {
-	struct task_struct * p;
+	int hl = heightof(node->left), hr = heightof(node->right);
+	unsigned long largest = node->size;
 
-	p = &init_task;
-	do {
-		((unsigned long *) p->tss.cr3)[dindex] = value;
-		p = p->next_task;
-	} while (p != &init_task);
+	node->height = 1 + (hl > hr ? hl : hr);
+	if (node->left && node->left->largest > largest)
+		largest = node->left->largest;
+	if (node->right && node->right->largest > largest)
+		largest = node->right->largest;
+	node->largest = largest;
+}
+
+static struct vm_struct * vm_rotate_right(struct vm_struct * node)
+{
+	struct vm_struct * left = node->left;
+
+	node->left = left->right;
+	left->right = node;
+	vm_update(node);
+	vm_update(left);
+	return left;
+}
+
+static struct vm_struct * vm_rotate_left(struct vm_struct * node)
+{
+	struct vm_struct * right = node->right;
+
+	node->right = right->left;
+	right->left = node;
+	vm_update(node);
+	vm_update(right);
+	return right;
+}
+
+/*
+ * As avl_rebalance() in mmap.c, but always all the way up: "largest"
+ * may change even where the height doesn't.
+ */
+static void vm_rebalance(struct vm_struct *** nodeplaces_ptr, int count)
+{
+	for ( ; count > 0 ; count--) {
+		struct vm_struct ** nodeplace = *--nodeplaces_ptr;
+		struct vm_struct * node = *nodeplace;
+		int hl = heightof(node->left), hr = heightof(node->right);
+
+		if (hl > hr + 1) {
+			if (heightof(node->left->left) < heightof(node->left->right))
+				node->left = vm_rotate_left(node->left);
+			*nodeplace = vm_rotate_right(node);
+		} else if (hr > hl + 1) {
+			if (heightof(node->right->right) < heightof(node->right->left))
+				node->right = vm_rotate_right(node->right);
+			*nodeplace = vm_rotate_left(node);
+		} else
+			vm_update(node);
+	}
+}
+
+static void vm_insert(struct vm_struct * new, struct vm_struct ** ptree)
+{
+	struct vm_struct ** nodeplace = ptree;
+	struct vm_struct ** stack[vm_maxheight];
+	struct vm_struct *** stack_ptr = stack;
+	int stack_count = 0;
+
+	while (*nodeplace) {
+		struct vm_struct * node = *nodeplace;
+
+		*stack_ptr++ = nodeplace;
+		stack_count++;
+		if (new->addr < node->addr)
+			nodeplace = &node->left;
+		else
+			nodeplace = &node->right;
+	}
+	new->left = NULL;
+	new->right = NULL;
+	new->height = 1;
+	new->largest = new->size;
+	*nodeplace = new;
+	vm_rebalance(stack_ptr, stack_count);
+}
+
+static void vm_remove(struct vm_struct * node_to_delete, struct vm_struct ** ptree)
+{
+	struct vm_struct ** nodeplace = ptree;
+	struct vm_struct ** nodeplace_to_delete;
+	struct vm_struct ** stack[vm_maxheight];
+	struct vm_struct *** stack_ptr = stack;
+	int stack_count = 0;
+
+	for (;;) {
+		struct vm_struct * node = *nodeplace;
+
+		if (!node) {
+			printk("vm_remove: area %p not in tree\n", node_to_delete->addr);
+			return;
+		}
+		*stack_ptr++ = nodeplace;
+		stack_count++;
+		if (node == node_to_delete)
+			break;
+		if (node_to_delete->addr < node->addr)
+			nodeplace = &node->left;
+		else
+			nodeplace = &node->right;
+	}
+	nodeplace_to_delete = nodeplace;
+	if (!node_to_delete->left) {
+		*nodeplace_to_delete = node_to_delete->right;
+		stack_ptr--;
+		stack_count--;
+	} else {
+		/* replace it with the rightmost node of its left subtree */
+		struct vm_struct *** stack_ptr_to_delete = stack_ptr;
+		struct vm_struct * node;
+
+		nodeplace = &node_to_delete->left;
+		while ((node = *nodeplace)->right) {
+			*stack_ptr++ = nodeplace;
+			stack_count++;
+			nodeplace = &node->right;
+		}
+		*nodeplace = node->left;
+		node->left = node_to_delete->left;
+		node->right = node_to_delete->right;
+		node->height = node_to_delete->height;
+		*nodeplace_to_delete = node;
+		*stack_ptr_to_delete = &node->left;
+	}
+	vm_rebalance(stack_ptr, stack_count);
+}
+
+/*
+ * The lowest free range of at least "size" bytes.
+ */
+static struct vm_struct * vm_find_free(unsigned long size)
+{
+	struct vm_struct * tree = vmfree;
+
+	while (tree) {
+		if (tree->left && tree->left->largest >= size)
+			tree = tree->left;
+		else if (tree->size >= size)
+			return tree;
+		else if (tree->right && tree->right->largest >= size)
+			tree = tree->right;
+		else
+			break;
+	}
+	return NULL;
+}
+
+/*
+ * The first area in use whose data ends above addr.
+ */
+static struct vm_struct * vm_find_busy(unsigned long addr)
+{
+	struct vm_struct * result = NULL, * tree = vmbusy;
+
+	while (tree) {
+		if ((unsigned long) tree->addr + tree->size - PAGE_SIZE > addr) {
+			result = tree;
+			tree = tree->left;
+		} else
+			tree = tree->right;
+	}
+	return result;
+}
+
+/*
+ * Give a range back to the free tree, merging it with its neighbours.
+ */
+static void vm_release(struct vm_struct * area)
+{
+	unsigned long start = (unsigned long) area->addr;
+	struct vm_struct * tree, * prev = NULL, * next = NULL;
+
+	for (tree = vmfree; tree; ) {
+		if ((unsigned long) tree->addr < start) {
+			prev = tree;
+			tree = tree->right;
+		} else {
+			next = tree;
+			tree = tree->left;
+		}
+	}
+	if (prev && (unsigned long) prev->addr + prev->size == start) {
+		vm_remove(prev, &vmfree);
+		area->addr = prev->addr;
+		area->size += prev->size;
+		kfree(prev);
+	}
+	if (next && (unsigned long) area->addr + area->size == (unsigned long) next->addr) {
+		vm_remove(next, &vmfree);
+		area->size += next->size;
+		kfree(next);
+	}
+	vm_insert(area, &vmfree);
+}
+
+/*
+ * Nothing maps the lazily freed ranges any more: flush the stale TLB
+ * entries once and let the ranges be used again.
+ */
+static void vm_purge_lazy(void)
+{
+	struct vm_struct * area;
+
+	if (!vmlazy)
+		return;
+	invalidate();
+	while ((area = vmlazy) != NULL) {
+		vmlazy = area->next;
+		vm_release(area);
+	}
+	vmlazy_size = 0;
 }
 
 static int free_area_pages(unsigned long dindex, unsigned long index, unsigned long nr)
@@ -60,14 +297,6 @@ static int free_area_pages(unsigned long dindex, unsigned long index, unsigned l
 			free_page(pg);
 		pte++;
 	} while (--nr);
-	pte = (unsigned long *) page;
-	for (nr = 0 ; nr < 1024 ; nr++, pte++)
-		if (*pte)
-			return 0;
-	set_pgdir(dindex,0);
-	mem_map[MAP_NR(page)] = 1;
-	free_page(page);
-	invalidate();
 	return 0;
 }
 
@@ -85,7 +314,8 @@ static int alloc_area_pages(unsigned long dindex, unsigned long index, unsigned
 			page = swapper_pg_dir[dindex];
 		} else {
 			mem_map[MAP_NR(page)] = MAP_PAGE_RESERVED;
-			set_pgdir(dindex, page | PAGE_SHARED);
+			swapper_pg_dir[dindex] = page | PAGE_SHARED;
+			((unsigned long *) current->tss.cr3)[dindex] = page | PAGE_SHARED;
 		}
 	}
 	page &= PAGE_MASK;
@@ -99,7 +329,6 @@ static int alloc_area_pages(unsigned long dindex, unsigned long index, unsigned
 		*pte = pg | PAGE_SHARED;
 		pte++;
 	} while (--nr);
-	invalidate();
 	return 0;
 }
 
@@ -127,7 +356,7 @@ static int do_area(void * addr, unsigned long size,
 
 void vfree(void * addr)
 {
-	struct vm_struct **p, *tmp;
+	struct vm_struct * tmp;
 
 	if (!addr)
 		return;
@@ -135,21 +364,25 @@ void vfree(void * addr)
 		printk("Trying to vfree() bad address (%p)\n", addr);
 		return;
 	}
-	for (p = &vmlist ; (tmp = *p) ; p = &tmp->next) {
-		if (tmp->addr == addr) {
-			*p = tmp->next;
-			do_area(tmp->addr, tmp->size, free_area_pages);
-			kfree(tmp);
-			return;
-		}
+	for (tmp = vmbusy; tmp && tmp->addr != addr; )
+		tmp = addr < tmp->addr ? tmp->left : tmp->right;
+	if (!tmp) {
+		printk("Trying to vfree() nonexistent vm area (%p)\n", addr);
+		return;
 	}
-	printk("Trying to vfree() nonexistent vm area (%p)\n", addr);
+	vm_remove(tmp, &vmbusy);
+	do_area(tmp->addr, tmp->size - PAGE_SIZE, free_area_pages);
+	tmp->next = vmlazy;
+	vmlazy = tmp;
+	vmlazy_size += tmp->size;
+	if (vmlazy_size >= VMALLOC_LAZY)
+		vm_purge_lazy();
 }
 
 void * vmalloc(unsigned long size)
 {
 	void * addr;
-	struct vm_struct **p, *tmp, *area;
+	struct vm_struct *tmp, *area;
 
 	size = PAGE_ALIGN(size);
 	if (!size || size > high_memory)
@@ -157,17 +390,40 @@ void * vmalloc(unsigned long size)
 	area = (struct vm_struct *) kmalloc(sizeof(*area), GFP_KERNEL);
 	if (!area)
 		return NULL;
-	addr = (void *) ((high_memory + VMALLOC_OFFSET) & ~(VMALLOC_OFFSET-1));
+	if (!vmfree_ready) {
+		tmp = (struct vm_struct *) kmalloc(sizeof(*tmp), GFP_KERNEL);
+		if (!tmp) {
+			kfree(area);
+			return NULL;
+		}
+		if (vmfree_ready)
+			kfree(tmp);
+		else {
+			tmp->addr = (void *) VMALLOC_START;
+			tmp->size = VMALLOC_END - VMALLOC_START;
+			vm_insert(tmp, &vmfree);
+			vmfree_ready = 1;
+		}
+	}
 	area->size = size + PAGE_SIZE;
-	area->next = NULL;
-	for (p = &vmlist; (tmp = *p) ; p = &tmp->next) {
-		if (size + (unsigned long) addr < (unsigned long) tmp->addr)
-			break;
-		addr = (void *) (tmp->size + (unsigned long) tmp->addr);
+	if (!(tmp = vm_find_free(area->size))) {
+		vm_purge_lazy();
+		if (!(tmp = vm_find_free(area->size))) {
+			kfree(area);
+			return NULL;
+		}
+	}
+	vm_remove(tmp, &vmfree);
+	addr = tmp->addr;
+	if (tmp->size == area->size)
+		kfree(tmp);
+	else {
+		tmp->addr = (void *) ((unsigned long) tmp->addr + area->size);
+		tmp->size -= area->size;
+		vm_insert(tmp, &vmfree);
 	}
 	area->addr = addr;
-	area->next = *p;
-	*p = area;
+	vm_insert(area, &vmbusy);
 	if (do_area(addr, size, alloc_area_pages)) {
 		vfree(addr);
 		return NULL;
@@ -177,20 +433,18 @@ void * vmalloc(unsigned long size)
 
 int vread(char *buf, char *addr, int count)
 {
-	struct vm_struct **p, *tmp;
+	struct vm_struct *tmp;
 	char *vaddr, *buf_start = buf;
 	int n;
 
-	for (p = &vmlist; (tmp = *p) ; p = &tmp->next) {
+	while ((tmp = vm_find_busy((unsigned long) addr)) != NULL) {
 		vaddr = (char *) tmp->addr;
 		while (addr < vaddr) {
 			if (count == 0)
 				goto finished;
 			put_fs_byte('\0', buf++), addr++, count--;
 		}
-		n = tmp->size - PAGE_SIZE;
-		if (addr > vaddr)
-			n -= addr - vaddr;
+		n = vaddr + tmp->size - PAGE_SIZE - addr;
 		while (--n >= 0) {
 			if (count == 0)
 				goto finished;
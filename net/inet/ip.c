@@ -522,12 +522,24 @@ ip_send_check(struct iphdr *iph)
 /************************ Fragment Handlers From NET2E not yet with tweaks to beat 4K **********************************/
 
 static struct ipq *ipqueue = NULL;		/* IP fragment queue	*/
+static struct kmem_cache *ipq_cachep = NULL;
+static struct kmem_cache *ipfrag_cachep = NULL;
+
+/* Set up the object caches for fragment queues and fragments. */
+void ip_init(void)
+{
+	ipq_cachep = kmem_cache_create("ipq", sizeof(struct ipq), 0, NULL);
+	ipfrag_cachep = kmem_cache_create("ipfrag", sizeof(struct ipfrag), 0, NULL);
+	if (ipq_cachep == NULL || ipfrag_cachep == NULL)
+		panic("ip_init: cannot create fragment caches");
+}
+
  /* Create a new fragment entry. */
 static struct ipfrag *ip_frag_create(int offset, int end, struct sk_buff *skb, unsigned char *ptr)
 {
    	struct ipfrag *fp;
  
-   	fp = (struct ipfrag *) kmalloc(sizeof(struct ipfrag), GFP_ATOMIC);
+   	fp = (struct ipfrag *) kmem_cache_alloc(ipfrag_cachep, GFP_ATOMIC);
    	if (fp == NULL) 
    	{
 	 	printk("IP: frag_create: no memory left !\n");
@@ -610,7 +622,7 @@ static void ip_free(struct ipq *qp)
  		xp = fp->next;
  		IS_SKB(fp->skb);
  		kfree_skb(fp->skb,FREE_READ);
- 		kfree_s(fp, sizeof(struct ipfrag));
+ 		kmem_cache_free(ipfrag_cachep, fp);
  		fp = xp;
    	}
    	
@@ -623,7 +635,7 @@ static void ip_free(struct ipq *qp)
    	kfree_s(qp->iph, qp->ihlen + 8);
  
    	/* Finally, release the queue descriptor itself. */
-   	kfree_s(qp, sizeof(struct ipq));
+   	kmem_cache_free(ipq_cachep, qp);
 /*   	printk("ip_free:done\n");*/
    	sti();
  }
@@ -665,7 +677,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
   	int maclen;
   	int ihlen;
 
-  	qp = (struct ipq *) kmalloc(sizeof(struct ipq), GFP_ATOMIC);
+  	qp = (struct ipq *) kmem_cache_alloc(ipq_cachep, GFP_ATOMIC);
   	if (qp == NULL) 
   	{
 		printk("IP: create: no memory left !\n");
@@ -679,7 +691,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
   	if (qp->mac == NULL) 
   	{
 		printk("IP: create: no memory left !\n");
-		kfree_s(qp, sizeof(struct ipq));
+		kmem_cache_free(ipq_cachep, qp);
 		return(NULL);
   	}
 
@@ -690,7 +702,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
   	{
 		printk("IP: create: no memory left !\n");
 		kfree_s(qp->mac, maclen);
-		kfree_s(qp, sizeof(struct ipq));
+		kmem_cache_free(ipq_cachep, qp);
 		return(NULL);
   	}
 
@@ -705,6 +717,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
 /*  	printk("Protocol = %d\n",qp->iph->protocol);*/
 	
   	/* Start a timer for this entry. */
+  	init_timer(&qp->timer);
   	qp->timer.expires = IP_FRAG_TIME;		/* about 30 seconds	*/
   	qp->timer.data = (unsigned long) qp;		/* pointer to queue	*/
   	qp->timer.function = ip_expire;			/* expire function	*/
@@ -924,7 +937,7 @@ static struct sk_buff *ip_defrag(struct iphdr *iph, struct sk_buff *skb, struct
  			if (tfp->next != NULL) 
  				next->next->prev = next->prev;
  			
- 			kfree_s(next, sizeof(struct ipfrag));
+ 			kmem_cache_free(ipfrag_cachep, next);
  		}
  		DPRINTF((DBG_IP, "IP: defrag: fixed high overlap %d bytes\n", i));
    	}
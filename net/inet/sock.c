@@ -96,6 +96,7 @@
 
 
 int inet_debug = DBG_OFF;		/* INET module debug flag	*/
+struct kmem_cache *sock_cachep = NULL;	/* all struct socks come from here */
 
 
 #define min(a,b)	((a)<(b)?(a):(b))
@@ -430,7 +431,7 @@ destroy_sock(struct sock *sk)
    */
 	  if (sk->rmem_alloc == 0 && sk->wmem_alloc == 0) 
 	  {
-		kfree_s((void *)sk,sizeof(*sk));
+		kmem_cache_free(sock_cachep, sk);
 	  } 
 	  else 
 	  {
@@ -758,7 +759,7 @@ inet_create(struct socket *sock, int protocol)
   struct proto *prot;
   int err;
 
-  sk = (struct sock *) kmalloc(sizeof(*sk), GFP_KERNEL);
+  sk = (struct sock *) kmem_cache_alloc(sock_cachep, GFP_KERNEL);
   if (sk == NULL) 
   	return(-ENOMEM);
   sk->num = 0;
@@ -767,7 +768,7 @@ inet_create(struct socket *sock, int protocol)
 	case SOCK_STREAM:
 	case SOCK_SEQPACKET:
 		if (protocol && protocol != IPPROTO_TCP) {
-			kfree_s((void *)sk, sizeof(*sk));
+			kmem_cache_free(sock_cachep, sk);
 			return(-EPROTONOSUPPORT);
 		}
 		protocol = IPPROTO_TCP;
@@ -777,7 +778,7 @@ inet_create(struct socket *sock, int protocol)
 
 	case SOCK_DGRAM:
 		if (protocol && protocol != IPPROTO_UDP) {
-			kfree_s((void *)sk, sizeof(*sk));
+			kmem_cache_free(sock_cachep, sk);
 			return(-EPROTONOSUPPORT);
 		}
 		protocol = IPPROTO_UDP;
@@ -787,11 +788,11 @@ inet_create(struct socket *sock, int protocol)
       
 	case SOCK_RAW:
 		if (!suser()) {
-			kfree_s((void *)sk, sizeof(*sk));
+			kmem_cache_free(sock_cachep, sk);
 			return(-EPERM);
 		}
 		if (!protocol) {
-			kfree_s((void *)sk, sizeof(*sk));
+			kmem_cache_free(sock_cachep, sk);
 			return(-EPROTONOSUPPORT);
 		}
 		prot = &raw_prot;
@@ -805,11 +806,11 @@ inet_create(struct socket *sock, int protocol)
 
 	case SOCK_PACKET:
 		if (!suser()) {
-			kfree_s((void *)sk, sizeof(*sk));
+			kmem_cache_free(sock_cachep, sk);
 			return(-EPERM);
 		}
 		if (!protocol) {
-			kfree_s((void *)sk, sizeof(*sk));
+			kmem_cache_free(sock_cachep, sk);
 			return(-EPROTONOSUPPORT);
 		}
 		prot = &packet_prot;
@@ -821,7 +822,7 @@ inet_create(struct socket *sock, int protocol)
 		break;
 
 	default:
-		kfree_s((void *)sk, sizeof(*sk));
+		kmem_cache_free(sock_cachep, sk);
 		return(-ESOCKTNOSUPPORT);
   }
   sk->socket = sock;
@@ -897,6 +898,8 @@ inet_create(struct socket *sock, int protocol)
   sk->send_head = NULL;
   sk->timeout = 0;
   sk->broadcast = 0;
+  init_timer(&sk->timer);
+  init_timer(&sk->partial_timer);
   sk->timer.data = (unsigned long)sk;
   sk->timer.function = &net_timer;
   sk->back_log = NULL;
@@ -1194,7 +1197,7 @@ inet_accept(struct socket *sock, struct socket *newsock, int flags)
    * We need to free it up because the tcp module creates
    * it's own when it accepts one.
    */
-  if (newsock->data) kfree_s(newsock->data, sizeof(struct sock));
+  if (newsock->data) kmem_cache_free(sock_cachep, newsock->data);
   newsock->data = NULL;
 
   if (sk1->prot->accept == NULL) return(-EOPNOTSUPP);
@@ -1872,6 +1875,12 @@ void inet_proto_init(struct ddi_proto *pro)
 
   seq_offset = CURRENT_TIME*250;
 
+  /* Socks and IP fragment queues come from their own object caches. */
+  sock_cachep = kmem_cache_create("sock", sizeof(struct sock), 0, NULL);
+  if (sock_cachep == NULL)
+	panic("inet_proto_init: cannot create sock cache");
+  ip_init();
+
   /* Add all the protocols. */
   for(i = 0; i < SOCK_ARRAY_SIZE; i++) {
 	tcp_prot.sock_array[i] = NULL;
@@ -245,6 +245,8 @@ struct proto {
 #define SEND_SHUTDOWN	2
 
 
+extern struct kmem_cache	*sock_cachep;
+
 extern void			destroy_sock(struct sock *sk);
 extern unsigned short		get_new_socknum(struct proto *, unsigned short);
 extern void			put_sock(unsigned short, struct sock *); 
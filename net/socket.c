@@ -106,7 +106,7 @@ get_fd(struct inode *inode)
   for (fd = 0; fd < NR_OPEN; ++fd)
 	if (!current->filp[fd]) break;
   if (fd == NR_OPEN) {
-	file->f_count = 0;
+	put_filp(file);
 	return(-1);
   }
   FD_CLR(fd, &current->close_on_exec);